@@ -0,0 +1,159 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+// Bump allocator: the allocations of a statement are taken from blocks one
+// after the other and released all at once. The blocks are kept for the next
+// statements, the arena only grows to the needs of the largest one.
+
+#define ARENA_ALIGN 16
+
+struct ArenaBlock {
+  arena_block* next;
+  size_t size;
+  size_t used;
+  size_t padding;  // the bytes after the header stay aligned
+};
+
+struct Arena {
+  arena_block* first;
+  arena_block* current;
+  size_t block_size;
+  size_t capacity;  // bytes of every block
+};
+
+static arena_block* new_block(size_t size) {
+  arena_block* block = (arena_block*)malloc(sizeof(arena_block) + size);
+  assert(block != NULL);
+  block->next = NULL;
+  block->size = size;
+  block->used = 0;
+  return block;
+}
+
+arena* arena_create(size_t block_size) {
+  arena* a = (arena*)malloc(sizeof(arena));
+  assert(a != NULL);
+  a->block_size = block_size;
+  a->first = new_block(block_size);
+  a->current = a->first;
+  a->capacity = block_size;
+  return a;
+}
+
+void arena_destroy(arena* a) {
+  if (a == NULL) {
+    return;
+  }
+  arena_block* block = a->first;
+  while (block != NULL) {
+    arena_block* next = block->next;
+    free(block);
+    block = next;
+  }
+  free(a);
+}
+
+// The next large enough block is reused, the smaller ones are skipped until
+// the arena is reset. A new block is inserted when there's none. A larger
+// allocation than the blocks gets a block of its own.
+void* arena_alloc(arena* a, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  arena_block* block = a->current;
+  if (block->used + size > block->size) {
+    arena_block* next = block->next;
+    while (next != NULL && next->size < size) {
+      next = next->next;
+    }
+    if (next == NULL) {
+      next = new_block(size > a->block_size ? size : a->block_size);
+      next->next = block->next;
+      block->next = next;
+      a->capacity += next->size;
+    }
+    next->used = 0;
+    block = next;
+    a->current = block;
+  }
+  char* bytes = (char*)(block + 1) + block->used;
+  block->used += size;
+  return bytes;
+}
+
+char* arena_strdup(arena* a, const char* s) {
+  size_t len = strlen(s);
+  char* copy = (char*)arena_alloc(a, len + 1);
+  memcpy(copy, s, len + 1);
+  return copy;
+}
+
+arena_mark arena_save(arena* a) {
+  arena_mark mark = {a->current, a->current->used};
+  return mark;
+}
+
+void arena_restore(arena* a, arena_mark mark) {
+  a->current = mark.block;
+  a->current->used = mark.used;
+}
+
+void arena_reset(arena* a) {
+  a->current = a->first;
+  a->first->used = 0;
+}
+
+size_t arena_capacity(arena* a) {
+  return a->capacity;
+}
+
+int example_arena(void) {
+  arena* a = arena_create(1024);
+  assert(arena_capacity(a) == 1024);
+
+  // aligned and distinct
+  char* first = (char*)arena_alloc(a, 3);
+  char* second = (char*)arena_alloc(a, 5);
+  assert((size_t)first % ARENA_ALIGN == 0 && (size_t)second % ARENA_ALIGN == 0);
+  assert(second >= first + 3);
+  char* copy = arena_strdup(a, "select");
+  assert(strcmp(copy, "select") == 0);
+
+  // the blocks are chained, a large allocation has its own
+  for (int i = 0; i < 100; i++) {
+    memset(arena_alloc(a, 100), i, 100);
+  }
+  char* large = (char*)arena_alloc(a, 5000);
+  memset(large, 1, 5000);
+  size_t capacity = arena_capacity(a);
+  assert(capacity >= 100 * 112 + 5000);
+
+  // a reset keeps the blocks, the same statement doesn't grow the arena
+  for (int statement = 0; statement < 10; statement++) {
+    arena_reset(a);
+    assert(arena_alloc(a, 3) == first);
+    for (int i = 0; i < 100; i++) {
+      memset(arena_alloc(a, 100), i, 100);
+    }
+    memset(arena_alloc(a, 5000), 1, 5000);
+    assert(arena_capacity(a) == capacity);
+  }
+
+  // a mark releases what was allocated after it
+  arena_reset(a);
+  arena_alloc(a, 10);
+  arena_mark mark = arena_save(a);
+  char* row = (char*)arena_alloc(a, 2000);
+  for (int i = 0; i < 1000; i++) {
+    arena_restore(a, mark);
+    assert(arena_alloc(a, 2000) == row);
+  }
+  assert(arena_capacity(a) == capacity);
+  arena_destroy(a);
+
+  printf("done arena\n");
+  return 0;
+}
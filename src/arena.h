@@ -0,0 +1,27 @@
+#ifndef _ARENA_H__
+#define _ARENA_H__
+
+#include <stddef.h>
+
+#define ARENA_BLOCK_SIZE (64 * 1024)
+
+typedef struct Arena arena;
+typedef struct ArenaBlock arena_block;
+
+// Where the arena was, everything allocated since is released by restoring it
+typedef struct ArenaMark {
+  arena_block* block;
+  size_t used;
+} arena_mark;
+
+arena* arena_create(size_t block_size);
+void arena_destroy(arena* a);
+void* arena_alloc(arena* a, size_t size);
+char* arena_strdup(arena* a, const char* s);
+arena_mark arena_save(arena* a);
+void arena_restore(arena* a, arena_mark mark);
+void arena_reset(arena* a);
+size_t arena_capacity(arena* a);
+int example_arena(void);
+
+#endif  // _ARENA_H__
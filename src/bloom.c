@@ -0,0 +1,138 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bloom.h"
+
+// Split block Bloom filters: a key only sets bits in one block of 256 bits,
+// a bit in each of its 8 words, so a lookup reads a single cache line. The
+// high bits of the hash choose the block, the low ones the bits.
+
+#define BLOOM_BLOCK_WORDS 8
+
+static const uint32_t salts[BLOOM_BLOCK_WORDS] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u};
+
+bloom* bloom_create(size_t nb_keys_per_filter) {
+  bloom* filters = (bloom*)malloc(sizeof(bloom));
+  assert(filters != NULL);
+  size_t nb_bits = nb_keys_per_filter * BLOOM_BITS_PER_KEY;
+  filters->blocks_per_filter = 1;
+  while (filters->blocks_per_filter * BLOOM_BLOCK_WORDS * 32 < nb_bits) {
+    filters->blocks_per_filter *= 2;
+  }
+  filters->nb_filters = 0;
+  filters->words = NULL;
+  return filters;
+}
+
+void bloom_destroy(bloom* filters) {
+  if (filters == NULL) {
+    return;
+  }
+  free(filters->words);
+  free(filters);
+}
+
+size_t bloom_nb_words(bloom* filters) {
+  return filters->nb_filters * filters->blocks_per_filter * BLOOM_BLOCK_WORDS;
+}
+
+// New filters are empty.
+void bloom_resize(bloom* filters, size_t nb_filters) {
+  size_t old_words = bloom_nb_words(filters);
+  filters->nb_filters = nb_filters;
+  size_t nb_words = bloom_nb_words(filters);
+  filters->words =
+      (uint32_t*)realloc(filters->words, sizeof(uint32_t) * (nb_words + 1));
+  assert(filters->words != NULL);
+  if (nb_words > old_words) {
+    memset(filters->words + old_words, 0,
+           sizeof(uint32_t) * (nb_words - old_words));
+  }
+}
+
+void bloom_clear(bloom* filters) {
+  memset(filters->words, 0, sizeof(uint32_t) * bloom_nb_words(filters));
+}
+
+// FNV-1a and the murmur3 finaliser
+uint64_t bloom_hash(const void* key, size_t length) {
+  const unsigned char* bytes = (const unsigned char*)key;
+  uint64_t hash = 14695981039346656037u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211u;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdu;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53u;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static uint32_t* find_block(bloom* filters, size_t filter, uint64_t hash) {
+  assert(filter < filters->nb_filters);
+  size_t block = (size_t)(hash >> 32) & (filters->blocks_per_filter - 1);
+  return filters->words +
+         (filter * filters->blocks_per_filter + block) * BLOOM_BLOCK_WORDS;
+}
+
+void bloom_add(bloom* filters, size_t filter, uint64_t hash) {
+  uint32_t* block = find_block(filters, filter, hash);
+  uint32_t low = (uint32_t)hash;
+  for (size_t i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+    block[i] |= (uint32_t)1 << ((low * salts[i]) >> 27);
+  }
+}
+
+// false when the key was never added to the filter
+bool bloom_may_contain(bloom* filters, size_t filter, uint64_t hash) {
+  uint32_t* block = find_block(filters, filter, hash);
+  uint32_t low = (uint32_t)hash;
+  for (size_t i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+    if ((block[i] & ((uint32_t)1 << ((low * salts[i]) >> 27))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+int example_bloom(void) {
+  size_t nb_keys = 1000;
+  bloom* filters = bloom_create(nb_keys);
+  assert(filters->blocks_per_filter * 256 >= nb_keys * BLOOM_BITS_PER_KEY);
+  bloom_resize(filters, 2);
+  for (long key = 0; key < (long)nb_keys; key++) {
+    bloom_add(filters, 0, bloom_hash(&key, sizeof(long)));
+  }
+  // no false negative
+  for (long key = 0; key < (long)nb_keys; key++) {
+    assert(bloom_may_contain(filters, 0, bloom_hash(&key, sizeof(long))));
+    assert(!bloom_may_contain(filters, 1, bloom_hash(&key, sizeof(long))));
+  }
+  // about 1% of false positives at 10 bits per key
+  size_t nb_false = 0;
+  for (long key = (long)nb_keys; key < 101 * (long)nb_keys; key++) {
+    nb_false += bloom_may_contain(filters, 0, bloom_hash(&key, sizeof(long)));
+  }
+  printf("false positives: %ld / %ld\n", nb_false, 100 * nb_keys);
+  assert(nb_false < 3 * nb_keys);
+
+  // growing keeps the filters
+  bloom_resize(filters, 5);
+  long key = 42;
+  assert(bloom_may_contain(filters, 0, bloom_hash(&key, sizeof(long))));
+  assert(!bloom_may_contain(filters, 4, bloom_hash(&key, sizeof(long))));
+  bloom_clear(filters);
+  assert(!bloom_may_contain(filters, 0, bloom_hash(&key, sizeof(long))));
+  bloom_destroy(filters);
+
+  printf("done bloom\n");
+  return 0;
+}
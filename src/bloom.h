@@ -0,0 +1,27 @@
+#ifndef _BLOOM_H__
+#define _BLOOM_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BLOOM_BITS_PER_KEY 10
+
+// A Bloom filter per page of a table, each one made of blocks of 8 words.
+typedef struct Bloom {
+  size_t blocks_per_filter;  // a power of two
+  size_t nb_filters;
+  uint32_t* words;
+} bloom;
+
+bloom* bloom_create(size_t nb_keys_per_filter);
+void bloom_destroy(bloom* filters);
+void bloom_resize(bloom* filters, size_t nb_filters);
+void bloom_clear(bloom* filters);
+uint64_t bloom_hash(const void* key, size_t length);
+void bloom_add(bloom* filters, size_t filter, uint64_t hash);
+bool bloom_may_contain(bloom* filters, size_t filter, uint64_t hash);
+size_t bloom_nb_words(bloom* filters);
+int example_bloom(void);
+
+#endif  // _BLOOM_H__
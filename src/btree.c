@@ -0,0 +1,356 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "btree.h"
+
+// Maximum number of entries in a node. An entry is a (key, row) pair so
+// duplicated keys are still totally ordered and can be removed one by one.
+#define BTREE_ORDER 64
+
+struct BTreeNode {
+  bool is_leaf;
+  size_t nb_keys;
+  char* keys;
+  size_t rows[BTREE_ORDER];
+  struct BTreeNode* children[BTREE_ORDER + 1];
+  struct BTreeNode* next;  // leaves only, next leaf in key order
+};
+
+static btree_node* create_node(btree* tree, bool is_leaf) {
+  btree_node* node = (btree_node*)malloc(sizeof(btree_node));
+  assert(node != NULL);
+  node->is_leaf = is_leaf;
+  node->nb_keys = 0;
+  node->keys = (char*)malloc(tree->key_size * BTREE_ORDER);
+  assert(node->keys != NULL);
+  node->next = NULL;
+  return node;
+}
+
+static void destroy_node(btree_node* node) {
+  if (!node->is_leaf) {
+    for (size_t i = 0; i <= node->nb_keys; i++) {
+      destroy_node(node->children[i]);
+    }
+  }
+  free(node->keys);
+  free(node);
+}
+
+btree* btree_create(btree_key_kind kind, size_t key_size) {
+  btree* tree = (btree*)malloc(sizeof(btree));
+  assert(tree != NULL);
+  tree->kind = kind;
+  tree->key_size = key_size;
+  tree->nb_entries = 0;
+  tree->root = create_node(tree, true);
+  return tree;
+}
+
+void btree_destroy(btree* tree) {
+  if (tree == NULL) {
+    return;
+  }
+  destroy_node(tree->root);
+  free(tree);
+}
+
+void btree_clear(btree* tree) {
+  destroy_node(tree->root);
+  tree->root = create_node(tree, true);
+  tree->nb_entries = 0;
+}
+
+static char* key_at(btree* tree, btree_node* node, size_t index) {
+  return node->keys + index * tree->key_size;
+}
+
+// keys may come straight from a row, they aren't always aligned.
+int btree_compare_keys(btree* tree, const void* a, const void* b) {
+  long a_int, b_int;
+  double a_flt, b_flt;
+  switch (tree->kind) {
+    case BTREE_INT:
+      memcpy(&a_int, a, sizeof(long));
+      memcpy(&b_int, b, sizeof(long));
+      return (a_int > b_int) - (a_int < b_int);
+    case BTREE_FLT:
+      memcpy(&a_flt, a, sizeof(double));
+      memcpy(&b_flt, b, sizeof(double));
+      return (a_flt > b_flt) - (a_flt < b_flt);
+    case BTREE_STR:
+      return strncmp((const char*)a, (const char*)b, tree->key_size);
+  }
+  return 0;
+}
+
+static int compare_entries(btree* tree,
+                           const void* key_a,
+                           size_t row_a,
+                           const void* key_b,
+                           size_t row_b) {
+  int cmp = btree_compare_keys(tree, key_a, key_b);
+  if (cmp != 0) {
+    return cmp;
+  }
+  return (row_a > row_b) - (row_a < row_b);
+}
+
+// first entry of a leaf which is >= (key, row)
+static size_t lower_bound(btree* tree,
+                          btree_node* node,
+                          const void* key,
+                          size_t row) {
+  size_t low = 0;
+  size_t high = node->nb_keys;
+  while (low < high) {
+    size_t middle = (low + high) / 2;
+    if (compare_entries(tree, key_at(tree, node, middle), node->rows[middle],
+                        key, row) < 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+// entries equal to a separator live in its right child
+static size_t child_index(btree* tree,
+                          btree_node* node,
+                          const void* key,
+                          size_t row) {
+  size_t low = 0;
+  size_t high = node->nb_keys;
+  while (low < high) {
+    size_t middle = (low + high) / 2;
+    if (compare_entries(tree, key_at(tree, node, middle), node->rows[middle],
+                        key, row) <= 0) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+static void insert_entry_at(btree* tree,
+                            btree_node* node,
+                            size_t position,
+                            const void* key,
+                            size_t row) {
+  size_t key_size = tree->key_size;
+  memmove(key_at(tree, node, position + 1), key_at(tree, node, position),
+          (node->nb_keys - position) * key_size);
+  memmove(&node->rows[position + 1], &node->rows[position],
+          (node->nb_keys - position) * sizeof(size_t));
+  memcpy(key_at(tree, node, position), key, key_size);
+  node->rows[position] = row;
+  node->nb_keys++;
+}
+
+// Returns the new right sibling if the node had to be split, NULL otherwise.
+// The separator between node and its sibling is copied into promoted_key and
+// promoted_row.
+static btree_node* insert_rec(btree* tree,
+                              btree_node* node,
+                              const void* key,
+                              size_t row,
+                              char* promoted_key,
+                              size_t* promoted_row) {
+  size_t key_size = tree->key_size;
+  if (node->is_leaf) {
+    insert_entry_at(tree, node, lower_bound(tree, node, key, row), key, row);
+  } else {
+    size_t index = child_index(tree, node, key, row);
+    char child_key[key_size];
+    size_t child_row;
+    btree_node* sibling = insert_rec(tree, node->children[index], key, row,
+                                     child_key, &child_row);
+    if (sibling == NULL) {
+      return NULL;
+    }
+    memmove(&node->children[index + 2], &node->children[index + 1],
+            (node->nb_keys - index) * sizeof(btree_node*));
+    node->children[index + 1] = sibling;
+    insert_entry_at(tree, node, index, child_key, child_row);
+  }
+  if (node->nb_keys < BTREE_ORDER) {
+    return NULL;
+  }
+
+  // split the full node in two halves
+  btree_node* right = create_node(tree, node->is_leaf);
+  size_t middle = BTREE_ORDER / 2;
+  if (node->is_leaf) {
+    right->nb_keys = BTREE_ORDER - middle;
+    memcpy(right->keys, key_at(tree, node, middle), right->nb_keys * key_size);
+    memcpy(right->rows, &node->rows[middle], right->nb_keys * sizeof(size_t));
+    memcpy(promoted_key, right->keys, key_size);
+    *promoted_row = right->rows[0];
+    right->next = node->next;
+    node->next = right;
+  } else {
+    right->nb_keys = BTREE_ORDER - middle - 1;
+    memcpy(right->keys, key_at(tree, node, middle + 1),
+           right->nb_keys * key_size);
+    memcpy(right->rows, &node->rows[middle + 1],
+           right->nb_keys * sizeof(size_t));
+    memcpy(right->children, &node->children[middle + 1],
+           (right->nb_keys + 1) * sizeof(btree_node*));
+    memcpy(promoted_key, key_at(tree, node, middle), key_size);
+    *promoted_row = node->rows[middle];
+  }
+  node->nb_keys = middle;
+  return right;
+}
+
+void btree_insert(btree* tree, const void* key, size_t row) {
+  char promoted_key[tree->key_size];
+  size_t promoted_row;
+  btree_node* sibling =
+      insert_rec(tree, tree->root, key, row, promoted_key, &promoted_row);
+  if (sibling != NULL) {
+    btree_node* root = create_node(tree, false);
+    memcpy(root->keys, promoted_key, tree->key_size);
+    root->rows[0] = promoted_row;
+    root->children[0] = tree->root;
+    root->children[1] = sibling;
+    root->nb_keys = 1;
+    tree->root = root;
+  }
+  tree->nb_entries++;
+}
+
+// Nodes aren't merged when they get under filled. Separators stay valid
+// bounds, empty leaves are skipped by the cursors.
+bool btree_remove(btree* tree, const void* key, size_t row) {
+  btree_node* node = tree->root;
+  while (!node->is_leaf) {
+    node = node->children[child_index(tree, node, key, row)];
+  }
+  size_t position = lower_bound(tree, node, key, row);
+  if (position >= node->nb_keys ||
+      compare_entries(tree, key_at(tree, node, position), node->rows[position],
+                      key, row) != 0) {
+    return false;
+  }
+  memmove(key_at(tree, node, position), key_at(tree, node, position + 1),
+          (node->nb_keys - position - 1) * tree->key_size);
+  memmove(&node->rows[position], &node->rows[position + 1],
+          (node->nb_keys - position - 1) * sizeof(size_t));
+  node->nb_keys--;
+  tree->nb_entries--;
+  return true;
+}
+
+static void skip_exhausted_leaves(btree_cursor* cursor) {
+  while (cursor->leaf != NULL && cursor->position >= cursor->leaf->nb_keys) {
+    cursor->leaf = cursor->leaf->next;
+    cursor->position = 0;
+  }
+}
+
+// Position a cursor on the first entry whose key is >= key.
+// A NULL key positions it on the smallest entry.
+btree_cursor btree_seek(btree* tree, const void* key) {
+  btree_cursor cursor;
+  cursor.tree = tree;
+  btree_node* node = tree->root;
+  while (!node->is_leaf) {
+    node = (key == NULL) ? node->children[0]
+                         : node->children[child_index(tree, node, key, 0)];
+  }
+  cursor.leaf = node;
+  cursor.position = (key == NULL) ? 0 : lower_bound(tree, node, key, 0);
+  skip_exhausted_leaves(&cursor);
+  return cursor;
+}
+
+bool btree_cursor_valid(btree_cursor* cursor) {
+  return cursor->leaf != NULL;
+}
+
+void btree_cursor_next(btree_cursor* cursor) {
+  cursor->position++;
+  skip_exhausted_leaves(cursor);
+}
+
+const void* btree_cursor_key(btree_cursor* cursor) {
+  return key_at(cursor->tree, cursor->leaf, cursor->position);
+}
+
+size_t btree_cursor_row(btree_cursor* cursor) {
+  return cursor->leaf->rows[cursor->position];
+}
+
+bool btree_find(btree* tree, const void* key, size_t* row) {
+  btree_cursor cursor = btree_seek(tree, key);
+  if (!btree_cursor_valid(&cursor) ||
+      btree_compare_keys(tree, btree_cursor_key(&cursor), key) != 0) {
+    return false;
+  }
+  if (row != NULL) {
+    *row = btree_cursor_row(&cursor);
+  }
+  return true;
+}
+
+int example_btree(void) {
+  btree* tree = btree_create(BTREE_INT, sizeof(long));
+  size_t nb_keys = 10000;
+  // 7919 is prime, this visits every key in a scrambled order
+  for (size_t i = 0; i < nb_keys; i++) {
+    long key = (long)((i * 7919) % nb_keys);
+    btree_insert(tree, &key, (size_t)key + 1);
+  }
+  assert(tree->nb_entries == nb_keys);
+  for (long key = 0; key < (long)nb_keys; key++) {
+    size_t row;
+    assert(btree_find(tree, &key, &row));
+    assert(row == (size_t)key + 1);
+  }
+  long missing = -3;
+  assert(!btree_find(tree, &missing, NULL));
+
+  for (long key = 0; key < (long)nb_keys; key += 2) {
+    assert(btree_remove(tree, &key, (size_t)key + 1));
+  }
+  long removed = 10;
+  assert(!btree_remove(tree, &removed, 11));
+  assert(!btree_find(tree, &removed, NULL));
+
+  // ordered iteration from a key which was removed
+  btree_cursor cursor = btree_seek(tree, &removed);
+  long expected = 11;
+  for (; btree_cursor_valid(&cursor); btree_cursor_next(&cursor)) {
+    long key;
+    memcpy(&key, btree_cursor_key(&cursor), sizeof(long));
+    assert(key == expected);
+    expected += 2;
+  }
+  assert(expected == (long)nb_keys + 1);
+  btree_destroy(tree);
+
+  // duplicated string keys, as in a secondary index
+  btree* names = btree_create(BTREE_STR, 8);
+  char key[8] = "'abc'";
+  for (size_t row = 0; row < 200; row++) {
+    btree_insert(names, key, row);
+  }
+  assert(btree_remove(names, key, 42));
+  size_t count = 0;
+  for (btree_cursor c = btree_seek(names, key); btree_cursor_valid(&c);
+       btree_cursor_next(&c)) {
+    assert(btree_cursor_row(&c) != 42);
+    count++;
+  }
+  assert(count == 199);
+  btree_destroy(names);
+
+  printf("done btree\n");
+  return 0;
+}
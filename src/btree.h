@@ -0,0 +1,42 @@
+#ifndef _BTREE_H__
+#define _BTREE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum BTreeKeyKind {
+  BTREE_INT,  // long
+  BTREE_FLT,  // double
+  BTREE_STR,  // char[key_size]
+} btree_key_kind;
+
+typedef struct BTreeNode btree_node;
+
+typedef struct BTree {
+  btree_key_kind kind;
+  size_t key_size;
+  size_t nb_entries;
+  btree_node* root;
+} btree;
+
+typedef struct BTreeCursor {
+  btree* tree;
+  btree_node* leaf;
+  size_t position;
+} btree_cursor;
+
+btree* btree_create(btree_key_kind kind, size_t key_size);
+void btree_destroy(btree* tree);
+void btree_clear(btree* tree);
+int btree_compare_keys(btree* tree, const void* a, const void* b);
+void btree_insert(btree* tree, const void* key, size_t row);
+bool btree_remove(btree* tree, const void* key, size_t row);
+bool btree_find(btree* tree, const void* key, size_t* row);
+btree_cursor btree_seek(btree* tree, const void* key);
+bool btree_cursor_valid(btree_cursor* cursor);
+void btree_cursor_next(btree_cursor* cursor);
+const void* btree_cursor_key(btree_cursor* cursor);
+size_t btree_cursor_row(btree_cursor* cursor);
+int example_btree(void);
+
+#endif  // _BTREE_H__
@@ -0,0 +1,11 @@
+#ifndef _CRC32C_H__
+#define _CRC32C_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+uint32_t crc32c(uint32_t crc, const void* data, size_t length);
+uint32_t crc32c_software(uint32_t crc, const void* data, size_t length);
+int example_crc32c(void);
+
+#endif  // _CRC32C_H__
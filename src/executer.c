@@ -1,21 +1,40 @@
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#include "arena.h"
+#include "bloom.h"
+#include "btree.h"
+#include "crc32c.h"
+#include "filter.h"
+#include "hash.h"
 #include "help.h"
 #include "lexer.h"
+#include "pager.h"
 #include "parser.h"
+#include "skiplist.h"
+#include "wal.h"
 
 #define MAXFORMAT 128
 
 #define DEBUG false
 
+// A table is compacted once this share of its rows are deleted.
+#define COMPACTION_PERCENT 50
+
 void runtime_error(const char* format, ...) {
   va_list args;
   va_start(args, format);
@@ -43,11 +62,14 @@ void runtime_error(const char* format, ...) {
 typedef enum AttrKind {
   D_INT,  // long
   D_FLT,  // double
-  D_CHR,  // char*
+  D_CHR,   // char*
+  D_DICT,  // char*, the row holds its code in the column dictionary
 } attr_kind;
 
-static char* repr_attr_kind[3] =
-    {[D_INT] = "INT", [D_FLT] = "FLOAT", [D_CHR] = "VARCHAR"};
+static char* repr_attr_kind[4] = {[D_INT] = "INT",
+                                  [D_FLT] = "FLOAT",
+                                  [D_CHR] = "VARCHAR",
+                                  [D_DICT] = "VARCHAR"};
 
 typedef struct {
   char* name;
@@ -108,11 +130,23 @@ attr_desc_size* desc_varchar(char* name, long unsigned int nb_char) {
   return d_varchar;
 }
 
+// A varchar with few distinct values, the rows hold their code.
+attr_desc_size* desc_dict(char* name, long unsigned int nb_char) {
+  attr_desc_size* d_dict = desc_varchar(name, nb_char);
+  if (d_dict != NULL) {
+    d_dict->desc = D_DICT;
+  }
+  return d_dict;
+}
+
 void print_schema(table_desc* td) {
   for (size_t i = 0; i < td->nb_attr; i++) {
     if (td->descs[i]->desc == D_CHR) {
       printf("%s: %s(%ld) - ", td->descs[i]->name,
              repr_attr_kind[td->descs[i]->desc], td->descs[i]->size);
+    } else if (td->descs[i]->desc == D_DICT) {
+      printf("%s: %s(%ld) DICT - ", td->descs[i]->name,
+             repr_attr_kind[td->descs[i]->desc], td->descs[i]->size);
     } else {
       printf("%s: %s - ", td->descs[i]->name,
              repr_attr_kind[td->descs[i]->desc]);
@@ -200,7 +234,9 @@ table_desc* create_table_desc_from_ast(ast_node* root) {
           return NULL;
         }
         size_t nb_char = (size_t)varchar_size->i_value;
-        desc = desc_varchar(colname->value, nb_char);
+        // varchar(n) DICT
+        desc = (type->right != NULL) ? desc_dict(colname->value, nb_char)
+                                     : desc_varchar(colname->value, nb_char);
         if (desc == NULL) {
           return NULL;
         }
@@ -219,506 +255,2927 @@ table_desc* create_table_desc_from_ast(ast_node* root) {
   return table;
 }
 
+typedef enum TableLayout {
+  L_ROWS,     // the values of a row are contiguous
+  L_COLUMNS,  // PAX, a page holds a minipage per column
+} table_layout;
+
+typedef enum IndexKind {
+  I_BTREE,  // ordered, for equalities and ranges
+  I_HASH,   // equalities only
+  I_BLOOM,  // a filter per page, equalities skip the pages without the value
+} index_kind;
+
+static char* repr_index_kind[3] = {
+    [I_BTREE] = "btree", [I_HASH] = "hash", [I_BLOOM] = "bloom"};
+
+// A secondary index: values of a column -> row index.
+typedef struct TableIndex {
+  char* name;
+  size_t column;
+  index_kind kind;
+  btree* tree;       // NULL until it's used
+  hash_index* hash;  // same
+  bloom* filters;    // always built, saved with the table
+} table_index;
+
+// A varchar wider than this header is stored out of line, German string
+// style: the header holds its length and first bytes. Strings of at most
+// VARCHAR_INLINE bytes are entirely in the header, longer ones are in the
+// string heap of their table.
+#define VARCHAR_INLINE 12
+
+typedef struct VarcharRef {
+  uint32_t length;
+  char prefix[4];
+  union {
+    char suffix[8];   // the bytes after the prefix, for short strings
+    uint64_t offset;  // in the heap, for long strings
+  };
+} varchar_ref;
+
+// Distinct values of a DICT column. A value is identified by its code, its
+// position in values.
+typedef struct Dictionary {
+  size_t size;  // of a value, as declared
+  size_t nb_values;
+  size_t capacity;
+  char* values;       // zero padded
+  hash_index* codes;  // value -> code
+} dictionary;
+
+// Smallest and largest values of a column in a page, strings are compared on
+// their first bytes. A page whose range can't satisfy a condition isn't
+// scanned.
+#define ZONE_PREFIX 8
+
+typedef union ZoneValue {
+  long i;
+  double f;
+  char s[ZONE_PREFIX];  // zero padded
+} zone_value;
+
+typedef struct Zone {
+  zone_value min;
+  zone_value max;
+} zone;
+
+// Rows of a table sorted by their primary key, a run is made of consecutive
+// rows. The first key of every block of rows_per_page rows is a fence: a
+// lookup searches the fences, then a single block. The Bloom filter of a run
+// tells the keys it can't hold.
+typedef struct SortedRun {
+  size_t first;
+  size_t nb_rows;
+  bool is_sorted;  // false once a key was updated, until the statement ends
+  char* fences;    // NULL until the run is searched
+  bloom* filter;   // same
+} sorted_run;
+
+// Storage of the ENGINE = LSM tables: an insert appends its row to the
+// memtable, the last rows, indexed by a skip list. A full memtable is sorted
+// in place and becomes the newest run, the runs are merged with the older
+// ones of about their size so there are O(log n) runs.
+#define LSM_MEMTABLE_ROWS 4096
+
+typedef struct LsmTree {
+  sorted_run* runs;  // oldest first
+  size_t nb_runs;
+  size_t runs_capacity;
+  size_t nb_flushed;   // rows in the runs, the memtable holds the others
+  skiplist* memtable;  // live rows of the memtable, NULL until it's used
+} lsm_tree;
+
+// place in the database file of a page or a description which was modified
+// since the last save
+#define NO_FILE_PAGE ((size_t)-1)
+
 typedef struct TableData {
   table_desc* schema;
   size_t nb_rows;
-  size_t capacity;
+  size_t capacity;  // rows fitting in the allocated pages
   size_t row_size;  // used bytes per row
-  void* values;
+  table_layout layout;
+  bool is_clustered;  // rows kept in the order of their primary key
+  size_t nb_sorted;   // first rows in key order, the others were appended
+  skiplist* appended;  // live appended rows, NULL until they're searched
+  lsm_tree* lsm;      // NULL unless the table uses the LSM engine
+  size_t* column_offsets;  // in a page, of the value of the first row
+  size_t* column_strides;  // between the values of consecutive rows
+  size_t rows_per_page;
+  size_t nb_pages;
+  size_t pages_capacity;
+  size_t* pages;    // page numbers in the buffer pool
+  btree* pk_index;  // column 0 -> row index, NULL until it's used
+  table_index** indexes;
+  size_t nb_indexes;
+  uint64_t* dead_rows;  // a bit per row, set when the row is deleted
+  size_t dead_words;
+  size_t nb_dead;  // deleted rows, still counted by nb_rows
+  char* heap;      // bytes of the long out of line varchars
+  size_t heap_size;
+  size_t heap_capacity;
+  size_t heap_garbage;  // bytes of deleted or overwritten strings
+  dictionary** dictionaries;  // per column, NULL unless it's a DICT column
+  size_t* file_pages;  // where each page was saved, NO_FILE_PAGE if modified
+  uint32_t* page_checksums;  // CRC32C of each saved page
+  zone* zones;         // of every column of a page, nb_attr per page
+  size_t meta_page;    // first file page of the saved description
+  size_t meta_length;
+  uint32_t meta_checksum;
 } table_data;
 
-table_data* create_page_for_table(table_desc* table) {
-  table_data* data = (table_data*)malloc(sizeof(table_data));
-  assert(data != NULL);
-  data->schema = table;
-  data->nb_rows = 0;
-  data->capacity = 16;
-  data->row_size = 0;
-  for (size_t i = 0; i < table->nb_attr; i++) {
-    data->row_size += table->descs[i]->size;
+static pager* buffer_pool;
+
+pager* get_buffer_pool(void) {
+  if (buffer_pool == NULL) {
+    buffer_pool = pager_create(PAGER_DEFAULT_BUDGET);
   }
-  data->values = (void*)malloc(data->row_size * data->capacity);
-  assert(data->values != NULL);
+  return buffer_pool;
+}
 
-  return data;
+// Tokens, tree and values extracted by a statement, released when it's done.
+static arena* statement_arena;
+
+arena* get_statement_arena(void) {
+  if (statement_arena == NULL) {
+    statement_arena = arena_create(ARENA_BLOCK_SIZE);
+  }
+  return statement_arena;
 }
 
-table_data* execute_create_table(ast_node* root) {
-  return create_page_for_table(create_table_desc_from_ast(root));
+btree_key_kind btree_kind_from_attr(attr_kind kind) {
+  switch (kind) {
+    case D_INT:
+      return BTREE_INT;
+    case D_FLT:
+      return BTREE_FLT;
+    case D_CHR:
+    case D_DICT:
+      return BTREE_STR;
+  }
+  return BTREE_INT;
 }
 
-void print_table(table_data* data) {
-  printf("\nSchema of table: %s\n", data->schema->name);
-  printf("Capacity: %ld rows, used rows: %ld, row size: %ld B\n\n",
-         data->capacity, data->nb_rows, data->row_size);
-  print_schema(data->schema);
+// Rows are stored in fixed size pages, a row is addressed by (page, slot).
+// Returns the page of the row, it stays pinned in the buffer pool until
+// unpin_row.
+char* pin_row(table_data* table, size_t row_index) {
+  size_t page = table->pages[row_index / table->rows_per_page];
+  return (char*)pager_pin(get_buffer_pool(), page);
 }
 
-void destroy_desc(attr_desc_size* desc) {
-  free(desc->name);
-  free(desc);
+// Address of a value in the pinned page of its row.
+char* get_field(table_data* table,
+                char* page,
+                size_t row_index,
+                size_t col_index) {
+  size_t slot = row_index % table->rows_per_page;
+  return page + table->column_offsets[col_index] +
+         slot * table->column_strides[col_index];
 }
 
-void destroy_table(table_data* table) {
-  for (size_t index_desc = 0; index_desc < table->schema->nb_attr;
-       index_desc++) {
-    destroy_desc(table->schema->descs[index_desc]);
+// The description of the table has to be saved again.
+void mark_modified(table_data* table) {
+  table->meta_page = NO_FILE_PAGE;
+}
+
+void unpin_row(table_data* table, size_t row_index, bool dirty) {
+  size_t index_page = row_index / table->rows_per_page;
+  pager_unpin(get_buffer_pool(), table->pages[index_page], dirty);
+  if (dirty) {
+    table->file_pages[index_page] = NO_FILE_PAGE;
+    mark_modified(table);
   }
-  free(table->schema->name);
-  free(table->schema);
-  free(table->values);
 }
-#define MAXTABLES 128
 
-table_data* find_table_from_name(table_data** tables,
-                                 char* name,
-                                 size_t nb_tables) {
-  for (size_t i = 0; i < nb_tables; i++) {
-    if (tables[i] == NULL) {
-      break;
-    }
-    if (strncmp(tables[i]->schema->name, name, strlen(name)) == 0) {
-      return tables[i];
+bool is_out_of_line(attr_desc_size* desc) {
+  return desc->desc == D_CHR && desc->size > sizeof(varchar_ref);
+}
+
+// bytes taken by a column in a row
+size_t field_width(attr_desc_size* desc) {
+  if (desc->desc == D_DICT) {
+    return sizeof(uint32_t);
+  }
+  return is_out_of_line(desc) ? sizeof(varchar_ref) : desc->size;
+}
+
+dictionary* create_dictionary(size_t size) {
+  dictionary* dict = (dictionary*)malloc(sizeof(dictionary));
+  assert(dict != NULL);
+  dict->size = size;
+  dict->nb_values = 0;
+  dict->capacity = 0;
+  dict->values = NULL;
+  dict->codes = hash_create(size, true);
+  return dict;
+}
+
+void destroy_dictionary(dictionary* dict) {
+  if (dict == NULL) {
+    return;
+  }
+  free(dict->values);
+  hash_destroy(dict->codes);
+  free(dict);
+}
+
+char* decode_value(dictionary* dict, uint32_t code) {
+  return dict->values + (size_t)code * dict->size;
+}
+
+bool find_code(dictionary* dict, const char* value, uint32_t* code) {
+  size_t row;
+  if (!hash_find(dict->codes, value, &row)) {
+    return false;
+  }
+  *code = (uint32_t)row;
+  return true;
+}
+
+// Code of a value of size bytes, a new value gets the next code.
+uint32_t encode_value(dictionary* dict, const char* value) {
+  uint32_t code;
+  if (find_code(dict, value, &code)) {
+    return code;
+  }
+  if (dict->nb_values == dict->capacity) {
+    dict->capacity = (dict->capacity == 0) ? 16 : dict->capacity * 2;
+    dict->values = (char*)realloc(dict->values, dict->capacity * dict->size);
+    assert(dict->values != NULL);
+  }
+  code = (uint32_t)dict->nb_values++;
+  memcpy(decode_value(dict, code), value, dict->size);
+  hash_insert(dict->codes, value, code);
+  return code;
+}
+
+uint64_t append_to_heap(table_data* table, const char* bytes, size_t length) {
+  if (table->heap_size + length > table->heap_capacity) {
+    table->heap_capacity = (table->heap_capacity == 0)
+                               ? 4096
+                               : table->heap_capacity * 2;
+    if (table->heap_capacity < table->heap_size + length) {
+      table->heap_capacity = table->heap_size + length;
     }
-    // TODO why ???
-    /* tables[i] += 1; */
+    table->heap = (char*)realloc(table->heap, table->heap_capacity);
+    assert(table->heap != NULL);
   }
+  memcpy(table->heap + table->heap_size, bytes, length);
+  table->heap_size += length;
+  return table->heap_size - length;
+}
 
-  return NULL;
+// Bytes of a string, in its header or in the heap.
+const char* varchar_bytes(const varchar_ref* ref, const char* heap) {
+  return ref->length <= VARCHAR_INLINE ? ref->prefix : heap + ref->offset;
 }
 
-bool new_tablename_is_unused(table_data** tables,
-                             size_t nb_tables,
-                             table_data* created_table) {
-  printf("is used %s\n", created_table->schema->name);
-  return find_table_from_name(tables, created_table->schema->name, nb_tables) ==
-         NULL;
+void make_varchar_ref(table_data* table,
+                      varchar_ref* ref,
+                      const char* bytes,
+                      size_t length) {
+  memset(ref, 0, sizeof(varchar_ref));
+  ref->length = (uint32_t)length;
+  if (length <= VARCHAR_INLINE) {
+    memcpy(ref->prefix, bytes, length);
+    return;
+  }
+  memcpy(ref->prefix, bytes, sizeof(ref->prefix));
+  ref->offset = append_to_heap(table, bytes, length);
 }
 
-typedef struct ExtractedValue {
-  char* colname;
-  attr_kind kind;
-  union {
-    long i;
-    double f;
-    char* s;
-  };
-} extracted_value;
+// The length and the prefix are compared first, the heap is only read when
+// they're equal.
+bool varchar_equals(const varchar_ref* ref,
+                    const char* heap,
+                    const char* bytes,
+                    size_t length) {
+  if (ref->length != length) {
+    return false;
+  }
+  size_t nb_prefix =
+      length < sizeof(ref->prefix) ? length : sizeof(ref->prefix);
+  if (memcmp(ref->prefix, bytes, nb_prefix) != 0) {
+    return false;
+  }
+  return memcmp(varchar_bytes(ref, heap) + nb_prefix, bytes + nb_prefix,
+                length - nb_prefix) == 0;
+}
 
-bool compare_extracted_value(extracted_value* a, ast_node* b) {
-  switch (a->kind) {
-    case D_INT:
-      return a->i == b->i_value;
-      break;
-    case D_FLT:
-      return a->f == b->f_value;
-      break;
-    case D_CHR:
-      return strcmp(a->s, b->value) == 0;
-      break;
+// Copy a value as it's declared: out of line varchars are copied back into
+// size bytes, zero padded.
+void read_declared_value(table_data* table,
+                         char* page,
+                         size_t row_index,
+                         size_t col_index,
+                         char* buffer) {
+  attr_desc_size* desc = table->schema->descs[col_index];
+  char* field = get_field(table, page, row_index, col_index);
+  if (desc->desc == D_DICT) {
+    uint32_t code;
+    memcpy(&code, field, sizeof(uint32_t));
+    memcpy(buffer, decode_value(table->dictionaries[col_index], code),
+           desc->size);
+    return;
   }
-  return false;
+  if (!is_out_of_line(desc)) {
+    memcpy(buffer, field, desc->size);
+    return;
+  }
+  varchar_ref ref;
+  memcpy(&ref, field, sizeof(varchar_ref));
+  memset(buffer, 0, desc->size);
+  memcpy(buffer, varchar_bytes(&ref, table->heap),
+         ref.length < desc->size ? ref.length : desc->size);
 }
 
-extracted_value** get_row_values(table_data* table,
-                                 size_t row_index,
-                                 size_t nb_attr) {
-  extracted_value** values =
-      (extracted_value**)malloc(sizeof(extracted_value*) * nb_attr);
-  assert(values != NULL);
+// Typed values read in the pinned page of their row, nothing is copied.
+long get_int(table_data* table,
+             char* page,
+             size_t row_index,
+             size_t col_index) {
+  long value;
+  memcpy(&value, get_field(table, page, row_index, col_index), sizeof(long));
+  return value;
+}
 
-  char* colnames[nb_attr];
-  size_t sizes[nb_attr];
-  attr_kind kinds[nb_attr];
-  size_t offsets[nb_attr];
+double get_float(table_data* table,
+                 char* page,
+                 size_t row_index,
+                 size_t col_index) {
+  double value;
+  memcpy(&value, get_field(table, page, row_index, col_index),
+         sizeof(double));
+  return value;
+}
 
-  size_t offset = 0;
-  size_t col_index = 0;
-  for (; col_index < nb_attr; col_index++) {
-    char* colname = table->schema->descs[col_index]->name;
-    colnames[col_index] = (char*)malloc(sizeof(char) * (strlen(colname) + 1));
-    assert(colnames[col_index] != NULL);
-
-    strncpy(colnames[col_index], colname, strlen(colname) + 1);
-    sizes[col_index] = table->schema->descs[col_index]->size;
-    kinds[col_index] = table->schema->descs[col_index]->desc;
-    offsets[col_index] = offset;
-    offset += table->schema->descs[col_index]->size;
-  }
-  offsets[col_index] = offset;
-
-  // extract the values
-
-  for (size_t col_index = 0; col_index < nb_attr; col_index++) {
-    void* read_value = (void*)malloc(sizes[col_index]);
-    assert(read_value != NULL);
-    /* printf("offset : %ld, size read: %ld\n", */
-    /*        line_index * table->row_size + offsets[col_index], */
-    /*        sizes[col_index]); */
-    extracted_value* value = (extracted_value*)malloc(sizeof(extracted_value));
-    assert(value != NULL);
-    value->kind = kinds[col_index];
-    value->colname =
-        (char*)malloc(sizeof(char*) * (strlen(colnames[col_index]) + 1));
-    assert(value->colname != NULL);
-    strcpy(value->colname, colnames[col_index]);
-
-    memcpy(
-        read_value,
-        (char*)table->values + row_index * table->row_size + offsets[col_index],
-        sizes[col_index]);
-    if (DEBUG) {
-      printf("%s ", value->colname);
+// Bytes of a string where they're stored: the page, the heap or the
+// dictionary of the column. length doesn't count the zero padding.
+const char* get_string(table_data* table,
+                       char* page,
+                       size_t row_index,
+                       size_t col_index,
+                       size_t* length) {
+  attr_desc_size* desc = table->schema->descs[col_index];
+  const char* field = get_field(table, page, row_index, col_index);
+  if (desc->desc == D_DICT) {
+    uint32_t code;
+    memcpy(&code, field, sizeof(uint32_t));
+    field = decode_value(table->dictionaries[col_index], code);
+  } else if (is_out_of_line(desc)) {
+    varchar_ref ref;
+    memcpy(&ref, field, sizeof(varchar_ref));
+    *length = ref.length < desc->size ? ref.length : desc->size;
+    return ref.length <= VARCHAR_INLINE ? field + offsetof(varchar_ref, prefix)
+                                        : table->heap + ref.offset;
+  }
+  *length = strnlen(field, desc->size);
+  return field;
+}
+
+// Key of a row in the index of a column. The buffer holds the size of the
+// column, it's only used by out of line varchars.
+char* get_index_key(table_data* table,
+                    char* page,
+                    size_t row_index,
+                    size_t col_index,
+                    char* buffer) {
+  attr_desc_size* desc = table->schema->descs[col_index];
+  if (desc->desc == D_DICT) {
+    uint32_t code;
+    memcpy(&code, get_field(table, page, row_index, col_index),
+           sizeof(uint32_t));
+    return decode_value(table->dictionaries[col_index], code);
+  }
+  if (!is_out_of_line(desc)) {
+    return get_field(table, page, row_index, col_index);
+  }
+  read_declared_value(table, page, row_index, col_index, buffer);
+  return buffer;
+}
+
+// The heap bytes of the strings of a row become garbage.
+void forget_row_strings(table_data* table,
+                        char* page,
+                        size_t row_index,
+                        size_t* columns,
+                        size_t nb_columns) {
+  for (size_t i = 0; i < nb_columns; i++) {
+    size_t col_index = columns == NULL ? i : columns[i];
+    if (!is_out_of_line(table->schema->descs[col_index])) {
+      continue;
     }
-    switch (kinds[col_index]) {
-      case D_INT:
-        value->i = *(long*)read_value;
-        if (DEBUG) {
-          printf("integer value %ld\n", value->i);
-        }
-        break;
-      case D_FLT:
-        value->f = *(double*)read_value;
-        break;
-      case D_CHR:
-        value->s =
-            (char*)malloc(sizeof(char) * (strlen((char*)read_value) + 1));
-        strcpy(value->s, (char*)read_value);
-        if (DEBUG) {
-          printf("string value %s\n", value->s);
-        }
-        break;
+    varchar_ref ref;
+    memcpy(&ref, get_field(table, page, row_index, col_index),
+           sizeof(varchar_ref));
+    if (ref.length > VARCHAR_INLINE) {
+      table->heap_garbage += ref.length;
     }
-    values[col_index] = value;
   }
+}
 
-  return values;
+void copy_row(table_data* table, size_t from, size_t to) {
+  char* source = pin_row(table, from);
+  char* destination = pin_row(table, to);
+  for (size_t col_index = 0; col_index < table->schema->nb_attr;
+       col_index++) {
+    memcpy(get_field(table, destination, to, col_index),
+           get_field(table, source, from, col_index),
+           field_width(table->schema->descs[col_index]));
+  }
+  unpin_row(table, to, true);
+  unpin_row(table, from, false);
 }
 
-bool execute_insert_into_table(table_data** tables,
-                               size_t nb_tables,
-                               ast_node* root) {
-  if (root->kind != INSERT) {
-    runtime_error("Expected an insert node");
-    return false;
+// Deleted rows stay in their page until the table is compacted.
+bool is_row_dead(table_data* table, size_t row_index) {
+  return (table->dead_rows[row_index / 64] >> (row_index % 64)) & 1;
+}
+
+void set_row_dead(table_data* table, size_t row_index) {
+  table->dead_rows[row_index / 64] |= (uint64_t)1 << (row_index % 64);
+  table->nb_dead++;
+  mark_modified(table);
+}
+
+size_t count_live_rows(table_data* table) {
+  return table->nb_rows - table->nb_dead;
+}
+
+// a bit for every row of the capacity, the bitmap never shrinks
+void resize_dead_rows(table_data* table) {
+  size_t nb_words = (table->capacity + 63) / 64;
+  if (nb_words <= table->dead_words) {
+    return;
   }
-  ast_node* n_tablename = root->left;
-  if (n_tablename == NULL || n_tablename->kind != TABLENAME) {
-    runtime_error("Expected a tablename node");
-    return false;
+  table->dead_rows = (uint64_t*)realloc(table->dead_rows,
+                                        sizeof(uint64_t) * nb_words);
+  assert(table->dead_rows != NULL);
+  memset(table->dead_rows + table->dead_words, 0,
+         sizeof(uint64_t) * (nb_words - table->dead_words));
+  table->dead_words = nb_words;
+}
+
+void clear_dead_rows(table_data* table) {
+  memset(table->dead_rows, 0, sizeof(uint64_t) * table->dead_words);
+  table->nb_dead = 0;
+}
+
+void add_page(table_data* table) {
+  if (table->nb_pages == table->pages_capacity) {
+    table->pages_capacity =
+        (table->pages_capacity == 0) ? 4 : table->pages_capacity * 2;
+    table->pages = (size_t*)realloc(table->pages,
+                                    sizeof(size_t) * table->pages_capacity);
+    assert(table->pages != NULL);
+    table->file_pages = (size_t*)realloc(
+        table->file_pages, sizeof(size_t) * table->pages_capacity);
+    assert(table->file_pages != NULL);
+    table->page_checksums = (uint32_t*)realloc(
+        table->page_checksums, sizeof(uint32_t) * table->pages_capacity);
+    assert(table->page_checksums != NULL);
+    table->zones =
+        (zone*)realloc(table->zones, sizeof(zone) * table->pages_capacity *
+                                         table->schema->nb_attr);
+    assert(table->zones != NULL);
   }
-  char* tablename = n_tablename->value;
+  table->file_pages[table->nb_pages] = NO_FILE_PAGE;
+  table->pages[table->nb_pages++] = pager_allocate(get_buffer_pool());
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    if (table->indexes[i]->filters != NULL) {
+      bloom_resize(table->indexes[i]->filters, table->nb_pages);
+    }
+  }
+  mark_modified(table);
+  table->capacity += table->rows_per_page;
+  resize_dead_rows(table);
+}
 
-  table_data* table = find_table_from_name(tables, tablename, nb_tables);
-  if (table == NULL) {
-    runtime_error("Unknown table %s", tablename);
-    return false;
+// give back the pages after the last row
+void truncate_pages(table_data* table) {
+  size_t nb_used =
+      (table->nb_rows + table->rows_per_page - 1) / table->rows_per_page;
+  while (table->nb_pages > nb_used) {
+    pager_free(get_buffer_pool(), table->pages[--table->nb_pages]);
+    table->capacity -= table->rows_per_page;
+    mark_modified(table);
   }
+}
 
-  // increase capacity & realloc
-  if (table->nb_rows + 1 >= table->capacity) {
-    table->capacity *= 2;
-    table->values =
-        (void*)realloc(table->values, table->row_size * table->capacity);
-    assert(table->values != NULL);
-    if (DEBUG) {
-      runtime_error("Capacity reached for %s, expanding capacity", tablename);
-      print_table(table);
+btree* build_column_index(table_data* table, size_t column) {
+  attr_desc_size* desc = table->schema->descs[column];
+  btree* tree = btree_create(btree_kind_from_attr(desc->desc), desc->size);
+  char buffer[desc->size];
+  for (size_t row_index = 0; row_index < table->nb_rows; row_index++) {
+    if (is_row_dead(table, row_index)) {
+      continue;
     }
+    char* page = pin_row(table, row_index);
+    btree_insert(tree, get_index_key(table, page, row_index, column, buffer),
+                 row_index);
+    unpin_row(table, row_index, false);
   }
+  return tree;
+}
 
-  // allocate for a new row
-  void* row_dest = (void*)malloc(table->row_size);
-  assert(row_dest != NULL);
+// The primary key is the first column. The indexes are built on first use so
+// opening a database doesn't read rows.
+btree* get_pk_index(table_data* table) {
+  if (table->pk_index == NULL) {
+    table->pk_index = build_column_index(table, 0);
+  }
+  return table->pk_index;
+}
 
-  size_t row_offset = table->nb_rows * table->row_size;
-  size_t curr_offset = 0;
-  ast_node* curr_col = n_tablename->left;
+hash_index* build_column_hash(table_data* table, size_t column) {
+  attr_desc_size* desc = table->schema->descs[column];
+  hash_index* hash = hash_create(desc->size, desc->desc != D_INT &&
+                                                  desc->desc != D_FLT);
+  char buffer[desc->size];
+  for (size_t row_index = 0; row_index < table->nb_rows; row_index++) {
+    if (is_row_dead(table, row_index)) {
+      continue;
+    }
+    char* page = pin_row(table, row_index);
+    hash_insert(hash, get_index_key(table, page, row_index, column, buffer),
+                row_index);
+    unpin_row(table, row_index, false);
+  }
+  return hash;
+}
 
-  for (size_t col_index = 0; col_index < table->schema->nb_attr; col_index++) {
-    if (curr_col == NULL ||
-        !(curr_col->kind == INT || curr_col->kind == FLOAT ||
-          curr_col->kind == STRING)) {
-      runtime_error("Expected a value (INT, FLOAT, STRING) node");
-      return false;
+// Hash of a value as returned by get_index_key, strings up to their '\0'.
+uint64_t hash_column_value(attr_desc_size* desc, const char* key) {
+  bool is_string = desc->desc == D_CHR || desc->desc == D_DICT;
+  return bloom_hash(key, is_string ? strnlen(key, desc->size) : desc->size);
+}
+
+void add_to_bloom(table_data* table,
+                  bloom* filters,
+                  size_t column,
+                  char* page,
+                  size_t row_index) {
+  attr_desc_size* desc = table->schema->descs[column];
+  char buffer[desc->size];
+  char* key = get_index_key(table, page, row_index, column, buffer);
+  bloom_add(filters, row_index / table->rows_per_page,
+            hash_column_value(desc, key));
+}
+
+// Fill the filters of a column from the live rows.
+void fill_column_bloom(table_data* table, bloom* filters, size_t column) {
+  bloom_resize(filters, table->nb_pages);
+  bloom_clear(filters);
+  for (size_t row_index = 0; row_index < table->nb_rows; row_index++) {
+    if (is_row_dead(table, row_index)) {
+      continue;
     }
+    char* page = pin_row(table, row_index);
+    add_to_bloom(table, filters, column, page, row_index);
+    unpin_row(table, row_index, false);
+  }
+}
 
-    void* data;
-    switch (curr_col->kind) {
-      case INT:
-        data = (void*)&curr_col->i_value;
-        break;
-      case FLOAT:
-        data = (void*)&curr_col->f_value;
-        break;
-      case STRING:
-        data = (void*)curr_col->value;
-        if (DEBUG) {
-          printf("string data in buffer %s - %s\n", (char*)data,
-                 curr_col->value);
-        }
-        break;
-      default:
-        runtime_error("Unknown value kind");
-        return false;
+btree* get_index_tree(table_data* table, table_index* index) {
+  if (index->tree == NULL) {
+    index->tree = build_column_index(table, index->column);
+  }
+  return index->tree;
+}
+
+hash_index* get_index_hash(table_data* table, table_index* index) {
+  if (index->hash == NULL) {
+    index->hash = build_column_hash(table, index->column);
+  }
+  return index->hash;
+}
+
+// ordered index of a column, NULL if it has none. Clustered and LSM tables
+// are ordered by their primary key, they don't need a tree.
+btree* find_column_index(table_data* table, size_t column) {
+  if (column == 0 && (table->is_clustered || table->lsm != NULL)) {
+    return NULL;
+  }
+  if (column == 0) {
+    return get_pk_index(table);
+  }
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    table_index* index = table->indexes[i];
+    if (index->column == column && index->kind == I_BTREE) {
+      return get_index_tree(table, index);
     }
-    // enforce unicity of Primary key
-    if (col_index == 0) {
-      if (strlen(curr_col->value) == 0) {
-        runtime_error("Primary key can't be null");
-        return false;
-      }
-      for (size_t row_index = 0; row_index < table->nb_rows; row_index++) {
-        extracted_value** values =
-            get_row_values(table, row_index, table->schema->nb_attr);
-        if (compare_extracted_value(*values, curr_col)) {
-          runtime_error("Primary key must be unique");
-          return false;
-        }
-      }
+  }
+  return NULL;
+}
+
+// hash index of a column, NULL if it has none
+hash_index* find_column_hash(table_data* table, size_t column) {
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    table_index* index = table->indexes[i];
+    if (index->column == column && index->kind == I_HASH) {
+      return get_index_hash(table, index);
     }
-    // write the data in the table
-    size_t data_size = table->schema->descs[col_index]->size;
-    memcpy((char*)table->values + row_offset + curr_offset, data, data_size);
-    curr_offset += data_size;
+  }
+  return NULL;
+}
 
-    curr_col = curr_col->left;
+int compare_pk(table_data* table, const void* a, const void* b) {
+  btree order;
+  order.kind = btree_kind_from_attr(table->schema->descs[0]->desc);
+  order.key_size = table->schema->descs[0]->size;
+  return btree_compare_keys(&order, a, b);
+}
+
+// copy the primary key of a row in key, of the size of the column
+void read_pk(table_data* table, size_t row_index, char* key) {
+  size_t size = table->schema->descs[0]->size;
+  char buffer[size];
+  char* page = pin_row(table, row_index);
+  memcpy(key, get_index_key(table, page, row_index, 0, buffer), size);
+  unpin_row(table, row_index, false);
+}
+
+// Compare the primary key of a row with key in its page, only out of line
+// varchars are copied.
+int compare_row_pk(table_data* table, size_t row_index, const void* key) {
+  char buffer[table->schema->descs[0]->size];
+  char* page = pin_row(table, row_index);
+  int cmp = compare_pk(
+      table, get_index_key(table, page, row_index, 0, buffer), key);
+  unpin_row(table, row_index, false);
+  return cmp;
+}
+
+// Binary search in rows sorted by key: the first of [low, high) whose key
+// isn't below key, or is above it when is_after. high when there's none.
+size_t seek_sorted_rows(table_data* table,
+                        size_t low,
+                        size_t high,
+                        const void* key,
+                        bool is_after) {
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    int cmp = compare_row_pk(table, middle, key);
+    if (cmp < 0 || (cmp == 0 && is_after)) {
+      low = middle + 1;
+    } else {
+      high = middle;
+    }
   }
-  table->nb_rows += 1;
+  return low;
+}
 
-  return true;
+// The sorted rows of a clustered table, a run without fences.
+sorted_run get_sorted_rows(table_data* table) {
+  sorted_run run = {0, table->nb_sorted, true, NULL, NULL};
+  return run;
 }
 
-bool is_node_comp(ast_node* node) {
-  return node->kind == COMP && strncmp(node->value, "AND", 3) != 0 &&
-         strncmp(node->value, "OR", 2) != 0;
+void forget_run_description(sorted_run* run) {
+  free(run->fences);
+  run->fences = NULL;
+  bloom_destroy(run->filter);
+  run->filter = NULL;
 }
 
-bool is_node_and(ast_node* node) {
-  return node->kind == COMP && strncmp(node->value, "AND", 3) == 0;
+lsm_tree* create_lsm(void) {
+  lsm_tree* lsm = (lsm_tree*)malloc(sizeof(lsm_tree));
+  assert(lsm != NULL);
+  lsm->runs = NULL;
+  lsm->nb_runs = 0;
+  lsm->runs_capacity = 0;
+  lsm->nb_flushed = 0;
+  lsm->memtable = NULL;
+  return lsm;
 }
 
-bool is_node_or(ast_node* node) {
-  return node->kind == COMP && strncmp(node->value, "OR", 2) == 0;
+// Forget the runs and the memtable, the rows aren't touched.
+void clear_lsm(lsm_tree* lsm) {
+  for (size_t i = 0; i < lsm->nb_runs; i++) {
+    forget_run_description(&lsm->runs[i]);
+  }
+  lsm->nb_runs = 0;
+  lsm->nb_flushed = 0;
+  skiplist_destroy(lsm->memtable);
+  lsm->memtable = NULL;
 }
 
-#define MAXCOLNAME 256
+void destroy_lsm(lsm_tree* lsm) {
+  if (lsm == NULL) {
+    return;
+  }
+  clear_lsm(lsm);
+  free(lsm->runs);
+  free(lsm);
+}
 
-bool run_where(ast_node* condition,
-               size_t nb_attr,
-               extracted_value* values[],
-               bool* error) {
-  // base case
-  if (condition == NULL) {
-    runtime_error("Condition shouldn't be NULL");
-    *error = true;
-    return false;
+void add_run(lsm_tree* lsm, size_t first, size_t nb_rows) {
+  if (lsm->nb_runs == lsm->runs_capacity) {
+    lsm->runs_capacity = (lsm->runs_capacity == 0) ? 4 : lsm->runs_capacity * 2;
+    lsm->runs = (sorted_run*)realloc(lsm->runs,
+                                     sizeof(sorted_run) * lsm->runs_capacity);
+    assert(lsm->runs != NULL);
   }
-  if (DEBUG) {
-    printf("run_where received node:\n");
-    print_ast(condition);
+  sorted_run run = {first, nb_rows, true, NULL, NULL};
+  lsm->runs[lsm->nb_runs++] = run;
+}
+
+// Build the fences and the filter of a run of an LSM table, if it's sorted.
+void describe_run(table_data* table, sorted_run* run) {
+  if (run->fences != NULL || !run->is_sorted) {
+    return;
   }
-  if (is_node_comp(condition)) {
-    if (DEBUG) {
-      printf("Node is a condition\n");
-    }
-    // switch about condition
-    if (condition->left == NULL || condition->right == NULL) {
-      runtime_error("Condition should have both children set.");
-      *error = true;
-      return false;
+  attr_desc_size* desc = table->schema->descs[0];
+  size_t nb_blocks = (run->nb_rows + table->rows_per_page - 1) /
+                     table->rows_per_page;
+  run->fences = (char*)malloc(desc->size * nb_blocks + 1);
+  assert(run->fences != NULL);
+  run->filter = bloom_create(run->nb_rows);
+  bloom_resize(run->filter, 1);
+  char key[desc->size];
+  for (size_t i = 0; i < run->nb_rows; i++) {
+    read_pk(table, run->first + i, key);
+    if (i % table->rows_per_page == 0) {
+      memcpy(run->fences + (i / table->rows_per_page) * desc->size, key,
+             desc->size);
     }
-    // a = 2
-    // at least one colname
-    if (condition->left->kind != COLNAME && condition->right->kind != COLNAME) {
-      runtime_error("Condition should have at least one COLNAME as children");
-      *error = true;
-      return false;
+    bloom_add(run->filter, 0, hash_column_value(desc, key));
+  }
+}
+
+// First row of a sorted run whose key isn't below key, or is above it when
+// is_after. The fences tell the block to search.
+size_t seek_run(table_data* table,
+                sorted_run* run,
+                const void* key,
+                bool is_after) {
+  size_t end = run->first + run->nb_rows;
+  if (run->fences == NULL) {
+    return seek_sorted_rows(table, run->first, end, key, is_after);
+  }
+  size_t size = table->schema->descs[0]->size;
+  size_t low = 0;
+  size_t high = (run->nb_rows + table->rows_per_page - 1) /
+                table->rows_per_page;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    int cmp = compare_pk(table, run->fences + middle * size, key);
+    if (cmp < 0 || (cmp == 0 && is_after)) {
+      low = middle + 1;
+    } else {
+      high = middle;
     }
-    // get the colname and its kind (INT, FLOAT, VARCHAR)
-    char* colname = (char*)malloc(sizeof(char) * MAXCOLNAME);
-    assert(colname != NULL);
-    ast_kind colkind;
-    bool is_value_right;
-    if (condition->left->kind == COLNAME) {
-      strcpy(colname, condition->left->value);
-      colkind = condition->right->kind;
-      is_value_right = true;
-      if (DEBUG) {
-        printf("found colname on left & value on right\n");
+  }
+  // the fence of the block before is below the key, the next isn't
+  if (low == 0) {
+    return run->first;
+  }
+  size_t block = run->first + (low - 1) * table->rows_per_page;
+  size_t block_end = block + table->rows_per_page;
+  return seek_sorted_rows(table, block, block_end < end ? block_end : end,
+                          key, is_after);
+}
+
+bool is_pk_of_row(table_data* table, size_t row_index, const void* key) {
+  return compare_row_pk(table, row_index, key) == 0;
+}
+
+// Live row holding a key in [first, last), rows which aren't sorted.
+bool scan_pk(table_data* table,
+             size_t first,
+             size_t last,
+             const void* key,
+             size_t* owner) {
+  for (size_t row_index = first; row_index < last; row_index++) {
+    if (!is_row_dead(table, row_index) &&
+        is_pk_of_row(table, row_index, key)) {
+      if (owner != NULL) {
+        *owner = row_index;
       }
-    } else {
-      strcpy(colname, condition->right->value);
-      colkind = condition->left->kind;
-      is_value_right = false;
-      if (DEBUG) {
-        printf("found value on left & colname on right\n");
+      return true;
+    }
+  }
+  return false;
+}
+
+// Live row of a run holding a key. Deleted rows keep their key, a key may be
+// held by a deleted row and by the live row inserted since.
+bool find_in_run(table_data* table,
+                 sorted_run* run,
+                 const void* key,
+                 size_t* owner) {
+  size_t end = run->first + run->nb_rows;
+  if (!run->is_sorted) {
+    return scan_pk(table, run->first, end, key, owner);
+  }
+  for (size_t row_index = seek_run(table, run, key, false);
+       row_index < end && is_pk_of_row(table, row_index, key); row_index++) {
+    if (!is_row_dead(table, row_index)) {
+      if (owner != NULL) {
+        *owner = row_index;
       }
+      return true;
     }
-    // return the comparison
-    extracted_value* value = NULL;
-    long literal_int_value;
-    double literal_float_value;
-    char* literal_string_value;
-
-    // invalid comparisons :
-    //
-    // type left != type right
-    // literal vs literal
-    // float: ==
-    // char*: < <= > >=
-
-    switch (colkind) {
-      case INT:
-        if (DEBUG) {
-          printf("value is an integer\n");
-        }
-        literal_int_value = (is_value_right) ? condition->right->i_value
-                                             : condition->left->i_value;
-        if (DEBUG) {
-          printf("literal value %ld\n", literal_int_value);
-        }
-        for (size_t i = 0; i < nb_attr; i++) {
-          if (strcmp(values[i]->colname, colname) == 0) {
-            value = values[i];
-            if (DEBUG) {
-              printf("table value %ld\n", value->i);
-            }
-            break;
-          }
-        }
-        if (value == NULL) {
-          runtime_error("Couldn't find the colname %s in the table", colname);
-          *error = true;
-          return false;
-        }
-        if (strncmp(condition->value, "=", 1) == 0) {
-          return value->i == literal_int_value;
-        } else if (strncmp(condition->value, "!=", 2) == 0) {
-          return value->i != literal_int_value;
-        } else if (strncmp(condition->value, "<=", 2) == 0) {
-          return value->i <= literal_int_value;
-        } else if (strncmp(condition->value, ">=", 2) == 0) {
-          return value->i >= literal_int_value;
-        } else if (strncmp(condition->value, "<", 1) == 0) {
-          return value->i < literal_int_value;
-        } else if (strncmp(condition->value, ">", 1) == 0) {
-          return value->i > literal_int_value;
-        } else {
-          runtime_error("invalid comparison between integer %s",
-                        condition->value);
-          *error = true;
-          return false;
-        }
-        break;
-      case FLOAT:
-        if (DEBUG) {
-          printf("value is a float\n");
-        }
-        literal_float_value = (is_value_right) ? condition->right->f_value
-                                               : condition->left->f_value;
-        if (DEBUG) {
-          printf("literal value %f\n", literal_float_value);
-        }
+  }
+  return false;
+}
 
-        for (size_t i = 0; i < nb_attr; i++) {
-          if (strcmp(values[i]->colname, colname) == 0) {
-            value = values[i];
-            if (DEBUG) {
-              printf("table value %f\n", value->f);
-            }
-            break;
-          }
-        }
-        if (value == NULL) {
-          runtime_error("Couldn't find the colname %s in the table", colname);
-          *error = true;
-          return false;
-        }
-        if (strncmp(condition->value, "<", 1) == 0) {
-          return value->f < literal_float_value;
-        } else if (strncmp(condition->value, ">", 1) == 0) {
-          return value->f > literal_float_value;
-        } else {
-          runtime_error("invalid comparison between floats %s",
-                        condition->value);
-          *error = true;
-          return false;
+// The primary keys of the live rows from first, in a skip list.
+skiplist* index_last_rows(table_data* table, size_t first) {
+  attr_desc_size* desc = table->schema->descs[0];
+  skiplist* list = skiplist_create(btree_kind_from_attr(desc->desc),
+                                   desc->size);
+  char key[desc->size];
+  for (size_t row_index = first; row_index < table->nb_rows; row_index++) {
+    if (!is_row_dead(table, row_index)) {
+      read_pk(table, row_index, key);
+      skiplist_insert(list, key, row_index);
+    }
+  }
+  return list;
+}
+
+// The row of a key in a skip list of primary keys.
+bool find_in_skiplist(table_data* table,
+                      skiplist* list,
+                      const void* key,
+                      size_t* owner) {
+  skiplist_cursor c = skiplist_seek(list, key);
+  if (!skiplist_cursor_valid(&c) ||
+      compare_pk(table, skiplist_cursor_key(&c), key) != 0) {
+    return false;
+  }
+  if (owner != NULL) {
+    *owner = skiplist_cursor_row(&c);
+  }
+  return true;
+}
+
+skiplist* get_memtable(table_data* table) {
+  lsm_tree* lsm = table->lsm;
+  if (lsm->memtable == NULL) {
+    lsm->memtable = index_last_rows(table, lsm->nb_flushed);
+  }
+  return lsm->memtable;
+}
+
+skiplist* get_appended(table_data* table) {
+  if (table->appended == NULL) {
+    table->appended = index_last_rows(table, table->nb_sorted);
+  }
+  return table->appended;
+}
+
+// The appended rows moved or changed, they're indexed again when they're
+// searched.
+void forget_appended(table_data* table) {
+  skiplist_destroy(table->appended);
+  table->appended = NULL;
+}
+
+// The sorted rows are searched, then the rows appended since the last merge.
+bool find_clustered_pk(table_data* table, const void* key, size_t* owner) {
+  sorted_run sorted = get_sorted_rows(table);
+  return find_in_run(table, &sorted, key, owner) ||
+         find_in_skiplist(table, get_appended(table), key, owner);
+}
+
+// The memtable is searched, then the runs from the newest, their filters
+// skip most of them.
+bool find_lsm_pk(table_data* table, const void* key, size_t* owner) {
+  lsm_tree* lsm = table->lsm;
+  if (find_in_skiplist(table, get_memtable(table), key, owner)) {
+    return true;
+  }
+  attr_desc_size* desc = table->schema->descs[0];
+  uint64_t hash = hash_column_value(desc, key);
+  for (size_t i = lsm->nb_runs; i-- > 0;) {
+    sorted_run* run = &lsm->runs[i];
+    describe_run(table, run);
+    if (run->filter != NULL && !bloom_may_contain(run->filter, 0, hash)) {
+      continue;
+    }
+    if (find_in_run(table, run, key, owner)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Row holding a primary key. A hash index on the key is cheaper than the
+// tree, which isn't even built when the hash is there. Clustered and LSM
+// tables are searched by their key.
+bool find_pk_owner(table_data* table, const void* key, size_t* owner) {
+  hash_index* hash = find_column_hash(table, 0);
+  if (hash != NULL) {
+    return hash_find(hash, key, owner);
+  }
+  if (table->is_clustered) {
+    return find_clustered_pk(table, key, owner);
+  }
+  if (table->lsm != NULL) {
+    return find_lsm_pk(table, key, owner);
+  }
+  return btree_find(get_pk_index(table), key, owner);
+}
+
+// Forget the indexes after rows were moved, they're rebuilt when needed.
+// The Bloom filters are refilled right away.
+void drop_index_trees(table_data* table) {
+  btree_destroy(table->pk_index);
+  table->pk_index = NULL;
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    table_index* index = table->indexes[i];
+    btree_destroy(index->tree);
+    index->tree = NULL;
+    hash_destroy(index->hash);
+    index->hash = NULL;
+    if (index->filters != NULL) {
+      fill_column_bloom(table, index->filters, index->column);
+    }
+  }
+}
+
+bool is_column_in(size_t column, size_t* columns, size_t nb_columns) {
+  for (size_t i = 0; i < nb_columns; i++) {
+    if (columns[i] == column) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Add or remove a row from the built secondary indexes on some columns, or
+// on every column if columns is NULL.
+void update_secondary_indexes(table_data* table,
+                              char* page,
+                              size_t row_index,
+                              size_t* columns,
+                              size_t nb_columns,
+                              bool is_added) {
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    table_index* index = table->indexes[i];
+    bool is_changed =
+        columns == NULL || is_column_in(index->column, columns, nb_columns);
+    // a filter keeps the removed values
+    if (index->filters != NULL && is_changed && is_added) {
+      add_to_bloom(table, index->filters, index->column, page, row_index);
+    }
+    if ((index->tree == NULL && index->hash == NULL) || !is_changed) {
+      continue;
+    }
+    char buffer[table->schema->descs[index->column]->size];
+    char* key =
+        get_index_key(table, page, row_index, index->column, buffer);
+    if (index->tree != NULL && is_added) {
+      btree_insert(index->tree, key, row_index);
+    } else if (index->tree != NULL) {
+      btree_remove(index->tree, key, row_index);
+    } else if (is_added) {
+      hash_insert(index->hash, key, row_index);
+    } else {
+      hash_remove(index->hash, key, row_index);
+    }
+  }
+}
+
+// Set the paging of a table from its schema and layout, no page is
+// allocated. With the columns layout, the values of a column are contiguous
+// in each page and a scan only reads the columns it uses.
+bool init_table_pages(table_data* data) {
+  size_t nb_attr = data->schema->nb_attr;
+  data->row_size = 0;
+  for (size_t i = 0; i < nb_attr; i++) {
+    data->row_size += field_width(data->schema->descs[i]);
+  }
+  if (data->row_size > PAGER_PAGE_SIZE) {
+    runtime_error("Rows of %s take %ld B, a page holds %d B",
+                  data->schema->name, data->row_size, PAGER_PAGE_SIZE);
+    return false;
+  }
+  data->rows_per_page = PAGER_PAGE_SIZE / data->row_size;
+  data->column_offsets = (size_t*)malloc(sizeof(size_t) * nb_attr);
+  assert(data->column_offsets != NULL);
+  data->column_strides = (size_t*)malloc(sizeof(size_t) * nb_attr);
+  assert(data->column_strides != NULL);
+  size_t offset = 0;
+  for (size_t i = 0; i < nb_attr; i++) {
+    size_t size = field_width(data->schema->descs[i]);
+    if (data->layout == L_ROWS) {
+      data->column_offsets[i] = offset;
+      data->column_strides[i] = data->row_size;
+    } else {
+      data->column_offsets[i] = offset * data->rows_per_page;
+      data->column_strides[i] = size;
+    }
+    offset += size;
+  }
+  data->capacity = 0;
+  data->nb_pages = 0;
+  data->pages_capacity = 0;
+  data->pages = NULL;
+  data->file_pages = NULL;
+  data->page_checksums = NULL;
+  data->zones = NULL;
+  data->meta_page = NO_FILE_PAGE;
+  data->meta_length = 0;
+  data->meta_checksum = 0;
+  data->is_clustered = false;
+  data->nb_sorted = 0;
+  data->appended = NULL;
+  data->lsm = NULL;
+  data->pk_index = NULL;
+  data->indexes = NULL;
+  data->nb_indexes = 0;
+  data->dead_rows = NULL;
+  data->dead_words = 0;
+  data->nb_dead = 0;
+  data->heap = NULL;
+  data->heap_size = 0;
+  data->heap_capacity = 0;
+  data->heap_garbage = 0;
+  data->dictionaries =
+      (dictionary**)malloc(sizeof(dictionary*) * nb_attr);
+  assert(data->dictionaries != NULL);
+  for (size_t i = 0; i < nb_attr; i++) {
+    attr_desc_size* desc = data->schema->descs[i];
+    data->dictionaries[i] =
+        desc->desc == D_DICT ? create_dictionary(desc->size) : NULL;
+  }
+  return true;
+}
+
+table_data* create_page_for_table(table_desc* table, table_layout layout) {
+  table_data* data = (table_data*)malloc(sizeof(table_data));
+  assert(data != NULL);
+  data->schema = table;
+  data->nb_rows = 0;
+  data->layout = layout;
+  if (!init_table_pages(data)) {
+    free(data);
+    return NULL;
+  }
+
+  return data;
+}
+
+// options of CREATE TABLE, STORAGE = ROWS or STORAGE = COLUMNS, CLUSTER = PK
+// to keep the rows in the order of their primary key and ENGINE = LSM
+bool read_table_options(ast_node* option,
+                        table_layout* layout,
+                        bool* is_clustered,
+                        bool* is_lsm) {
+  *layout = L_ROWS;
+  *is_clustered = false;
+  *is_lsm = false;
+  for (; option != NULL; option = option->left) {
+    char* value = option->right->value;
+    if (strcasecmp(option->value, "ENGINE") == 0) {
+      if (strcasecmp(value, "LSM") != 0) {
+        runtime_error("ENGINE is LSM, got %s", value);
+        return false;
+      }
+      *is_lsm = true;
+      continue;
+    }
+    if (strcasecmp(option->value, "CLUSTER") == 0) {
+      if (strcasecmp(value, "PK") != 0) {
+        runtime_error("CLUSTER is PK, got %s", value);
+        return false;
+      }
+      *is_clustered = true;
+      continue;
+    }
+    if (strcasecmp(option->value, "STORAGE") != 0) {
+      runtime_error("Unknown table option %s", option->value);
+      return false;
+    }
+    if (strcasecmp(value, "ROWS") == 0) {
+      *layout = L_ROWS;
+    } else if (strcasecmp(value, "COLUMNS") == 0) {
+      *layout = L_COLUMNS;
+    } else {
+      runtime_error("STORAGE is ROWS or COLUMNS, got %s", value);
+      return false;
+    }
+  }
+  if (*is_clustered && *is_lsm) {
+    runtime_error("An LSM table is already ordered by its runs");
+    return false;
+  }
+  return true;
+}
+
+table_data* execute_create_table(ast_node* root) {
+  table_layout layout;
+  bool is_clustered;
+  bool is_lsm;
+  if (!read_table_options(root->right, &layout, &is_clustered, &is_lsm)) {
+    return NULL;
+  }
+  table_desc* schema = create_table_desc_from_ast(root);
+  if (schema == NULL) {
+    return NULL;
+  }
+  table_data* data = create_page_for_table(schema, layout);
+  if (data != NULL) {
+    data->is_clustered = is_clustered;
+    data->lsm = is_lsm ? create_lsm() : NULL;
+  }
+  return data;
+}
+
+void print_table(table_data* data) {
+  printf("\nSchema of table: %s\n", data->schema->name);
+  printf("Capacity: %ld rows in %ld pages, used rows: %ld, deleted rows: %ld, "
+         "row size: %ld B, stored by %s%s\n\n",
+         data->capacity, data->nb_pages, count_live_rows(data), data->nb_dead,
+         data->row_size, data->layout == L_ROWS ? "rows" : "columns",
+         data->is_clustered ? ", clustered by the primary key"
+         : data->lsm != NULL ? ", LSM engine"
+                             : "");
+  print_schema(data->schema);
+  for (size_t i = 0; i < data->nb_indexes; i++) {
+    printf("Index %s on %s using %s\n", data->indexes[i]->name,
+           data->schema->descs[data->indexes[i]->column]->name,
+           repr_index_kind[data->indexes[i]->kind]);
+  }
+}
+
+void destroy_desc(attr_desc_size* desc) {
+  free(desc->name);
+  free(desc);
+}
+
+void destroy_schema(table_desc* schema) {
+  for (size_t index_desc = 0; index_desc < schema->nb_attr; index_desc++) {
+    destroy_desc(schema->descs[index_desc]);
+  }
+  free(schema->descs);
+  free(schema->name);
+  free(schema);
+}
+
+void destroy_table(table_data* table) {
+  for (size_t i = 0; i < table->schema->nb_attr; i++) {
+    destroy_dictionary(table->dictionaries[i]);
+  }
+  free(table->dictionaries);
+  destroy_schema(table->schema);
+  for (size_t index_page = 0; index_page < table->nb_pages; index_page++) {
+    pager_free(get_buffer_pool(), table->pages[index_page]);
+  }
+  free(table->pages);
+  free(table->file_pages);
+  free(table->page_checksums);
+  free(table->zones);
+  free(table->column_offsets);
+  free(table->column_strides);
+  btree_destroy(table->pk_index);
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    free(table->indexes[i]->name);
+    btree_destroy(table->indexes[i]->tree);
+    hash_destroy(table->indexes[i]->hash);
+    bloom_destroy(table->indexes[i]->filters);
+    free(table->indexes[i]);
+  }
+  free(table->indexes);
+  free(table->dead_rows);
+  free(table->heap);
+  skiplist_destroy(table->appended);
+  destroy_lsm(table->lsm);
+}
+
+table_data* read_table(int fd,
+                       size_t meta_page,
+                       size_t meta_length,
+                       uint32_t meta_checksum);
+
+// A table of the opened file which isn't read yet: its entry in the
+// directory of the file.
+typedef struct TablePlace {
+  table_desc* schema;
+  size_t meta_page;  // description of the table
+  size_t meta_length;
+  uint32_t meta_checksum;
+  size_t nb_pages;
+  size_t* file_pages;
+  size_t nb_indexes;
+  char** index_names;
+} table_place;
+
+void destroy_table_place(table_place* place) {
+  destroy_schema(place->schema);
+  free(place->file_pages);
+  for (size_t i = 0; i < place->nb_indexes; i++) {
+    free(place->index_names[i]);
+  }
+  free(place->index_names);
+  free(place);
+}
+
+// The tables of the database. The array grows without limit, a dropped table
+// is replaced by the last one. The tables themselves never move.
+// The tables of an opened file are read when they're first used, until then
+// their position holds NULL and their place in the file.
+typedef struct Catalog {
+  table_data** tables;
+  table_place** places;  // NULL for a table in memory
+  size_t nb_tables;
+  size_t capacity;
+  hash_index* names;  // hash of a name -> position in tables
+  FILE* file;         // of the places, NULL when every table is read
+} catalog;
+
+void init_catalog(catalog* database) {
+  database->capacity = 16;
+  database->tables =
+      (table_data**)malloc(sizeof(table_data*) * database->capacity);
+  assert(database->tables != NULL);
+  database->places =
+      (table_place**)malloc(sizeof(table_place*) * database->capacity);
+  assert(database->places != NULL);
+  database->nb_tables = 0;
+  database->names = hash_create(sizeof(uint64_t), false);
+  database->file = NULL;
+}
+
+char* get_table_name(catalog* database, size_t position) {
+  if (database->tables[position] == NULL) {
+    return database->places[position]->schema->name;
+  }
+  return database->tables[position]->schema->name;
+}
+
+// Read a table of the opened file, if it isn't already. NULL when its
+// description is damaged, the table stays unread.
+table_data* load_table(catalog* database, size_t position) {
+  if (database->tables[position] != NULL) {
+    return database->tables[position];
+  }
+  table_place* place = database->places[position];
+  table_data* table = read_table(fileno(database->file), place->meta_page,
+                                 place->meta_length, place->meta_checksum);
+  if (table == NULL) {
+    runtime_error("The description of table %s doesn't match its checksum",
+                  place->schema->name);
+    return NULL;
+  }
+  destroy_table_place(place);
+  database->places[position] = NULL;
+  database->tables[position] = table;
+  return table;
+}
+
+// false when a table couldn't be read, the file stays open
+bool load_all_tables(catalog* database) {
+  bool is_complete = true;
+  for (size_t i = 0; i < database->nb_tables; i++) {
+    is_complete = load_table(database, i) != NULL && is_complete;
+  }
+  if (is_complete && database->file != NULL) {
+    fclose(database->file);
+    database->file = NULL;
+  }
+  return is_complete;
+}
+
+uint64_t hash_table_name(char* name) {
+  return bloom_hash(name, strlen(name));
+}
+
+// Position of a table in the catalog, the names of the same hash are compared.
+bool find_table_position(catalog* database, char* name, size_t* position) {
+  uint64_t key = hash_table_name(name);
+  for (hash_cursor c = hash_seek(database->names, &key); hash_cursor_valid(&c);
+       hash_cursor_next(&c)) {
+    if (strcmp(get_table_name(database, hash_cursor_row(&c)), name) == 0) {
+      *position = hash_cursor_row(&c);
+      return true;
+    }
+  }
+  return false;
+}
+
+table_data* find_table_from_name(catalog* database, char* name) {
+  size_t position;
+  if (!find_table_position(database, name, &position)) {
+    return NULL;
+  }
+  return load_table(database, position);
+}
+
+// A table in memory, or the place of a table of the opened file.
+void add_table_or_place(catalog* database,
+                        table_data* table,
+                        table_place* place) {
+  if (database->nb_tables == database->capacity) {
+    database->capacity *= 2;
+    database->tables = (table_data**)realloc(
+        database->tables, sizeof(table_data*) * database->capacity);
+    assert(database->tables != NULL);
+    database->places = (table_place**)realloc(
+        database->places, sizeof(table_place*) * database->capacity);
+    assert(database->places != NULL);
+  }
+  database->tables[database->nb_tables] = table;
+  database->places[database->nb_tables] = place;
+  size_t position = database->nb_tables++;
+  uint64_t key = hash_table_name(get_table_name(database, position));
+  hash_insert(database->names, &key, position);
+}
+
+void add_table(catalog* database, table_data* table) {
+  add_table_or_place(database, table, NULL);
+}
+
+// Take a table out of the catalog, the last table takes its position. A
+// table of the file which isn't read yet is forgotten without being read,
+// NULL is returned.
+table_data* remove_table(catalog* database, size_t position) {
+  table_data* table = database->tables[position];
+  uint64_t key = hash_table_name(get_table_name(database, position));
+  if (table == NULL) {
+    destroy_table_place(database->places[position]);
+  }
+  bool is_removed = hash_remove(database->names, &key, position);
+  assert(is_removed);
+  size_t last = --database->nb_tables;
+  if (position != last) {
+    key = hash_table_name(get_table_name(database, last));
+    is_removed = hash_remove(database->names, &key, last);
+    assert(is_removed);
+    hash_insert(database->names, &key, position);
+    database->tables[position] = database->tables[last];
+    database->places[position] = database->places[last];
+  }
+  return table;
+}
+
+// Forget every table, they're destroyed.
+void clear_catalog(catalog* database) {
+  for (size_t i = 0; i < database->nb_tables; i++) {
+    if (database->tables[i] == NULL) {
+      destroy_table_place(database->places[i]);
+      continue;
+    }
+    destroy_table(database->tables[i]);
+    free(database->tables[i]);
+  }
+  database->nb_tables = 0;
+  hash_destroy(database->names);
+  database->names = hash_create(sizeof(uint64_t), false);
+  if (database->file != NULL) {
+    fclose(database->file);
+    database->file = NULL;
+  }
+}
+
+bool new_tablename_is_unused(catalog* database, table_data* created_table) {
+  printf("is used %s\n", created_table->schema->name);
+  size_t position;
+  return !find_table_position(database, created_table->schema->name,
+                              &position);
+}
+
+// Copy a literal into a column of a row, the column is zero padded.
+bool write_literal(char* dest, ast_node* literal, size_t size) {
+  memset(dest, 0, size);
+  switch (literal->kind) {
+    case INT:
+      memcpy(dest, &literal->i_value,
+             size < sizeof(long) ? size : sizeof(long));
+      return true;
+    case FLOAT:
+      memcpy(dest, &literal->f_value,
+             size < sizeof(double) ? size : sizeof(double));
+      return true;
+    case STRING:
+      if (DEBUG) {
+        printf("string data in buffer %s\n", literal->value);
+      }
+      strncpy(dest, literal->value, size);
+      return true;
+    default:
+      runtime_error("Unknown value kind");
+      return false;
+  }
+}
+
+zone* get_zone(table_data* table, size_t row_index, size_t col_index) {
+  size_t index_page = row_index / table->rows_per_page;
+  return &table->zones[index_page * table->schema->nb_attr + col_index];
+}
+
+void read_zone_value(table_data* table,
+                     char* page,
+                     size_t row_index,
+                     size_t col_index,
+                     zone_value* value) {
+  attr_desc_size* desc = table->schema->descs[col_index];
+  char buffer[desc->size];
+  char* field = get_index_key(table, page, row_index, col_index, buffer);
+  memset(value, 0, sizeof(zone_value));
+  switch (desc->desc) {
+    case D_INT:
+      memcpy(&value->i, field, sizeof(long));
+      break;
+    case D_FLT:
+      memcpy(&value->f, field, sizeof(double));
+      break;
+    case D_CHR:
+    case D_DICT:
+      strncpy(value->s, field,
+              desc->size < ZONE_PREFIX ? desc->size : ZONE_PREFIX);
+      break;
+  }
+}
+
+// negative, zero or positive like strcmp
+int compare_zone_values(attr_kind kind, zone_value* a, zone_value* b) {
+  switch (kind) {
+    case D_INT:
+      return (a->i > b->i) - (a->i < b->i);
+    case D_FLT:
+      return (a->f > b->f) - (a->f < b->f);
+    case D_CHR:
+    case D_DICT:
+      return memcmp(a->s, b->s, ZONE_PREFIX);
+  }
+  return 0;
+}
+
+// Widen the zone of a column with the value of a row, the first row of a
+// page sets it. The zones never shrink, they only have to hold every value.
+void update_zone(table_data* table,
+                 char* page,
+                 size_t row_index,
+                 size_t col_index) {
+  attr_kind kind = table->schema->descs[col_index]->desc;
+  zone* z = get_zone(table, row_index, col_index);
+  zone_value value;
+  read_zone_value(table, page, row_index, col_index, &value);
+  if (row_index == table->nb_rows && row_index % table->rows_per_page == 0) {
+    z->min = value;
+    z->max = value;
+    return;
+  }
+  if (compare_zone_values(kind, &value, &z->min) < 0) {
+    z->min = value;
+  }
+  if (compare_zone_values(kind, &value, &z->max) > 0) {
+    z->max = value;
+  }
+}
+
+// Exact zones after the rows were moved.
+void rebuild_zones(table_data* table) {
+  size_t nb_attr = table->schema->nb_attr;
+  for (size_t index_page = 0; index_page < table->nb_pages; index_page++) {
+    size_t first = index_page * table->rows_per_page;
+    if (first >= table->nb_rows) {
+      break;
+    }
+    char* page = pin_row(table, first);
+    for (size_t col_index = 0; col_index < nb_attr; col_index++) {
+      zone* z = get_zone(table, first, col_index);
+      read_zone_value(table, page, first, col_index, &z->min);
+      z->max = z->min;
+      for (size_t row_index = first + 1;
+           row_index < table->nb_rows &&
+           row_index < first + table->rows_per_page;
+           row_index++) {
+        update_zone(table, page, row_index, col_index);
+      }
+    }
+    unpin_row(table, first, false);
+  }
+}
+
+// the mark of a moved row, nb_dead doesn't change
+void set_dead_mark(table_data* table, size_t row_index, bool is_dead) {
+  uint64_t bit = (uint64_t)1 << (row_index % 64);
+  if (is_dead) {
+    table->dead_rows[row_index / 64] |= bit;
+  } else {
+    table->dead_rows[row_index / 64] &= ~bit;
+  }
+}
+
+// A sorted row moves to a free slot further in the table, the indexes and
+// the zones follow it. Deleted rows move with their mark.
+void move_sorted_row(table_data* table, size_t from, size_t to) {
+  bool is_dead = is_row_dead(table, from);
+  if (!is_dead) {
+    char* page = pin_row(table, from);
+    update_secondary_indexes(table, page, from, NULL, 0, false);
+    unpin_row(table, from, false);
+  }
+  copy_row(table, from, to);
+  set_dead_mark(table, to, is_dead);
+  if (is_dead) {
+    return;
+  }
+  char* page = pin_row(table, to);
+  update_secondary_indexes(table, page, to, NULL, 0, true);
+  for (size_t col_index = 0; col_index < table->schema->nb_attr;
+       col_index++) {
+    update_zone(table, page, to, col_index);
+  }
+  unpin_row(table, to, false);
+}
+
+// Merge the rows [middle, last) with the sorted rows [first, middle). The
+// rows [middle, last) are copied aside and sorted unless they already are,
+// then the range is filled from its end so a sorted row moves at most once,
+// and only if a smaller key was in the other rows.
+void merge_rows(table_data* table,
+                size_t first,
+                size_t middle,
+                size_t last,
+                bool is_sorted) {
+  attr_desc_size* pk_desc = table->schema->descs[0];
+  size_t nb_attr = table->schema->nb_attr;
+  size_t nb_aside = last - middle;
+  char* aside = (char*)malloc(table->row_size * nb_aside + 1);
+  assert(aside != NULL);
+  char* keys = (char*)malloc(pk_desc->size * nb_aside + 1);
+  assert(keys != NULL);
+  bool* is_dead = (bool*)malloc(sizeof(bool) * (nb_aside + 1));
+  assert(is_dead != NULL);
+  size_t* order = (size_t*)malloc(sizeof(size_t) * (nb_aside + 1));
+  assert(order != NULL);
+  btree* sorter = btree_create(btree_kind_from_attr(pk_desc->desc),
+                               pk_desc->size);
+  char buffer[pk_desc->size];
+  for (size_t i = 0; i < nb_aside; i++) {
+    size_t row_index = middle + i;
+    char* page = pin_row(table, row_index);
+    is_dead[i] = is_row_dead(table, row_index);
+    if (!is_dead[i]) {
+      update_secondary_indexes(table, page, row_index, NULL, 0, false);
+    }
+    char* key = keys + i * pk_desc->size;
+    memcpy(key, get_index_key(table, page, row_index, 0, buffer),
+           pk_desc->size);
+    if (is_sorted) {
+      order[i] = i;
+    } else {
+      btree_insert(sorter, key, i);
+    }
+    char* row = aside + i * table->row_size;
+    for (size_t col_index = 0; col_index < nb_attr; col_index++) {
+      size_t width = field_width(table->schema->descs[col_index]);
+      memcpy(row, get_field(table, page, row_index, col_index), width);
+      row += width;
+    }
+    unpin_row(table, row_index, false);
+  }
+  size_t rank = 0;
+  for (btree_cursor c = btree_seek(sorter, NULL); btree_cursor_valid(&c);
+       btree_cursor_next(&c)) {
+    order[rank++] = btree_cursor_row(&c);
+  }
+  btree_destroy(sorter);
+
+  rank = nb_aside;
+  size_t destination = last;
+  char sorted_key[pk_desc->size];
+  while (rank > 0) {
+    destination--;
+    size_t slot = order[rank - 1];
+    if (middle > first) {
+      read_pk(table, middle - 1, sorted_key);
+    }
+    if (middle > first &&
+        compare_pk(table, sorted_key, keys + slot * pk_desc->size) > 0) {
+      move_sorted_row(table, middle - 1, destination);
+      middle--;
+      continue;
+    }
+    char* row = aside + slot * table->row_size;
+    char* page = pin_row(table, destination);
+    for (size_t col_index = 0; col_index < nb_attr; col_index++) {
+      size_t width = field_width(table->schema->descs[col_index]);
+      memcpy(get_field(table, page, destination, col_index), row, width);
+      row += width;
+      if (!is_dead[slot]) {
+        update_zone(table, page, destination, col_index);
+      }
+    }
+    set_dead_mark(table, destination, is_dead[slot]);
+    if (!is_dead[slot]) {
+      update_secondary_indexes(table, page, destination, NULL, 0, true);
+    }
+    unpin_row(table, destination, true);
+    rank--;
+  }
+  free(order);
+  free(is_dead);
+  free(keys);
+  free(aside);
+}
+
+// An insert merges the appended rows of a clustered table once they fill a
+// page and are a quarter of the sorted rows. A merge moves most of the
+// sorted rows, waiting for the appended rows to grow with the table keeps
+// it at a few moves per inserted row. Reads merge them at once.
+#define CLUSTER_MERGE_RATIO 4
+
+// Merge the rows appended to a clustered table since the last merge with its
+// sorted rows.
+void cluster_table(table_data* table) {
+  if (!table->is_clustered || table->nb_sorted == table->nb_rows) {
+    return;
+  }
+  merge_rows(table, 0, table->nb_sorted, table->nb_rows, false);
+  table->nb_sorted = table->nb_rows;
+  forget_appended(table);
+}
+
+// The memtable is sorted in place and becomes the newest run. The newest run
+// is then merged with the one before while it's at least half its size, a
+// row is merged O(log n) times.
+void flush_memtable(table_data* table) {
+  lsm_tree* lsm = table->lsm;
+  if (lsm->nb_flushed == table->nb_rows) {
+    return;
+  }
+  merge_rows(table, lsm->nb_flushed, lsm->nb_flushed, table->nb_rows, false);
+  add_run(lsm, lsm->nb_flushed, table->nb_rows - lsm->nb_flushed);
+  lsm->nb_flushed = table->nb_rows;
+  skiplist_destroy(lsm->memtable);
+  lsm->memtable = NULL;
+  while (lsm->nb_runs >= 2) {
+    sorted_run* older = &lsm->runs[lsm->nb_runs - 2];
+    sorted_run* newer = &lsm->runs[lsm->nb_runs - 1];
+    if (older->nb_rows > 2 * newer->nb_rows) {
+      break;
+    }
+    merge_rows(table, older->first, newer->first,
+               newer->first + newer->nb_rows, true);
+    older->nb_rows += newer->nb_rows;
+    forget_run_description(older);
+    forget_run_description(newer);
+    lsm->nb_runs--;
+  }
+}
+
+// Sort again the runs whose keys were updated.
+void sort_runs(table_data* table) {
+  for (size_t i = 0; table->lsm != NULL && i < table->lsm->nb_runs; i++) {
+    sorted_run* run = &table->lsm->runs[i];
+    if (!run->is_sorted) {
+      merge_rows(table, run->first, run->first, run->first + run->nb_rows,
+                 false);
+      run->is_sorted = true;
+    }
+  }
+}
+
+// The primary key of a row was updated, it isn't in its place anymore. The
+// rows of a clustered table are merged again from this one. The memtable of
+// an LSM table is indexed again, a run is sorted again once the statement
+// is done.
+void move_updated_pk(table_data* table,
+                     size_t row_index,
+                     const char* old_key,
+                     const char* new_key) {
+  if (table->is_clustered && row_index < table->nb_sorted) {
+    table->nb_sorted = row_index;
+  }
+  if (table->is_clustered) {
+    forget_appended(table);
+  }
+  lsm_tree* lsm = table->lsm;
+  if (lsm == NULL) {
+    return;
+  }
+  if (row_index >= lsm->nb_flushed) {
+    skiplist* memtable = get_memtable(table);
+    skiplist_remove(memtable, old_key, row_index);
+    skiplist_insert(memtable, new_key, row_index);
+    return;
+  }
+  for (size_t i = 0; i < lsm->nb_runs; i++) {
+    sorted_run* run = &lsm->runs[i];
+    if (row_index >= run->first && row_index < run->first + run->nb_rows) {
+      forget_run_description(run);
+      run->is_sorted = false;
+    }
+  }
+}
+
+// The deleted rows are about to be removed, the runs only keep their live
+// rows.
+void shrink_runs(table_data* table) {
+  lsm_tree* lsm = table->lsm;
+  if (lsm == NULL) {
+    return;
+  }
+  size_t first = 0;
+  size_t nb_runs = 0;
+  for (size_t i = 0; i < lsm->nb_runs; i++) {
+    sorted_run* run = &lsm->runs[i];
+    forget_run_description(run);
+    size_t nb_live = 0;
+    for (size_t row_index = run->first; row_index < run->first + run->nb_rows;
+         row_index++) {
+      nb_live += !is_row_dead(table, row_index);
+    }
+    if (nb_live > 0) {
+      sorted_run shrunk = {first, nb_live, run->is_sorted, NULL, NULL};
+      lsm->runs[nb_runs++] = shrunk;
+    }
+    first += nb_live;
+  }
+  lsm->nb_runs = nb_runs;
+  lsm->nb_flushed = first;
+  skiplist_destroy(lsm->memtable);
+  lsm->memtable = NULL;
+}
+
+// The bytes of a number would be read as a code or a varchar header.
+bool accepts_literal(attr_desc_size* desc, ast_node* literal) {
+  if ((desc->desc == D_DICT || is_out_of_line(desc)) &&
+      literal->kind != STRING) {
+    runtime_error("%s holds strings", desc->name);
+    return false;
+  }
+  return true;
+}
+
+// Copy a literal in a row, out of line varchars get a header and their
+// bytes go to the heap when they're long.
+bool store_field(table_data* table,
+                 char* page,
+                 size_t row_index,
+                 size_t col_index,
+                 ast_node* literal) {
+  attr_desc_size* desc = table->schema->descs[col_index];
+  char* field = get_field(table, page, row_index, col_index);
+  if (!accepts_literal(desc, literal)) {
+    return false;
+  }
+  if (desc->desc == D_DICT) {
+    char value[desc->size];
+    write_literal(value, literal, desc->size);
+    uint32_t code = encode_value(table->dictionaries[col_index], value);
+    memcpy(field, &code, sizeof(uint32_t));
+    return true;
+  }
+  if (!is_out_of_line(desc)) {
+    return write_literal(field, literal, field_width(desc));
+  }
+  varchar_ref ref;
+  make_varchar_ref(table, &ref, literal->value,
+                   strnlen(literal->value, desc->size));
+  memcpy(field, &ref, sizeof(varchar_ref));
+  return true;
+}
+
+// Write a literal in a row and widen the zone of its column.
+bool write_field(table_data* table,
+                 char* page,
+                 size_t row_index,
+                 size_t col_index,
+                 ast_node* literal) {
+  if (!store_field(table, page, row_index, col_index, literal)) {
+    return false;
+  }
+  update_zone(table, page, row_index, col_index);
+  return true;
+}
+
+bool execute_insert_into_table(catalog* database, ast_node* root) {
+  if (root->kind != INSERT) {
+    runtime_error("Expected an insert node");
+    return false;
+  }
+  ast_node* n_tablename = root->left;
+  if (n_tablename == NULL || n_tablename->kind != TABLENAME) {
+    runtime_error("Expected a tablename node");
+    return false;
+  }
+  char* tablename = n_tablename->value;
+
+  table_data* table = find_table_from_name(database, tablename);
+  if (table == NULL) {
+    runtime_error("Unknown table %s", tablename);
+    return false;
+  }
+
+  // increase capacity by a page
+  if (table->nb_rows == table->capacity) {
+    add_page(table);
+    if (DEBUG) {
+      runtime_error("Capacity reached for %s, adding a page", tablename);
+      print_table(table);
+    }
+  }
+
+  char* row = pin_row(table, table->nb_rows);
+  ast_node* curr_col = n_tablename->left;
+
+  for (size_t col_index = 0; col_index < table->schema->nb_attr; col_index++) {
+    if (curr_col == NULL ||
+        !(curr_col->kind == INT || curr_col->kind == FLOAT ||
+          curr_col->kind == STRING)) {
+      runtime_error("Expected a value (INT, FLOAT, STRING) node");
+      forget_row_strings(table, row, table->nb_rows, NULL, col_index);
+      unpin_row(table, table->nb_rows, true);
+      return false;
+    }
+    if (col_index == 0 && strlen(curr_col->value) == 0) {
+      runtime_error("Primary key can't be null");
+      unpin_row(table, table->nb_rows, true);
+      return false;
+    }
+    // write the data in the table
+    if (!write_field(table, row, table->nb_rows, col_index, curr_col)) {
+      forget_row_strings(table, row, table->nb_rows, NULL, col_index);
+      unpin_row(table, table->nb_rows, true);
+      return false;
+    }
+
+    curr_col = curr_col->left;
+  }
+  // enforce unicity of Primary key
+  char buffer[table->schema->descs[0]->size];
+  char* pk_key = get_index_key(table, row, table->nb_rows, 0, buffer);
+  bool is_unique = !find_pk_owner(table, pk_key, NULL);
+  if (is_unique && table->pk_index != NULL) {
+    btree_insert(table->pk_index, pk_key, table->nb_rows);
+  }
+  if (is_unique && table->lsm != NULL) {
+    skiplist_insert(get_memtable(table), pk_key, table->nb_rows);
+  }
+  if (is_unique && table->is_clustered) {
+    skiplist_insert(get_appended(table), pk_key, table->nb_rows);
+  }
+  if (is_unique) {
+    update_secondary_indexes(table, row, table->nb_rows, NULL, 0, true);
+  }
+  if (!is_unique) {
+    forget_row_strings(table, row, table->nb_rows, NULL,
+                       table->schema->nb_attr);
+  }
+  unpin_row(table, table->nb_rows, true);
+  if (!is_unique) {
+    runtime_error("Primary key must be unique");
+    return false;
+  }
+  table->nb_rows += 1;
+  size_t nb_appended = table->nb_rows - table->nb_sorted;
+  if (table->is_clustered && nb_appended >= table->rows_per_page &&
+      nb_appended * CLUSTER_MERGE_RATIO >= table->nb_sorted) {
+    cluster_table(table);
+  }
+  if (table->lsm != NULL &&
+      table->nb_rows - table->lsm->nb_flushed >= LSM_MEMTABLE_ROWS) {
+    flush_memtable(table);
+  }
+
+  return true;
+}
+
+bool is_node_comp(ast_node* node) {
+  return node->kind == COMP && strncmp(node->value, "AND", 3) != 0 &&
+         strncmp(node->value, "OR", 2) != 0;
+}
+
+bool is_node_and(ast_node* node) {
+  return node->kind == COMP && strncmp(node->value, "AND", 3) == 0;
+}
+
+bool is_node_or(ast_node* node) {
+  return node->kind == COMP && strncmp(node->value, "OR", 2) == 0;
+}
+
+// A WHERE condition compiled for a table, once per statement. Comparisons
+// become instructions holding the place of their column in a page and their
+// literal, AND and OR become jumps over the comparisons they short circuit.
+// The comparisons of ints and floats are in the order of filter_op. Strings
+// are equal, different, or start with a prefix: `LIKE 'abc%'`.
+typedef enum WhereOpcode {
+  WHERE_INT_EQ,
+  WHERE_INT_NE,
+  WHERE_INT_LT,
+  WHERE_INT_LE,
+  WHERE_INT_GT,
+  WHERE_INT_GE,
+  WHERE_FLT_EQ,
+  WHERE_FLT_NE,
+  WHERE_FLT_LT,
+  WHERE_FLT_LE,
+  WHERE_FLT_GT,
+  WHERE_FLT_GE,
+  WHERE_CODE_EQ,     // a DICT column and the code of the literal
+  WHERE_CODE_NE,
+  WHERE_CODE_IN,     // the codes of the values starting with the prefix
+  WHERE_CHR_EQ,      // a string stored in the row
+  WHERE_CHR_NE,
+  WHERE_CHR_PREFIX,
+  WHERE_REF_EQ,      // an out of line varchar
+  WHERE_REF_NE,
+  WHERE_REF_PREFIX,
+  WHERE_JUMP_FALSE,  // AND: the left side failed, skip the right one
+  WHERE_JUMP_TRUE,   // OR: the left side matched, skip the right one
+} where_opcode;
+
+typedef struct WhereInstruction {
+  where_opcode op;
+  size_t offset;  // of the column in a page, the target of a jump
+  size_t stride;
+  size_t size;  // declared size of a string column
+  union {
+    long i;  // an int, or a DICT code, -1 when it isn't in the dictionary
+    double f;
+    struct {
+      const char* bytes;  // the literal, or the prefix
+      size_t length;
+      // the field, or the varchar header, compared by filter_windows
+      char pattern[FILTER_WINDOW];
+      uint32_t byte_mask;
+      bool is_exact;  // the windows matching the pattern need no check
+    } s;
+    struct {
+      const bool* is_matching;  // by code
+      size_t nb_codes;
+    } codes;
+  };
+} where_instruction;
+
+typedef struct WhereProgram {
+  where_instruction* code;
+  size_t nb_instructions;
+} where_program;
+
+size_t count_where_instructions(ast_node* condition) {
+  if (condition == NULL || is_node_comp(condition)) {
+    return 1;
+  }
+  return count_where_instructions(condition->left) +
+         count_where_instructions(condition->right) + 1;
+}
+
+filter_op comparison_op(char* op, bool* is_valid) {
+  *is_valid = true;
+  if (strncmp(op, "=", 1) == 0) {
+    return FILTER_EQ;
+  } else if (strncmp(op, "!=", 2) == 0) {
+    return FILTER_NE;
+  } else if (strncmp(op, "<=", 2) == 0) {
+    return FILTER_LE;
+  } else if (strncmp(op, ">=", 2) == 0) {
+    return FILTER_GE;
+  } else if (strncmp(op, "<", 1) == 0) {
+    return FILTER_LT;
+  } else if (strncmp(op, ">", 1) == 0) {
+    return FILTER_GT;
+  }
+  *is_valid = false;
+  return FILTER_EQ;
+}
+
+// flip a comparison whose literal is on the left: 3 < "a" is "a" > 3
+char* flip_comparison(char* op) {
+  if (strcmp(op, "<") == 0) {
+    return ">";
+  } else if (strcmp(op, ">") == 0) {
+    return "<";
+  } else if (strcmp(op, "<=") == 0) {
+    return ">=";
+  } else if (strcmp(op, ">=") == 0) {
+    return "<=";
+  }
+  return op;
+}
+
+// The column, the literal and the operator of a comparison, as if the
+// column was on the left. The program and the lookups of the candidate rows,
+// in the indexes, the zones and the sorted rows, all read it here. false
+// when no side is a column.
+bool orient_comparison(ast_node* condition,
+                       ast_node** column,
+                       ast_node** literal,
+                       char** op) {
+  *column = condition->left;
+  *literal = condition->right;
+  *op = condition->value;
+  if ((*column)->kind != COLNAME) {
+    *column = condition->right;
+    *literal = condition->left;
+    *op = flip_comparison(*op);
+  }
+  return (*column)->kind == COLNAME;
+}
+
+// The fixed bytes of a LIKE pattern, before its final %. The strings keep
+// their quotes: 'abc%' is the prefix 'abc. A pattern without a wildcard is
+// an equality, the others aren't supported.
+bool like_prefix(const char* pattern, size_t* length, bool* is_prefix) {
+  size_t len = strlen(pattern);
+  size_t nb_fixed = strcspn(pattern, "%_");
+  *is_prefix = nb_fixed < len;
+  *length = nb_fixed;
+  return nb_fixed == len || (pattern[nb_fixed] == '%' && nb_fixed + 2 == len);
+}
+
+// A string comparison: =, != or LIKE. The kernels compare the fields, or
+// the varchar headers, to a pattern built here from the literal as it's
+// stored. Out of line varchars whose header matches are checked in full.
+bool compile_string(table_data* table,
+                    size_t col_index,
+                    char* op,
+                    ast_node* literal,
+                    where_instruction* instruction) {
+  attr_desc_size* desc = table->schema->descs[col_index];
+  size_t length = strlen(literal->value);
+  bool is_prefix = false;
+  bool is_different = strncmp(op, "!=", 2) == 0;
+  if (strncmp(op, "LIKE", 4) == 0) {
+    if (!like_prefix(literal->value, &length, &is_prefix)) {
+      runtime_error("LIKE only matches a prefix: 'abc%%'");
+      return false;
+    }
+  } else if (!is_different && strncmp(op, "=", 1) != 0) {
+    runtime_error("invalid comparison between strings %s", op);
+    return false;
+  }
+  // the opcodes of a kind of column are equal, different, prefix
+  int variant = is_prefix ? 2 : is_different ? 1 : 0;
+  if (desc->desc == D_DICT) {
+    dictionary* dict = table->dictionaries[col_index];
+    instruction->op = (where_opcode)(WHERE_CODE_EQ + variant);
+    if (is_prefix) {
+      bool* is_matching = (bool*)arena_alloc(get_statement_arena(),
+                                             sizeof(bool) * dict->nb_values);
+      for (size_t code = 0; code < dict->nb_values; code++) {
+        is_matching[code] =
+            length <= dict->size &&
+            memcmp(dict->values + code * dict->size, literal->value,
+                   length) == 0;
+      }
+      instruction->codes.is_matching = is_matching;
+      instruction->codes.nb_codes = dict->nb_values;
+      return true;
+    }
+    char value[desc->size];
+    write_literal(value, literal, desc->size);
+    uint32_t code;
+    instruction->i = -1;
+    if (find_code(dict, value, &code)) {
+      instruction->i = code;
+    }
+    return true;
+  }
+  instruction->s.bytes = literal->value;
+  instruction->s.length = length;
+  instruction->s.is_exact = true;
+  char* pattern = instruction->s.pattern;
+  memset(pattern, 0, FILTER_WINDOW);
+  instruction->s.byte_mask = 0;
+  if (!is_out_of_line(desc)) {
+    // an equality also compares the zero padding after the string
+    instruction->op = (where_opcode)(WHERE_CHR_EQ + variant);
+    size_t nb_bytes = is_prefix || length >= desc->size ? length : length + 1;
+    if (length <= desc->size) {
+      memcpy(pattern, literal->value, length);
+      instruction->s.byte_mask = (uint32_t)((1UL << nb_bytes) - 1);
+    }
+    return true;
+  }
+  instruction->op = (where_opcode)(WHERE_REF_EQ + variant);
+  varchar_ref header;
+  memset(&header, 0, sizeof(varchar_ref));
+  size_t nb_prefix =
+      length < sizeof(header.prefix) ? length : sizeof(header.prefix);
+  memcpy(header.prefix, literal->value, nb_prefix);
+  if (is_prefix) {
+    instruction->s.byte_mask = (uint32_t)((1UL << nb_prefix) - 1)
+                               << offsetof(varchar_ref, prefix);
+    instruction->s.is_exact = length == nb_prefix;
+  } else if (length <= VARCHAR_INLINE) {
+    // a short string is entirely in its header
+    header.length = (uint32_t)length;
+    memcpy(header.prefix, literal->value, length);
+    instruction->s.byte_mask = 0xffff;
+  } else {
+    header.length = (uint32_t)length;
+    instruction->s.byte_mask = 0xff;
+    instruction->s.is_exact = false;
+  }
+  memcpy(pattern, &header, sizeof(varchar_ref));
+  return true;
+}
+
+// Resolve the column and the literal of a comparison `"column" op literal`.
+bool compile_comparison(table_data* table,
+                        ast_node* condition,
+                        where_instruction* instruction) {
+  if (condition->left == NULL || condition->right == NULL) {
+    runtime_error("Condition should have both children set.");
+    return false;
+  }
+  ast_node* column;
+  ast_node* literal;
+  char* op;
+  if (!orient_comparison(condition, &column, &literal, &op)) {
+    runtime_error("Condition should have at least one COLNAME as children");
+    return false;
+  }
+  size_t col_index;
+  attr_desc_size* desc = NULL;
+  for (col_index = 0; col_index < table->schema->nb_attr; col_index++) {
+    if (strcmp(table->schema->descs[col_index]->name, column->value) == 0) {
+      desc = table->schema->descs[col_index];
+      break;
+    }
+  }
+  if (desc == NULL) {
+    runtime_error("Couldn't find the colname %s in the table", column->value);
+    return false;
+  }
+  instruction->offset = table->column_offsets[col_index];
+  instruction->stride = table->column_strides[col_index];
+  instruction->size = desc->size;
+  bool is_valid = false;
+  switch (literal->kind) {
+    case INT:
+      instruction->op =
+          (where_opcode)(WHERE_INT_EQ + comparison_op(op, &is_valid));
+      instruction->i = literal->i_value;
+      if (!is_valid) {
+        runtime_error("invalid comparison between integer %s", op);
+        return false;
+      }
+      is_valid = desc->desc == D_INT;
+      break;
+    case FLOAT:
+      instruction->op =
+          (where_opcode)(WHERE_FLT_EQ + comparison_op(op, &is_valid));
+      instruction->f = literal->f_value;
+      if (!is_valid) {
+        runtime_error("invalid comparison between floats %s", op);
+        return false;
+      }
+      is_valid = desc->desc == D_FLT;
+      break;
+    case STRING:
+      is_valid = desc->desc == D_CHR || desc->desc == D_DICT;
+      if (is_valid &&
+          !compile_string(table, col_index, op, literal, instruction)) {
+        return false;
+      }
+      break;
+    default:
+      runtime_error("Invalid node kind for a comparison value");
+      return false;
+  }
+  if (!is_valid) {
+    runtime_error("Column %s can't be compared to this literal",
+                  column->value);
+    return false;
+  }
+  return true;
+}
+
+bool compile_condition(table_data* table,
+                       ast_node* condition,
+                       where_program* program) {
+  if (condition == NULL) {
+    runtime_error("Condition shouldn't be NULL");
+    return false;
+  }
+  if (is_node_comp(condition)) {
+    return compile_comparison(table, condition,
+                              &program->code[program->nb_instructions++]);
+  }
+  if (!is_node_and(condition) && !is_node_or(condition)) {
+    runtime_error("Expected a condition node");
+    return false;
+  }
+  if (!compile_condition(table, condition->left, program)) {
+    return false;
+  }
+  where_instruction* jump = &program->code[program->nb_instructions++];
+  jump->op = is_node_and(condition) ? WHERE_JUMP_FALSE : WHERE_JUMP_TRUE;
+  if (!compile_condition(table, condition->right, program)) {
+    return false;
+  }
+  jump->offset = program->nb_instructions;
+  return true;
+}
+
+// The program of a condition, allocated in the arena of the statement. NULL
+// when the condition is invalid for the table, the error is reported.
+where_program* compile_where(table_data* table, ast_node* condition) {
+  arena* a = get_statement_arena();
+  where_program* program =
+      (where_program*)arena_alloc(a, sizeof(where_program));
+  program->nb_instructions = 0;
+  program->code = (where_instruction*)arena_alloc(
+      a, sizeof(where_instruction) * count_where_instructions(condition));
+  if (!compile_condition(table, condition, program)) {
+    return NULL;
+  }
+  return program;
+}
+
+// Rows of a page taken together by a scan, about a thousand at a time. The
+// rows are a selection vector: the conditions only keep the rows they
+// match, in the same order.
+#define BATCH_ROWS 1024
+
+typedef struct RowBatch {
+  size_t index_page;
+  char* page;  // pinned until unpin_batch
+  size_t nb_rows;
+  size_t rows[BATCH_ROWS];
+} row_batch;
+
+bool is_jump(where_opcode op) {
+  return op == WHERE_JUMP_FALSE || op == WHERE_JUMP_TRUE;
+}
+
+bool is_different(where_opcode op) {
+  return op == WHERE_CODE_NE || op == WHERE_CHR_NE || op == WHERE_REF_NE;
+}
+
+// The full comparison of an out of line varchar whose header matched.
+bool ref_matches(const where_instruction* instruction,
+                 const varchar_ref* ref,
+                 const char* heap) {
+  if (instruction->op == WHERE_REF_PREFIX) {
+    return ref->length >= instruction->s.length &&
+           memcmp(varchar_bytes(ref, heap), instruction->s.bytes,
+                  instruction->s.length) == 0;
+  }
+  return varchar_equals(ref, heap, instruction->s.bytes,
+                        instruction->s.length);
+}
+
+// The selected positions of a batch whose row matches a comparison. The
+// values of the column are gathered first, then compared at once by the
+// widest kernels of the processor, except the DICT codes.
+size_t filter_comparison(const where_instruction* instruction,
+                         table_data* table,
+                         row_batch* batch,
+                         const size_t* selection,
+                         size_t nb_selected,
+                         size_t* kept) {
+  // the rows are in the page, their slot is found without a division
+  size_t first_row = batch->index_page * table->rows_per_page;
+  const char* column = batch->page + instruction->offset;
+  const char* fields[nb_selected];
+  for (size_t i = 0; i < nb_selected; i++) {
+    size_t slot = batch->rows[selection[i]] - first_row;
+    fields[i] = column + slot * instruction->stride;
+  }
+  uint64_t mask[FILTER_MASK_WORDS(nb_selected)];
+  memset(mask, 0, sizeof(mask));
+  switch (instruction->op) {
+    case WHERE_INT_EQ:
+    case WHERE_INT_NE:
+    case WHERE_INT_LT:
+    case WHERE_INT_LE:
+    case WHERE_INT_GT:
+    case WHERE_INT_GE: {
+      long values[nb_selected];
+      for (size_t i = 0; i < nb_selected; i++) {
+        memcpy(&values[i], fields[i], sizeof(long));
+      }
+      filter_longs(filter_best_level(),
+                   (filter_op)(instruction->op - WHERE_INT_EQ), values,
+                   nb_selected, instruction->i, mask);
+      break;
+    }
+    case WHERE_FLT_EQ:
+    case WHERE_FLT_NE:
+    case WHERE_FLT_LT:
+    case WHERE_FLT_LE:
+    case WHERE_FLT_GT:
+    case WHERE_FLT_GE: {
+      double values[nb_selected];
+      for (size_t i = 0; i < nb_selected; i++) {
+        memcpy(&values[i], fields[i], sizeof(double));
+      }
+      filter_doubles(filter_best_level(),
+                     (filter_op)(instruction->op - WHERE_FLT_EQ), values,
+                     nb_selected, instruction->f, mask);
+      break;
+    }
+    case WHERE_CODE_EQ:
+    case WHERE_CODE_NE:
+      for (size_t i = 0; i < nb_selected; i++) {
+        uint32_t code;
+        memcpy(&code, fields[i], sizeof(uint32_t));
+        mask[i / 64] |= (uint64_t)((long)code == instruction->i) << (i % 64);
+      }
+      break;
+    case WHERE_CODE_IN:
+      for (size_t i = 0; i < nb_selected; i++) {
+        uint32_t code;
+        memcpy(&code, fields[i], sizeof(uint32_t));
+        // the codes given by the statement itself don't match
+        bool is_matching = code < instruction->codes.nb_codes &&
+                           instruction->codes.is_matching[code];
+        mask[i / 64] |= (uint64_t)is_matching << (i % 64);
+      }
+      break;
+    case WHERE_CHR_EQ:
+    case WHERE_CHR_NE:
+    case WHERE_CHR_PREFIX: {
+      if (instruction->s.length > instruction->size) {
+        break;  // longer than the field, nothing matches
+      }
+      // a window past the end of the page is copied, there are at most
+      // FILTER_WINDOW - 1 of them
+      char tails[FILTER_WINDOW][FILTER_WINDOW];
+      size_t nb_tails = 0;
+      const char* end = batch->page + PAGER_PAGE_SIZE;
+      for (size_t i = 0; i < nb_selected; i++) {
+        if (fields[i] + FILTER_WINDOW > end) {
+          memset(tails[nb_tails], 0, FILTER_WINDOW);
+          memcpy(tails[nb_tails], fields[i], (size_t)(end - fields[i]));
+          fields[i] = tails[nb_tails++];
         }
+      }
+      filter_windows(filter_best_level(), fields, nb_selected,
+                     instruction->s.pattern, instruction->s.byte_mask, mask);
+      break;
+    }
+    case WHERE_REF_EQ:
+    case WHERE_REF_NE:
+    case WHERE_REF_PREFIX:
+      filter_windows(filter_best_level(), fields, nb_selected,
+                     instruction->s.pattern, instruction->s.byte_mask, mask);
+      if (instruction->s.is_exact) {
         break;
-      case STRING:
-        if (DEBUG) {
-          printf("value is a string\n");
-        }
-        literal_string_value =
-            (is_value_right) ? condition->right->value : condition->left->value;
-        if (DEBUG) {
-          printf("literal value %s\n", literal_string_value);
+      }
+      for (size_t i = 0; i < nb_selected; i++) {
+        if ((mask[i / 64] >> (i % 64)) & 1) {
+          varchar_ref ref;
+          memcpy(&ref, fields[i], sizeof(varchar_ref));
+          if (!ref_matches(instruction, &ref, table->heap)) {
+            mask[i / 64] &= ~((uint64_t)1 << (i % 64));
+          }
         }
+      }
+      break;
+    case WHERE_JUMP_FALSE:
+    case WHERE_JUMP_TRUE:
+      break;
+  }
+  if (is_different(instruction->op)) {
+    filter_invert(mask, nb_selected);
+  }
+  return filter_select(mask, selection, nb_selected, kept);
+}
+
+// The selected positions matching the instructions [first, last) of a
+// program: a comparison, or a left side, the jump to last and a right side.
+// AND checks the right side on the rows kept by the left one, OR on the
+// others.
+size_t filter_program(where_program* program,
+                      size_t first,
+                      size_t last,
+                      table_data* table,
+                      row_batch* batch,
+                      const size_t* selection,
+                      size_t nb_selected,
+                      size_t* kept) {
+  if (nb_selected == 0) {
+    return 0;
+  }
+  if (last - first == 1) {
+    return filter_comparison(&program->code[first], table, batch, selection,
+                             nb_selected, kept);
+  }
+  // the jumps of the left side stay in it
+  size_t jump = first;
+  while (!is_jump(program->code[jump].op) ||
+         program->code[jump].offset != last) {
+    jump++;
+  }
+  size_t left[nb_selected];
+  size_t nb_left = filter_program(program, first, jump, table, batch,
+                                  selection, nb_selected, left);
+  if (program->code[jump].op == WHERE_JUMP_FALSE) {
+    return filter_program(program, jump + 1, last, table, batch, left,
+                          nb_left, kept);
+  }
+  size_t others[nb_selected];
+  size_t nb_others = 0;
+  for (size_t i = 0, j = 0; i < nb_selected; i++) {
+    if (j < nb_left && left[j] == selection[i]) {
+      j++;
+    } else {
+      others[nb_others++] = selection[i];
+    }
+  }
+  size_t right[nb_selected];
+  size_t nb_right = filter_program(program, jump + 1, last, table, batch,
+                                   others, nb_others, right);
+  // both are in the order of the batch
+  size_t nb_kept = 0;
+  size_t i = 0;
+  size_t j = 0;
+  while (i < nb_left || j < nb_right) {
+    if (j == nb_right || (i < nb_left && left[i] < right[j])) {
+      kept[nb_kept++] = left[i++];
+    } else {
+      kept[nb_kept++] = right[j++];
+    }
+  }
+  return nb_kept;
+}
+
+// Only keep the rows of a batch which satisfy a program, every row is kept
+// without one.
+void filter_batch(where_program* program, table_data* table, row_batch* batch) {
+  if (program == NULL || batch->nb_rows == 0) {
+    return;
+  }
+  size_t selection[batch->nb_rows];
+  for (size_t i = 0; i < batch->nb_rows; i++) {
+    selection[i] = i;
+  }
+  size_t kept[batch->nb_rows];
+  size_t nb_kept =
+      filter_program(program, 0, program->nb_instructions, table, batch,
+                     selection, batch->nb_rows, kept);
+  // kept[i] >= i, the rows are moved down in place
+  for (size_t i = 0; i < nb_kept; i++) {
+    batch->rows[i] = batch->rows[kept[i]];
+  }
+  batch->nb_rows = nb_kept;
+}
+
+// A comparison `"column" op literal` which an index can answer.
+typedef struct IndexedComparison {
+  btree* tree;
+  hash_index* hash;  // for equalities, used instead of a tree
+  char* op;  // as if the column was on the left
+  ast_node* literal;
+} indexed_comparison;
+
+// Comparisons an index answers: every one but != for ints, < and > for
+// floats, = for strings.
+bool is_comparison_indexable(attr_kind kind, ast_kind literal, char* op) {
+  switch (kind) {
+    case D_INT:
+      return literal == INT && strcmp(op, "!=") != 0;
+    case D_FLT:
+      return literal == FLOAT && (strcmp(op, "<") == 0 || strcmp(op, ">") == 0);
+    case D_CHR:
+    case D_DICT:
+      return literal == STRING && strcmp(op, "=") == 0;
+  }
+  return false;
+}
+
+// Search a comparison on an indexed column in a condition, possibly AND-ed
+// with other conditions. Equalities are preferred to ranges.
+bool find_indexed_comparison(table_data* table,
+                             ast_node* condition,
+                             bool is_equality,
+                             indexed_comparison* found) {
+  if (condition == NULL) {
+    return false;
+  }
+  if (is_node_and(condition)) {
+    return find_indexed_comparison(table, condition->left, is_equality,
+                                   found) ||
+           find_indexed_comparison(table, condition->right, is_equality,
+                                   found);
+  }
+  if (!is_node_comp(condition) || condition->left == NULL ||
+      condition->right == NULL ||
+      (strcmp(condition->value, "=") == 0) != is_equality) {
+    return false;
+  }
+  ast_node* colname;
+  ast_node* literal;
+  char* op;
+  if (!orient_comparison(condition, &colname, &literal, &op)) {
+    return false;
+  }
+  for (size_t column = 0; column < table->schema->nb_attr; column++) {
+    attr_desc_size* desc = table->schema->descs[column];
+    if (strcmp(colname->value, desc->name) != 0) {
+      continue;
+    }
+    if (!is_comparison_indexable(desc->desc, literal->kind, op)) {
+      return false;
+    }
+    found->hash = is_equality ? find_column_hash(table, column) : NULL;
+    found->tree =
+        found->hash == NULL ? find_column_index(table, column) : NULL;
+    found->op = op;
+    found->literal = literal;
+    return found->tree != NULL || found->hash != NULL;
+  }
+  return false;
+}
+
+// Rows which may satisfy a where condition. Candidates come from an index
+// when the condition allows it, otherwise every row is visited.
+typedef struct RowCursor {
+  table_data* table;
+  ast_node* condition;
+  size_t position;
+  size_t nb_rows;
+  size_t* rows;  // NULL for a full scan
+} row_cursor;
+
+int compare_row_indexes(const void* a, const void* b) {
+  size_t row_a = *(const size_t*)a;
+  size_t row_b = *(const size_t*)b;
+  return (row_a > row_b) - (row_a < row_b);
+}
+
+// Collect the rows of an index range, they're visited in the table order.
+void collect_indexed_rows(row_cursor* cursor,
+                          indexed_comparison* comparison,
+                          size_t max_rows) {
+  cursor->rows = (size_t*)malloc(sizeof(size_t) * (max_rows + 1));
+  assert(cursor->rows != NULL);
+  cursor->nb_rows = 0;
+  if (comparison->hash != NULL) {
+    char key[comparison->hash->key_size];
+    write_literal(key, comparison->literal, comparison->hash->key_size);
+    for (hash_cursor c = hash_seek(comparison->hash, key);
+         hash_cursor_valid(&c); hash_cursor_next(&c)) {
+      cursor->rows[cursor->nb_rows++] = hash_cursor_row(&c);
+    }
+    qsort(cursor->rows, cursor->nb_rows, sizeof(size_t), compare_row_indexes);
+    return;
+  }
+  btree* tree = comparison->tree;
+  char* op = comparison->op;
+  char key[tree->key_size];
+  write_literal(key, comparison->literal, tree->key_size);
+  bool is_lower = op[0] == '<';
+  btree_cursor c = btree_seek(tree, is_lower ? NULL : key);
+  for (; btree_cursor_valid(&c); btree_cursor_next(&c)) {
+    int cmp = btree_compare_keys(tree, btree_cursor_key(&c), key);
+    if (cmp == 0 && strcmp(op, ">") == 0) {
+      continue;
+    }
+    if ((cmp > 0 && (is_lower || strcmp(op, "=") == 0)) ||
+        (cmp == 0 && strcmp(op, "<") == 0)) {
+      break;
+    }
+    cursor->rows[cursor->nb_rows++] = btree_cursor_row(&c);
+  }
+  qsort(cursor->rows, cursor->nb_rows, sizeof(size_t), compare_row_indexes);
+}
+
+// String literals compared to a DICT column get the code of their value, -1
+// if it isn't in the dictionary. Rows are then compared by their codes.
+void bind_dictionary_codes(table_data* table, ast_node* condition) {
+  if (condition == NULL) {
+    return;
+  }
+  if (!is_node_comp(condition)) {
+    bind_dictionary_codes(table, condition->left);
+    bind_dictionary_codes(table, condition->right);
+    return;
+  }
+  if (condition->left == NULL || condition->right == NULL) {
+    return;
+  }
+  ast_node* column;
+  ast_node* literal;
+  char* op;
+  if (!orient_comparison(condition, &column, &literal, &op) ||
+      literal->kind != STRING) {
+    return;
+  }
+  for (size_t i = 0; i < table->schema->nb_attr; i++) {
+    dictionary* dict = table->dictionaries[i];
+    if (dict == NULL ||
+        strcmp(column->value, table->schema->descs[i]->name) != 0) {
+      continue;
+    }
+    char value[dict->size];
+    write_literal(value, literal, dict->size);
+    uint32_t code;
+    literal->i_value = find_code(dict, value, &code) ? (long)code : -1;
+    return;
+  }
+}
+
+// false when a Bloom index of the column tells the page hasn't the value.
+bool may_hold_value(table_data* table,
+                    size_t index_page,
+                    size_t column,
+                    ast_node* literal) {
+  attr_desc_size* desc = table->schema->descs[column];
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    bloom* filters = table->indexes[i]->filters;
+    if (table->indexes[i]->column != column || filters == NULL ||
+        index_page >= filters->nb_filters) {
+      continue;
+    }
+    char key[desc->size];
+    write_literal(key, literal, desc->size);
+    return bloom_may_contain(filters, index_page,
+                             hash_column_value(desc, key));
+  }
+  return true;
+}
+
+// false when no row of the page can satisfy a comparison of the condition,
+// according to the zones and the Bloom filters of the page.
+bool may_match_page(table_data* table, size_t index_page, ast_node* condition) {
+  if (condition == NULL) {
+    return true;
+  }
+  if (is_node_and(condition)) {
+    return may_match_page(table, index_page, condition->left) &&
+           may_match_page(table, index_page, condition->right);
+  }
+  if (is_node_or(condition)) {
+    return may_match_page(table, index_page, condition->left) ||
+           may_match_page(table, index_page, condition->right);
+  }
+  if (!is_node_comp(condition) || condition->left == NULL ||
+      condition->right == NULL) {
+    return true;
+  }
+  ast_node* colname;
+  ast_node* literal;
+  char* op;
+  if (!orient_comparison(condition, &colname, &literal, &op)) {
+    return true;
+  }
+  for (size_t column = 0; column < table->schema->nb_attr; column++) {
+    attr_desc_size* desc = table->schema->descs[column];
+    if (strcmp(colname->value, desc->name) != 0) {
+      continue;
+    }
+    if (!is_comparison_indexable(desc->desc, literal->kind, op) &&
+        !(desc->desc == D_INT && literal->kind == INT)) {
+      return true;
+    }
+    if (strcmp(op, "=") == 0 &&
+        is_comparison_indexable(desc->desc, literal->kind, op) &&
+        !may_hold_value(table, index_page, column, literal)) {
+      return false;
+    }
+    zone_value value;
+    memset(&value, 0, sizeof(zone_value));
+    if (literal->kind == INT) {
+      value.i = literal->i_value;
+    } else if (literal->kind == FLOAT) {
+      value.f = literal->f_value;
+    } else {
+      strncpy(value.s, literal->value,
+              desc->size < ZONE_PREFIX ? desc->size : ZONE_PREFIX);
+    }
+    zone* z = &table->zones[index_page * table->schema->nb_attr + column];
+    int to_min = compare_zone_values(desc->desc, &value, &z->min);
+    int to_max = compare_zone_values(desc->desc, &value, &z->max);
+    if (strcmp(op, "=") == 0) {
+      return to_min >= 0 && to_max <= 0;
+    } else if (strcmp(op, "!=") == 0) {
+      return to_min != 0 || to_max != 0;
+    } else if (strcmp(op, "<") == 0) {
+      return to_min > 0;
+    } else if (strcmp(op, "<=") == 0) {
+      return to_min >= 0;
+    } else if (strcmp(op, ">") == 0) {
+      return to_max < 0;
+    } else if (strcmp(op, ">=") == 0) {
+      return to_max <= 0;
+    }
+    return true;
+  }
+  return true;
+}
+
+// Narrow [first, last) to the rows of a sorted run which may satisfy the
+// comparisons of the primary key AND-ed in a condition, they're found by
+// binary search. false when the condition doesn't compare the key.
+bool narrow_sorted_range(table_data* table,
+                         sorted_run* run,
+                         ast_node* condition,
+                         size_t* first,
+                         size_t* last) {
+  if (condition == NULL) {
+    return false;
+  }
+  if (is_node_and(condition)) {
+    bool is_left_narrowed =
+        narrow_sorted_range(table, run, condition->left, first, last);
+    return narrow_sorted_range(table, run, condition->right, first, last) ||
+           is_left_narrowed;
+  }
+  if (!is_node_comp(condition) || condition->left == NULL ||
+      condition->right == NULL) {
+    return false;
+  }
+  ast_node* colname;
+  ast_node* literal;
+  char* op;
+  bool is_oriented = orient_comparison(condition, &colname, &literal, &op);
+  attr_desc_size* desc = table->schema->descs[0];
+  if (!is_oriented || strcmp(colname->value, desc->name) != 0 ||
+      !is_comparison_indexable(desc->desc, literal->kind, op)) {
+    return false;
+  }
+  char key[desc->size];
+  write_literal(key, literal, desc->size);
+  size_t lower = run->first;
+  size_t upper = run->first + run->nb_rows;
+  if (strcmp(op, "=") == 0 || strcmp(op, ">=") == 0) {
+    lower = seek_run(table, run, key, false);
+  } else if (strcmp(op, ">") == 0) {
+    lower = seek_run(table, run, key, true);
+  }
+  if (strcmp(op, "=") == 0 || strcmp(op, "<=") == 0) {
+    upper = seek_run(table, run, key, true);
+  } else if (strcmp(op, "<") == 0) {
+    upper = seek_run(table, run, key, false);
+  }
+  *first = lower > *first ? lower : *first;
+  *last = upper < *last ? upper : *last;
+  if (*last < *first) {
+    *last = *first;
+  }
+  return true;
+}
+
+// Rows of an LSM table which may satisfy the comparisons of the primary key
+// in a condition: a range of each run, and the whole memtable. false when
+// the condition doesn't compare the key.
+bool collect_run_rows(row_cursor* cursor) {
+  table_data* table = cursor->table;
+  lsm_tree* lsm = table->lsm;
+  cursor->rows = (size_t*)malloc(sizeof(size_t) * (table->nb_rows + 1));
+  assert(cursor->rows != NULL);
+  cursor->nb_rows = 0;
+  bool is_narrowed = false;
+  for (size_t i = 0; i < lsm->nb_runs; i++) {
+    sorted_run* run = &lsm->runs[i];
+    describe_run(table, run);
+    size_t first = run->first;
+    size_t last = run->first + run->nb_rows;
+    if (narrow_sorted_range(table, run, cursor->condition, &first, &last)) {
+      is_narrowed = true;
+    }
+    for (size_t row_index = first; row_index < last; row_index++) {
+      cursor->rows[cursor->nb_rows++] = row_index;
+    }
+  }
+  for (size_t row_index = lsm->nb_flushed; row_index < table->nb_rows;
+       row_index++) {
+    cursor->rows[cursor->nb_rows++] = row_index;
+  }
+  if (!is_narrowed) {
+    free(cursor->rows);
+    cursor->rows = NULL;
+    cursor->nb_rows = table->nb_rows;
+  }
+  return is_narrowed;
+}
+
+row_cursor open_row_cursor(table_data* table, ast_node* condition) {
+  bind_dictionary_codes(table, condition);
+  row_cursor cursor;
+  cursor.table = table;
+  cursor.condition = condition;
+  cursor.position = 0;
+  cursor.nb_rows = table->nb_rows;
+  cursor.rows = NULL;
+
+  if (table->is_clustered) {
+    cluster_table(table);
+    sorted_run sorted = get_sorted_rows(table);
+    if (narrow_sorted_range(table, &sorted, condition, &cursor.position,
+                            &cursor.nb_rows)) {
+      return cursor;
+    }
+  }
+  if (table->lsm != NULL && collect_run_rows(&cursor)) {
+    return cursor;
+  }
+  indexed_comparison comparison;
+  if (find_indexed_comparison(table, condition, true, &comparison) ||
+      find_indexed_comparison(table, condition, false, &comparison)) {
+    collect_indexed_rows(&cursor, &comparison, table->nb_rows);
+  }
+  return cursor;
+}
+
+// Next row which isn't deleted. A scan skips the pages whose zones don't
+// match the condition.
+bool next_row(row_cursor* cursor, size_t* row_index) {
+  table_data* table = cursor->table;
+  while (cursor->position < cursor->nb_rows) {
+    if (cursor->rows == NULL &&
+        cursor->position % table->rows_per_page == 0 &&
+        !may_match_page(table, cursor->position / table->rows_per_page,
+                        cursor->condition)) {
+      cursor->position += table->rows_per_page;
+      continue;
+    }
+    *row_index = (cursor->rows == NULL) ? cursor->position
+                                        : cursor->rows[cursor->position];
+    cursor->position++;
+    if (!is_row_dead(cursor->table, *row_index)) {
+      return true;
+    }
+  }
+  return false;
+}
 
-        for (size_t i = 0; i < nb_attr; i++) {
-          if (strcmp(values[i]->colname, colname) == 0) {
-            value = values[i];
-            if (DEBUG) {
-              printf("table value %s\n", value->s);
-            }
-            break;
-          }
-        }
-        if (value == NULL) {
-          runtime_error("Couldn't find the colname %s in the table", colname);
-          *error = true;
-          return false;
-        }
-        if (strncmp(condition->value, "=", 1) == 0) {
-          return strcmp(value->s, literal_string_value) == 0;
-        } else {
-          runtime_error("invalid comparison between strings %s",
-                        condition->value);
-          *error = true;
-          return false;
-        }
-        break;
-      default:
-        runtime_error("Invalid node kind for a comparison value");
-        *error = true;
-        return false;
-        break;
+void close_row_cursor(row_cursor* cursor) {
+  free(cursor->rows);
+  cursor->rows = NULL;
+}
+
+// The live rows of a full scan are read from the bitmap of the dead rows,
+// without a test per row.
+bool next_scanned_batch(row_cursor* cursor, row_batch* batch) {
+  table_data* table = cursor->table;
+  size_t rows_per_page = table->rows_per_page;
+  while (cursor->position < cursor->nb_rows) {
+    size_t first = cursor->position;
+    size_t index_page = first / rows_per_page;
+    if (first % rows_per_page == 0 &&
+        !may_match_page(table, index_page, cursor->condition)) {
+      cursor->position += rows_per_page;
+      continue;
+    }
+    size_t last = (index_page + 1) * rows_per_page;
+    if (last > cursor->nb_rows) {
+      last = cursor->nb_rows;
+    }
+    if (last > first + BATCH_ROWS) {
+      last = first + BATCH_ROWS;
+    }
+    cursor->position = last;
+    for (size_t row_index = first; row_index < last; row_index++) {
+      batch->rows[batch->nb_rows] = row_index;
+      batch->nb_rows += !is_row_dead(table, row_index);
     }
+    if (batch->nb_rows > 0) {
+      batch->index_page = index_page;
+      batch->page = pin_row(table, first);
+      return true;
+    }
+  }
+  return false;
+}
 
-  } else if (is_node_and(condition)) {
-    return run_where(condition->left, nb_attr, values, error) &&
-           run_where(condition->right, nb_attr, values, error);
-  } else if (is_node_or(condition)) {
-    return run_where(condition->left, nb_attr, values, error) ||
-           run_where(condition->right, nb_attr, values, error);
-  } else {
-    runtime_error("Expected a condition node");
+// The next rows of a cursor which are in the same page, their page is
+// pinned. false once the cursor is exhausted.
+bool next_batch(row_cursor* cursor, row_batch* batch) {
+  table_data* table = cursor->table;
+  batch->nb_rows = 0;
+  if (cursor->rows == NULL) {
+    return next_scanned_batch(cursor, batch);
+  }
+  size_t position = cursor->position;
+  size_t row_index;
+  while (batch->nb_rows < BATCH_ROWS && next_row(cursor, &row_index)) {
+    size_t index_page = row_index / table->rows_per_page;
+    if (batch->nb_rows > 0 && index_page != batch->index_page) {
+      // the row starts the next batch
+      cursor->position = position;
+      break;
+    }
+    batch->index_page = index_page;
+    batch->rows[batch->nb_rows++] = row_index;
+    position = cursor->position;
+  }
+  if (batch->nb_rows == 0) {
     return false;
   }
+  batch->page = pin_row(table, batch->rows[0]);
   return true;
 }
 
-bool keep_row(table_data* table,
-              ast_node* right,
-              size_t row_index,
-              bool* error) {
-  // no where condition, all rows should be kept
-  if (right == NULL) {
-    return true;
-  }
-  if (right->left == NULL || right->left->kind != CONDITION) {
-    runtime_error("Expected a where condition");
-    return false;
+void unpin_batch(table_data* table, row_batch* batch) {
+  unpin_row(table, batch->index_page * table->rows_per_page, false);
+}
+
+// condition tree below the CONDITION node of a where clause
+ast_node* get_where_condition(ast_node* where_parent) {
+  if (where_parent == NULL || where_parent->left == NULL ||
+      where_parent->left->kind != CONDITION) {
+    return NULL;
   }
-  size_t nb_attr = table->schema->nb_attr;
-  extracted_value** values = get_row_values(table, row_index, nb_attr);
-  return run_where(right->left->left, nb_attr, values, error);
+  return where_parent->left->left;
 }
 
-bool execute_select_from_table(table_data** tables,
-                               size_t nb_tables,
-                               ast_node* root) {
+bool execute_select_from_table(catalog* database, ast_node* root) {
   if (DEBUG) {
     print_ast(root);
   }
@@ -733,7 +3190,7 @@ bool execute_select_from_table(table_data** tables,
   }
   char* tablename = n_tablename->value;
 
-  table_data* table = find_table_from_name(tables, tablename, nb_tables);
+  table_data* table = find_table_from_name(database, tablename);
   if (DEBUG) {
     print_table(table);
   }
@@ -757,14 +3214,8 @@ bool execute_select_from_table(table_data** tables,
     // copy all column names
     for (size_t index_col = 0; index_col < table->schema->nb_attr;
          index_col++) {
-      // TODO DRY refactor with other branch
-      char* colname = table->schema->descs[index_col]->name;
-      size_t len_colname = strlen(colname);
       projection_colnames[nb_projection] =
-          (char*)malloc(sizeof(char) * (len_colname + 1));
-      assert(projection_colnames[nb_projection] != NULL);
-      strncpy(projection_colnames[nb_projection], colname, len_colname);
-      projection_colnames[nb_projection][len_colname] = '\0';
+          table->schema->descs[index_col]->name;
       nb_projection++;
     }
   } else {
@@ -777,46 +3228,49 @@ bool execute_select_from_table(table_data** tables,
         runtime_error("Expected a COLNAME got %s", col->value);
         return false;
       }
-      size_t colname_len = strlen(col->value);
-      projection_colnames[nb_projection] =
-          (char*)malloc(sizeof(char) * (colname_len + 1));
-      assert(projection_colnames[nb_projection] != NULL);
-      strncpy(projection_colnames[nb_projection], col->value, colname_len);
-      projection_colnames[nb_projection][colname_len] = '\0';
+      projection_colnames[nb_projection] = col->value;
       col = col->left;
     }
   }
 
-  // search in the schema for sizes, offsets & kinds
+  // search in the schema for sizes, columns & kinds
 
-  size_t offsets[nb_projection];
+  size_t columns[nb_projection];
   size_t sizes[nb_projection];
   attr_kind kinds[nb_projection];
 
   for (size_t i = 0; i < nb_projection; i++) {
     char* colname = projection_colnames[i];
-    size_t offset = 0;
     bool found = false;
     for (size_t j = 0; j < table->schema->nb_attr; j++) {
       if (strcmp(colname, table->schema->descs[j]->name) == 0) {
         sizes[i] = table->schema->descs[j]->size;
         kinds[i] = table->schema->descs[j]->desc;
+        columns[i] = j;
         found = true;
         break;
       }
-      offset += table->schema->descs[j]->size;
     }
     if (!found) {
       runtime_error("Couldn't find COLNAME %s in table %s", colname, tablename);
       return false;
     }
-    offsets[i] = offset;
   }
 
   if (DEBUG) {
     for (size_t i = 0; i < nb_projection; i++) {
-      printf("column %s, size %ld, offset %ld, kind %d\n",
-             projection_colnames[i], sizes[i], offsets[i], kinds[i]);
+      printf("column %s, size %ld, index %ld, kind %d\n",
+             projection_colnames[i], sizes[i], columns[i], kinds[i]);
+    }
+  }
+
+  // the condition is compiled once, before the first row
+  ast_node* condition = get_where_condition(root->right);
+  where_program* program = NULL;
+  if (condition != NULL) {
+    program = compile_where(table, condition);
+    if (program == NULL) {
+      return false;
     }
   }
 
@@ -835,46 +3289,41 @@ bool execute_select_from_table(table_data** tables,
   }
   printf("+\n");
 
-  // print the values
-  bool* error = (bool*)malloc(sizeof(bool));
-  assert(error != NULL);
-  *error = false;
-  for (size_t row_index = 0; row_index < table->nb_rows; row_index++) {
-    // WHERE CONDITION
-    if (*error) {
-      break;
-    }
-    if (!keep_row(table, root->right, row_index, error)) {
-      continue;
-    }
-    if (*error) {
-      break;
-    }
-    printf("|");
-    for (size_t col_index = 0; col_index < nb_projection; col_index++) {
-      void* read_value = (void*)malloc(sizes[col_index]);
-      assert(read_value != NULL);
-      /* printf("offset : %ld, size read: %ld\n", */
-      /*        line_index * table->row_size + offsets[col_index], */
-      /*        sizes[col_index]); */
-      memcpy(read_value,
-             (char*)table->values + row_index * table->row_size +
-                 offsets[col_index],
-             sizes[col_index]);
-      switch (kinds[col_index]) {
-        case D_INT:
-          printf("  %8ld    |", *(long*)read_value);
-          break;
-        case D_FLT:
-          printf("  %8.3f    |", *(double*)read_value);
-          break;
-        case D_CHR:
-          printf("  %8s    |", (char*)read_value);
-          break;
+  // print the values, a batch of rows at a time
+  row_cursor cursor = open_row_cursor(table, condition);
+  row_batch batch;
+  while (next_batch(&cursor, &batch)) {
+    filter_batch(program, table, &batch);
+    char* row = batch.page;
+    for (size_t i = 0; i < batch.nb_rows; i++) {
+      size_t row_index = batch.rows[i];
+      printf("|");
+      for (size_t col_index = 0; col_index < nb_projection; col_index++) {
+        // the values are printed from where they're stored
+        size_t length;
+        const char* bytes;
+        switch (kinds[col_index]) {
+          case D_INT:
+            printf("  %8ld    |",
+                   get_int(table, row, row_index, columns[col_index]));
+            break;
+          case D_FLT:
+            printf("  %8.3f    |",
+                   get_float(table, row, row_index, columns[col_index]));
+            break;
+          case D_CHR:
+          case D_DICT:
+            bytes = get_string(table, row, row_index, columns[col_index],
+                               &length);
+            printf("  %8.*s    |", (int)length, bytes);
+            break;
+        }
       }
+      printf("\n");
     }
-    printf("\n");
+    unpin_batch(table, &batch);
   }
+  close_row_cursor(&cursor);
   for (size_t i = 0; i < nb_projection; i++) {
     printf("+--------------");
   }
@@ -883,11 +3332,11 @@ bool execute_select_from_table(table_data** tables,
   return true;
 }
 
-bool execute_drop_table(table_data** tables, ast_node* root, size_t nb_tables) {
+bool execute_drop_table(catalog* database, ast_node* root) {
   if (DEBUG) {
     print_ast(root);
   }
-  if (nb_tables == 0) {
+  if (database->nb_tables == 0) {
     runtime_error("No table to drop");
     return false;
   }
@@ -902,52 +3351,227 @@ bool execute_drop_table(table_data** tables, ast_node* root, size_t nb_tables) {
   }
   char* tablename = n_tablename->value;
 
-  table_data* table = NULL;
-  size_t i = 0;
+  size_t position;
+  if (!find_table_position(database, tablename, &position)) {
+    runtime_error("Can't find table %s", tablename);
+    return false;
+  }
+  table_data* table = remove_table(database, position);
+  if (table == NULL) {
+    return true;
+  }
+  if (DEBUG) {
+    printf("DROP TABLE. Found table %s index %ld\n", tablename, position);
+    print_table(table);
+  }
+  destroy_table(table);
+  free(table);
+  return true;
+}
 
-  // Find the index of the table -- can't use find by name which doesn't return
-  // an index
-  for (; i < nb_tables; i++) {
-    if (tables[i] == NULL) {
-      continue;
+// table of an index and its position in the table, NULL if it doesn't exist
+table_data* find_index_from_name(catalog* database,
+                                 char* name,
+                                 size_t* position) {
+  for (size_t i = 0; i < database->nb_tables; i++) {
+    // a table of the file is read if it has the index
+    table_place* place = database->places[i];
+    for (size_t j = 0; place != NULL && j < place->nb_indexes; j++) {
+      if (strcmp(place->index_names[j], name) == 0) {
+        load_table(database, i);
+        break;
+      }
     }
-    if (strncmp(tables[i]->schema->name, tablename, strlen(tablename)) == 0) {
-      table = tables[i];
-      break;
+    table_data* table = database->tables[i];
+    for (size_t j = 0; table != NULL && j < table->nb_indexes; j++) {
+      if (strcmp(table->indexes[j]->name, name) == 0) {
+        *position = j;
+        return table;
+      }
     }
   }
+  return NULL;
+}
 
+bool execute_create_index(catalog* database, ast_node* root) {
+  char* name = root->left->value;
+  char* tablename = root->right->value;
+  char* colname = root->right->left->value;
+  ast_node* using = root->left->right;  // USING BTREE | HASH | BLOOM
+  index_kind kind = I_BTREE;
+  if (using != NULL && strcasecmp(using->right->value, "HASH") == 0) {
+    kind = I_HASH;
+  } else if (using != NULL && strcasecmp(using->right->value, "BLOOM") == 0) {
+    kind = I_BLOOM;
+  }
+  size_t position;
+  if (find_index_from_name(database, name, &position) != NULL) {
+    runtime_error("Index %s already exists", name);
+    return false;
+  }
+  table_data* table = find_table_from_name(database, tablename);
   if (table == NULL) {
-    runtime_error("Can't find table %s", tablename);
+    runtime_error("Unknown table %s", tablename);
     return false;
   }
-  if (DEBUG) {
-    printf("DROP TABLE. Found table %s index %ld\n", tablename, i);
-    print_table(table);
+  size_t column = 0;
+  while (column < table->schema->nb_attr &&
+         strcmp(table->schema->descs[column]->name, colname) != 0) {
+    column++;
   }
-  if (nb_tables > 1) {
-    for (size_t j = i; j <= nb_tables - 2; j++) {
-      if (tables[j + 1] != NULL) {
-        if (DEBUG) {
-          printf("moving into %ld from %ld\n", j, j + 1);
-        }
-        memmove(tables[j], tables[j + 1], sizeof(&tables[j + 1]));
-        tables[j]->nb_rows = tables[j + 1]->nb_rows;
-        tables[j]->capacity = tables[j + 1]->capacity;
-        tables[j]->row_size = tables[j + 1]->row_size;
-        memmove(tables[j]->schema, tables[j + 1]->schema,
-                sizeof(&(tables[j + 1]->schema)));
-        memmove(tables[j]->values, tables[j + 1]->values,
-                tables[j + 1]->row_size * tables[j + 1]->capacity);
+  if (column == table->schema->nb_attr) {
+    runtime_error("Couldn't find COLNAME %s in table %s", colname, tablename);
+    return false;
+  }
+
+  table_index* index = (table_index*)malloc(sizeof(table_index));
+  assert(index != NULL);
+  index->name = (char*)malloc(sizeof(char) * (strlen(name) + 1));
+  assert(index->name != NULL);
+  strcpy(index->name, name);
+  index->column = column;
+  index->kind = kind;
+  index->tree = NULL;
+  index->hash = NULL;
+  index->filters = NULL;
+  if (kind == I_HASH) {
+    index->hash = build_column_hash(table, column);
+  } else if (kind == I_BLOOM) {
+    index->filters = bloom_create(table->rows_per_page);
+    fill_column_bloom(table, index->filters, column);
+  } else {
+    index->tree = build_column_index(table, column);
+  }
+  table->indexes = (table_index**)realloc(
+      table->indexes, sizeof(table_index*) * (table->nb_indexes + 1));
+  assert(table->indexes != NULL);
+  table->indexes[table->nb_indexes++] = index;
+  mark_modified(table);
+  return true;
+}
+
+bool execute_drop_index(catalog* database, ast_node* root) {
+  char* name = root->left->value;
+  size_t position;
+  table_data* table = find_index_from_name(database, name, &position);
+  if (table == NULL) {
+    runtime_error("Unknown index %s", name);
+    return false;
+  }
+  table_index* index = table->indexes[position];
+  free(index->name);
+  btree_destroy(index->tree);
+  hash_destroy(index->hash);
+  bloom_destroy(index->filters);
+  free(index);
+  for (size_t i = position; i + 1 < table->nb_indexes; i++) {
+    table->indexes[i] = table->indexes[i + 1];
+  }
+  table->nb_indexes--;
+  mark_modified(table);
+  return true;
+}
+
+// Copy the strings of the rows into a new heap, without the garbage. The
+// rows aren't moved. A deleted row keeps its primary key, sorted rows are
+// still compared to it until they're compacted, its other strings become
+// empty.
+void pack_heap(table_data* table) {
+  if (table->heap_garbage == 0) {
+    return;
+  }
+  mark_modified(table);
+  char* old_heap = table->heap;
+  table->heap = NULL;
+  table->heap_size = 0;
+  table->heap_capacity = 0;
+  table->heap_garbage = 0;
+  for (size_t row_index = 0; row_index < table->nb_rows; row_index++) {
+    bool is_dead = is_row_dead(table, row_index);
+    char* page = pin_row(table, row_index);
+    bool is_moved = false;
+    for (size_t col_index = 0; col_index < table->schema->nb_attr;
+         col_index++) {
+      if (!is_out_of_line(table->schema->descs[col_index])) {
+        continue;
+      }
+      char* field = get_field(table, page, row_index, col_index);
+      varchar_ref ref;
+      memcpy(&ref, field, sizeof(varchar_ref));
+      if (ref.length <= VARCHAR_INLINE) {
+        continue;
+      }
+      if (is_dead && col_index != 0) {
+        memset(field, 0, sizeof(varchar_ref));
+        is_moved = true;
+        continue;
+      }
+      ref.offset = append_to_heap(table, old_heap + ref.offset, ref.length);
+      memcpy(field, &ref, sizeof(varchar_ref));
+      is_moved = true;
+    }
+    unpin_row(table, row_index, is_moved);
+  }
+  free(old_heap);
+}
+
+// Remove the deleted rows in one pass, the others are moved to the first
+// free slot, keeping their order. The heap loses its garbage.
+void compact_table(table_data* table) {
+  if (table->nb_dead == 0) {
+    pack_heap(table);
+    return;
+  }
+  shrink_runs(table);
+  size_t destination = 0;
+  while (!is_row_dead(table, destination)) {
+    destination++;
+  }
+  size_t nb_sorted = table->nb_sorted < destination ? table->nb_sorted
+                                                      : destination;
+  for (size_t row_index = destination + 1; row_index < table->nb_rows;
+       row_index++) {
+    if (!is_row_dead(table, row_index)) {
+      copy_row(table, row_index, destination);
+      destination++;
+      // the order is kept, the sorted rows stay first
+      if (row_index < table->nb_sorted) {
+        nb_sorted = destination;
+      }
+    }
+  }
+  table->nb_rows = destination;
+  table->nb_sorted = nb_sorted;
+  forget_appended(table);
+  clear_dead_rows(table);
+  truncate_pages(table);
+  rebuild_zones(table);
+  pack_heap(table);
+  // rows were moved, their index changed
+  drop_index_trees(table);
+}
+
+// Compact a table, or every table.
+bool execute_vacuum(catalog* database, ast_node* root) {
+  if (root->left == NULL) {
+    // the tables which aren't read were compacted by their save
+    for (size_t i = 0; i < database->nb_tables; i++) {
+      if (database->tables[i] != NULL) {
+        compact_table(database->tables[i]);
       }
     }
+    return true;
   }
+  table_data* table = find_table_from_name(database, root->left->value);
+  if (table == NULL) {
+    runtime_error("Unknown table %s", root->left->value);
+    return false;
+  }
+  compact_table(table);
   return true;
 }
 
-bool execute_delete_from_table(table_data** tables,
-                               size_t nb_tables,
-                               ast_node* root) {
+bool execute_delete_from_table(catalog* database, ast_node* root) {
   if (DEBUG) {
     print_ast(root);
   }
@@ -962,12 +3586,12 @@ bool execute_delete_from_table(table_data** tables,
   }
   char* tablename = n_tablename->value;
 
-  table_data* table = find_table_from_name(tables, tablename, nb_tables);
+  table_data* table = find_table_from_name(database, tablename);
   if (table == NULL) {
     runtime_error("Unknown table %s", tablename);
     return false;
   }
-  if (table->nb_rows == 0) {
+  if (count_live_rows(table) == 0) {
     runtime_error("Table %s is empty", tablename);
     return false;
   }
@@ -977,6 +3601,16 @@ bool execute_delete_from_table(table_data** tables,
   // when no where clause, clear the table completely
   if (where == NULL) {
     table->nb_rows = 0;
+    table->nb_sorted = 0;
+    forget_appended(table);
+    if (table->lsm != NULL) {
+      clear_lsm(table->lsm);
+    }
+    clear_dead_rows(table);
+    truncate_pages(table);
+    drop_index_trees(table);
+    table->heap_size = 0;
+    table->heap_garbage = 0;
     return true;
   }
   ast_node* condition = where->left;
@@ -985,43 +3619,81 @@ bool execute_delete_from_table(table_data** tables,
     return false;
   }
 
-  bool* error = (bool*)malloc(sizeof(bool));
-  *error = false;
+  where_program* program = compile_where(table, condition);
+  if (program == NULL) {
+    return false;
+  }
 
-  // find row to delete
-  size_t nb_rows = table->nb_rows;
-  size_t nb_attr = table->schema->nb_attr;
-  for (size_t row_index = table->nb_rows - 1;; row_index--) {
-    extracted_value** value = get_row_values(table, row_index, nb_attr);
-    if (run_where(condition, nb_attr, value, error)) {
-      if (*error) {
-        runtime_error("Error while exploring the condition");
-        return false;
-      }
+  // the deleted rows are only marked, they're removed from the indexes
+  row_cursor cursor = open_row_cursor(table, condition);
+  row_batch batch;
+  while (next_batch(&cursor, &batch)) {
+    filter_batch(program, table, &batch);
+    for (size_t i = 0; i < batch.nb_rows; i++) {
+      size_t row_index = batch.rows[i];
       if (DEBUG) {
         printf("found row to delete %ld\n", row_index);
       }
-      // move every row after j to j
-      memmove((char*)table->values + table->row_size * row_index,
-              (char*)table->values + table->row_size * (row_index + 1),
-              table->row_size * (table->nb_rows - row_index + 1));
-      nb_rows -= 1;
-      if (nb_rows == 0) {
-        break;
+      char* page = batch.page;
+      char buffer[table->schema->descs[0]->size];
+      char* pk = get_index_key(table, page, row_index, 0, buffer);
+      if (table->pk_index != NULL) {
+        btree_remove(table->pk_index, pk, row_index);
       }
+      if (table->lsm != NULL && row_index >= table->lsm->nb_flushed) {
+        skiplist_remove(get_memtable(table), pk, row_index);
+      }
+      if (table->is_clustered && row_index >= table->nb_sorted) {
+        skiplist_remove(get_appended(table), pk, row_index);
+      }
+      update_secondary_indexes(table, page, row_index, NULL, 0, false);
+      forget_row_strings(table, page, row_index, NULL,
+                         table->schema->nb_attr);
+      set_row_dead(table, row_index);
     }
-    if (row_index == 0) {
-      break;
-    }
-    table->nb_rows = nb_rows;
+    unpin_batch(table, &batch);
+  }
+  close_row_cursor(&cursor);
+
+  if (table->nb_dead * 100 > table->nb_rows * COMPACTION_PERCENT) {
+    compact_table(table);
   }
 
   return true;
 }
 
-bool execute_update_table(table_data** tables,
-                          size_t nb_tables,
-                          ast_node* root) {
+// An UPDATE of the primary key gives the same key to every row it matches.
+// It's refused before any row is written when it matches two rows, or a row
+// which doesn't own the key: a failed UPDATE changes nothing, like the log
+// which doesn't record it.
+bool is_pk_update_unique(table_data* table,
+                         ast_node* condition,
+                         where_program* program,
+                         const char* pk_key) {
+  row_cursor cursor = open_row_cursor(table, condition);
+  row_batch batch;
+  size_t nb_matched = 0;
+  size_t matched = 0;
+  while (nb_matched < 2 && next_batch(&cursor, &batch)) {
+    filter_batch(program, table, &batch);
+    if (nb_matched == 0 && batch.nb_rows > 0) {
+      matched = batch.rows[0];
+    }
+    nb_matched += batch.nb_rows;
+    unpin_batch(table, &batch);
+  }
+  close_row_cursor(&cursor);
+  size_t owner;
+  if (nb_matched > 1 || (nb_matched == 1 &&
+                         find_pk_owner(table, pk_key, &owner) &&
+                         owner != matched)) {
+    runtime_error("Primary key must be unique");
+    return false;
+  }
+  return true;
+}
+
+bool execute_update_table(catalog* database, ast_node* root) {
   if (DEBUG) {
     print_ast(root);
   }
@@ -1037,7 +3709,7 @@ bool execute_update_table(table_data** tables,
   }
   char* tablename = n_tablename->value;
 
-  table_data* table = find_table_from_name(tables, tablename, nb_tables);
+  table_data* table = find_table_from_name(database, tablename);
   if (DEBUG) {
     print_table(table);
   }
@@ -1062,21 +3734,9 @@ bool execute_update_table(table_data** tables,
     if (col == NULL || col->right == NULL) {
       break;
     }
-    size_t colname_len = strlen(col->value);
-    set_colnames[nb_set] = (char*)malloc(sizeof(char) * (colname_len + 1));
-    assert(set_colnames[nb_set] != NULL);
-    strncpy(set_colnames[nb_set], col->value, colname_len);
-    set_colnames[nb_set][colname_len] = '\0';
-
-    size_t value_len = strlen(col->right->value);
-    set_values[nb_set] = (ast_node*)malloc(sizeof(ast_node));
-    assert(set_values[nb_set] != NULL);
-    set_values[nb_set]->kind = col->right->kind;
-    set_values[nb_set]->f_value = col->right->f_value;
-    set_values[nb_set]->i_value = col->right->i_value;
-    set_values[nb_set]->value = (char*)malloc(sizeof(char) * (value_len + 1));
-    assert(set_values[nb_set]->value != NULL);
-    strcpy(set_values[nb_set]->value, col->right->value);
+    // the tree lives until the end of the statement
+    set_colnames[nb_set] = col->value;
+    set_values[nb_set] = col->right;
     if (DEBUG) {
       printf("update got:\n");
       print_ast(set_values[nb_set]);
@@ -1085,111 +3745,229 @@ bool execute_update_table(table_data** tables,
     col = col->left;
   }
 
-  // search in the schema for sizes, offsets & kinds
+  // search in the schema for sizes, columns & kinds
 
-  size_t offsets[nb_set];
+  size_t columns[nb_set];
   size_t sizes[nb_set];
   attr_kind kinds[nb_set];
+  ast_node* pk_value = NULL;
 
   for (size_t i = 0; i < nb_set; i++) {
     char* colname = set_colnames[i];
-    size_t offset = 0;
+    bool found = false;
     for (size_t j = 0; j < table->schema->nb_attr; j++) {
       if (strcmp(colname, table->schema->descs[j]->name) == 0) {
         sizes[i] = table->schema->descs[j]->size;
         kinds[i] = table->schema->descs[j]->desc;
+        columns[i] = j;
+        if (j == 0) {
+          pk_value = set_values[i];
+        }
+        found = true;
         break;
       }
-      offset += table->schema->descs[j]->size;
     }
-    offsets[i] = offset;
+    if (!found) {
+      runtime_error("Couldn't find COLNAME %s in table %s", colname, tablename);
+      return false;
+    }
+    // refused before any row is written, like a duplicated primary key
+    if (!accepts_literal(table->schema->descs[columns[i]], set_values[i])) {
+      return false;
+    }
   }
 
   if (DEBUG) {
     for (size_t i = 0; i < nb_set; i++) {
-      printf("column %s, size %ld, offset %ld, kind %d\n", set_colnames[i],
-             sizes[i], offsets[i], kinds[i]);
+      printf("column %s, size %ld, index %ld, kind %d\n", set_colnames[i],
+             sizes[i], columns[i], kinds[i]);
     }
   }
+  if (pk_value != NULL && strlen(pk_value->value) == 0) {
+    runtime_error("Primary key can't be null");
+    return false;
+  }
+  size_t pk_size = table->schema->descs[0]->size;
+  char pk_key[pk_size];
+  if (pk_value != NULL && !write_literal(pk_key, pk_value, pk_size)) {
+    return false;
+  }
 
-  // set the new values
-  bool* error = (bool*)malloc(sizeof(bool));
-  assert(error != NULL);
-  *error = false;
-  for (size_t row_index = 0; row_index < table->nb_rows; row_index++) {
-    // WHERE CONDITION
-    if (*error) {
-      break;
-    }
-    if (!keep_row(table, root->right, row_index, error)) {
-      continue;
-    }
-    if (*error) {
-      break;
+  ast_node* condition = get_where_condition(root->right);
+  where_program* program = NULL;
+  if (condition != NULL) {
+    program = compile_where(table, condition);
+    if (program == NULL) {
+      return false;
     }
-    size_t row_offset = table->row_size * row_index;
-    for (size_t col_index = 0; col_index < nb_set; col_index++) {
-      // enforce unicity of Primary key
-      ast_node* set_value = set_values[col_index];
+  }
 
-      if (col_index == 0) {
-        if (strlen(set_value->value) == 0) {
-          runtime_error("Primary key can't be null");
-          return false;
-        }
-        for (size_t row_index = 0; row_index < table->nb_rows; row_index++) {
-          extracted_value** values =
-              get_row_values(table, row_index, table->schema->nb_attr);
-          if (compare_extracted_value(*values, set_value)) {
-            runtime_error("Primary key must be unique");
-            return false;
-          }
-        }
-      }
+  // enforce unicity of Primary key
+  if (pk_value != NULL &&
+      !is_pk_update_unique(table, condition, program, pk_key)) {
+    return false;
+  }
 
-      void* data;
-      switch (set_value->kind) {
-        case INT:
-          data = (void*)&set_value->i_value;
-          break;
-        case FLOAT:
-          data = (void*)&set_value->f_value;
-          break;
-        case STRING:
-          data = (void*)set_value->value;
-          if (DEBUG) {
-            printf("string data in buffer %s - %s\n", (char*)data,
-                   set_value->value);
-          }
-          break;
-        default:
-          runtime_error("Unknown value kind");
-          return false;
+  // set the new values
+  row_cursor cursor = open_row_cursor(table, condition);
+  row_batch batch;
+  while (next_batch(&cursor, &batch)) {
+    filter_batch(program, table, &batch);
+    for (size_t i = 0; i < batch.nb_rows; i++) {
+      size_t row_index = batch.rows[i];
+      char* row = pin_row(table, row_index);
+      char old_pk[pk_size];
+      if (pk_value != NULL) {
+        char buffer[pk_size];
+        memcpy(old_pk, get_index_key(table, row, row_index, 0, buffer),
+               pk_size);
+      }
+      if (pk_value != NULL && table->pk_index != NULL) {
+        btree_remove(table->pk_index, old_pk, row_index);
+      }
+      update_secondary_indexes(table, row, row_index, columns, nb_set,
+                               false);
+      forget_row_strings(table, row, row_index, columns, nb_set);
+      for (size_t col_index = 0; col_index < nb_set; col_index++) {
+        write_field(table, row, row_index, columns[col_index],
+                    set_values[col_index]);
+      }
+      if (pk_value != NULL && table->pk_index != NULL) {
+        btree_insert(table->pk_index, pk_key, row_index);
+      }
+      update_secondary_indexes(table, row, row_index, columns, nb_set, true);
+      unpin_row(table, row_index, true);
+      if (pk_value != NULL) {
+        move_updated_pk(table, row_index, old_pk, pk_key);
       }
-
-      size_t data_size = table->schema->descs[col_index]->size;
-      memcpy((char*)table->values + row_offset + offsets[col_index], data,
-             data_size);
     }
+    unpin_batch(table, &batch);
+  }
+  close_row_cursor(&cursor);
+  // the moved keys are put back in order
+  cluster_table(table);
+  sort_runs(table);
+  if (table->heap_garbage * 2 > table->heap_size) {
+    pack_heap(table);
   }
 
   return true;
 }
 
-static table_data** tables;
-static size_t nb_tables;
+static catalog database;
+
+// Successful INSERT, UPDATE, DELETE, CREATE and DROP requests, of tables and
+// indexes, are logged in
+// <database>-wal, the database being the file of the last .open or .save.
+// The log is replayed by .open and emptied by .save.
+static wal* request_log;
+static bool is_replaying;
+static size_t log_interval_ms = WAL_DEFAULT_INTERVAL_MS;
+static size_t log_bytes = WAL_DEFAULT_BYTES;
 bool execute(char* request);
+bool execute_request(char* request);
+
+bool replay_request(char* request) {
+  is_replaying = true;
+  bool success = execute_request(request);
+  is_replaying = false;
+  return success;
+}
+
+// database of the log
+static char* logged_path;
+
+void open_request_log(char* filename, bool replay) {
+  wal_close(request_log);
+  free(logged_path);
+  logged_path = (char*)malloc(sizeof(char) * (strlen(filename) + 1));
+  assert(logged_path != NULL);
+  strcpy(logged_path, filename);
+  char path[strlen(filename) + 5];
+  snprintf(path, sizeof(path), "%s-wal", filename);
+  request_log = wal_open(path, replay ? replay_request : NULL);
+  if (request_log != NULL) {
+    wal_set_group_commit(request_log, log_interval_ms, log_bytes);
+  }
+}
+
+void close_request_log(void) {
+  wal_close(request_log);
+  request_log = NULL;
+  free(logged_path);
+  logged_path = NULL;
+}
+
+void log_request(char* request) {
+  if (request_log != NULL && !is_replaying) {
+    wal_append(request_log, request, strlen(request));
+  }
+}
+
+// The files hold fixed width little endian integers, whatever the host.
+void store_u32(unsigned char* bytes, uint32_t value) {
+  for (size_t i = 0; i < 4; i++) {
+    bytes[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+void store_u64(unsigned char* bytes, uint64_t value) {
+  for (size_t i = 0; i < 8; i++) {
+    bytes[i] = (unsigned char)(value >> (8 * i));
+  }
+}
+
+uint32_t load_u32(const unsigned char* bytes) {
+  uint32_t value = 0;
+  for (size_t i = 0; i < 4; i++) {
+    value |= (uint32_t)bytes[i] << (8 * i);
+  }
+  return value;
+}
+
+uint64_t load_u64(const unsigned char* bytes) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < 8; i++) {
+    value |= (uint64_t)bytes[i] << (8 * i);
+  }
+  return value;
+}
+
+void write_u32(FILE* save_file, uint32_t value) {
+  unsigned char bytes[4];
+  store_u32(bytes, value);
+  fwrite(bytes, sizeof(bytes), 1, save_file);
+}
+
+void write_u64(FILE* save_file, uint64_t value) {
+  unsigned char bytes[8];
+  store_u64(bytes, value);
+  fwrite(bytes, sizeof(bytes), 1, save_file);
+}
+
+// 0 past the end of the file
+uint32_t read_u32(FILE* save_file) {
+  unsigned char bytes[4] = {0};
+  fread(bytes, sizeof(bytes), 1, save_file);
+  return load_u32(bytes);
+}
+
+uint64_t read_u64(FILE* save_file) {
+  unsigned char bytes[8] = {0};
+  fread(bytes, sizeof(bytes), 1, save_file);
+  return load_u64(bytes);
+}
 
 void serialise_attr_desc_size(attr_desc_size* attr_desc, FILE* save_file) {
   size_t name_len = strlen(attr_desc->name) + 1;
   // 1. write the name len
-  fwrite(&name_len, sizeof(size_t), 1, save_file);
+  write_u64(save_file, name_len);
   // 2. write the name itself
   fwrite(attr_desc->name, name_len, 1, save_file);
   // 3. write down attr_kind
-  fwrite(&attr_desc->desc, sizeof(attr_kind), 1, save_file);
+  write_u32(save_file, (uint32_t)attr_desc->desc);
   // 4. write the size
-  fwrite(&attr_desc->size, sizeof(size_t), 1, save_file);
+  write_u64(save_file, attr_desc->size);
 }
 
 attr_desc_size* deserialise_attr_desc_size(FILE* save_file) {
@@ -1199,16 +3977,16 @@ attr_desc_size* deserialise_attr_desc_size(FILE* save_file) {
 
   assert(save_file != NULL);
   // 1. write the name len
-  fread(&name_len, sizeof(size_t), 1, save_file);
+  name_len = read_u64(save_file);
   // 2. read the name itself
   attr_desc->name = (char*)malloc(sizeof(char) * name_len);
   assert(attr_desc->name != NULL);
 
   fread(attr_desc->name, name_len, 1, save_file);
   // 3. read down attr_kind
-  fread(&attr_desc->desc, sizeof(attr_kind), 1, save_file);
+  attr_desc->desc = (attr_kind)read_u32(save_file);
   // 4. read the size
-  fread(&attr_desc->size, sizeof(size_t), 1, save_file);
+  attr_desc->size = read_u64(save_file);
 
   return attr_desc;
 }
@@ -1223,11 +4001,11 @@ void print_desc(attr_desc_size* desc) {
 void serialise_table_desc(table_desc* t_desc, FILE* save_file) {
   size_t name_len = strlen(t_desc->name) + 1;
   // 1. write the name len
-  fwrite(&name_len, sizeof(size_t), 1, save_file);
+  write_u64(save_file, name_len);
   // 2. write the name itself
   fwrite(t_desc->name, name_len, 1, save_file);
   // 3. write the number of attributes
-  fwrite(&t_desc->nb_attr, sizeof(size_t), 1, save_file);
+  write_u64(save_file, t_desc->nb_attr);
   // 4. write every attr_desc_size
   for (size_t index_attr = 0; index_attr < t_desc->nb_attr; index_attr++) {
     serialise_attr_desc_size(t_desc->descs[index_attr], save_file);
@@ -1240,13 +4018,13 @@ table_desc* deserialise_table_desc(FILE* save_file) {
 
   size_t name_len;
   // 1. write the name len
-  fread(&name_len, sizeof(size_t), 1, save_file);
+  name_len = read_u64(save_file);
   // 2. write the name itself
   t_desc->name = (char*)malloc(sizeof(char) * name_len);
   assert(t_desc->name != NULL);
   fread(t_desc->name, name_len, 1, save_file);
   // 3. write the number of attributes
-  fread(&t_desc->nb_attr, sizeof(size_t), 1, save_file);
+  t_desc->nb_attr = read_u64(save_file);
   // 4. write every attr_desc_size
   // Allocate space for descriptions
   t_desc->descs =
@@ -1256,24 +4034,377 @@ table_desc* deserialise_table_desc(FILE* save_file) {
   for (size_t index_attr = 0; index_attr < t_desc->nb_attr; index_attr++) {
     t_desc->descs[index_attr] = deserialise_attr_desc_size(save_file);
   }
-  return t_desc;
+  return t_desc;
+}
+
+// Pages of a database file taken by the last save, or by the one being
+// written, a bit per page. Page 0 is the header of the file.
+typedef struct FileSpace {
+  uint64_t* used;
+  size_t words;
+  size_t nb_pages;  // length of the file
+} file_space;
+
+void reset_file_space(file_space* space) {
+  if (space->words > 0) {
+    memset(space->used, 0, sizeof(uint64_t) * space->words);
+  }
+  space->nb_pages = 0;
+}
+
+bool is_file_page_used(file_space* space, size_t page) {
+  return page / 64 < space->words &&
+         (space->used[page / 64] & ((uint64_t)1 << (page % 64))) != 0;
+}
+
+void use_file_pages(file_space* space, size_t first, size_t count) {
+  size_t words = (first + count + 63) / 64;
+  if (words > space->words) {
+    space->used = (uint64_t*)realloc(space->used, sizeof(uint64_t) * words);
+    assert(space->used != NULL);
+    memset(space->used + space->words, 0,
+           sizeof(uint64_t) * (words - space->words));
+    space->words = words;
+  }
+  for (size_t page = first; page < first + count; page++) {
+    space->used[page / 64] |= (uint64_t)1 << (page % 64);
+  }
+  if (first + count > space->nb_pages) {
+    space->nb_pages = first + count;
+  }
+}
+
+// First run of count free pages, the file grows when there's none.
+size_t allocate_file_pages(file_space* space, size_t count) {
+  size_t first = 1;
+  size_t length = 0;
+  for (size_t page = 1; page < space->nb_pages && length < count; page++) {
+    if (is_file_page_used(space, page)) {
+      first = page + 1;
+      length = 0;
+    } else {
+      length++;
+    }
+  }
+  use_file_pages(space, first, count);
+  return first;
+}
+
+// Write bytes in free pages of the file, returns the first one.
+size_t write_file_pages(int fd, file_space* space, char* bytes, size_t length) {
+  size_t count = (length + PAGER_PAGE_SIZE - 1) / PAGER_PAGE_SIZE;
+  size_t first = allocate_file_pages(space, count > 0 ? count : 1);
+  ssize_t written =
+      pwrite(fd, bytes, length, (off_t)(first * PAGER_PAGE_SIZE));
+  assert(written == (ssize_t)length);
+  return first;
+}
+
+// The table will be written entirely by the next save.
+void forget_file_pages(table_data* table) {
+  for (size_t index_page = 0; index_page < table->nb_pages; index_page++) {
+    table->file_pages[index_page] = NO_FILE_PAGE;
+  }
+  mark_modified(table);
+}
+
+void write_zone_value(attr_kind kind, zone_value* value, FILE* save_file) {
+  uint64_t bits;
+  switch (kind) {
+    case D_INT:
+      write_u64(save_file, (uint64_t)value->i);
+      break;
+    case D_FLT:
+      memcpy(&bits, &value->f, sizeof(double));
+      write_u64(save_file, bits);
+      break;
+    case D_CHR:
+    case D_DICT:
+      fwrite(value->s, ZONE_PREFIX, 1, save_file);
+      break;
+  }
+}
+
+void read_zone_value_from(attr_kind kind, zone_value* value, FILE* save_file) {
+  uint64_t bits;
+  memset(value, 0, sizeof(zone_value));
+  switch (kind) {
+    case D_INT:
+      value->i = (long)read_u64(save_file);
+      break;
+    case D_FLT:
+      bits = read_u64(save_file);
+      memcpy(&value->f, &bits, sizeof(double));
+      break;
+    case D_CHR:
+    case D_DICT:
+      fread(value->s, ZONE_PREFIX, 1, save_file);
+      break;
+  }
+}
+
+// Write the pages modified since the last save in free pages of the file,
+// then the description of the table if it changed. The description ends with
+// the file page and the checksum of every page so they can be mapped. The
+// deleted rows are removed first. Returns the number of written pages.
+size_t serialise_table(table_data* table, int fd, file_space* space) {
+  compact_table(table);
+  size_t nb_written = 0;
+  for (size_t index_page = 0; index_page < table->nb_pages; index_page++) {
+    if (table->file_pages[index_page] != NO_FILE_PAGE) {
+      continue;
+    }
+    size_t page = table->pages[index_page];
+    char* bytes = (char*)pager_pin(get_buffer_pool(), page);
+    table->page_checksums[index_page] = crc32c(0, bytes, PAGER_PAGE_SIZE);
+    table->file_pages[index_page] =
+        write_file_pages(fd, space, bytes, PAGER_PAGE_SIZE);
+    pager_unpin(get_buffer_pool(), page, false);
+    nb_written++;
+  }
+  if (table->meta_page != NO_FILE_PAGE) {
+    return nb_written;
+  }
+  char* description;
+  size_t length;
+  FILE* save_file = open_memstream(&description, &length);
+  assert(save_file != NULL);
+  // 1. schema
+  serialise_table_desc(table->schema, save_file);
+  // 2. nb_rows
+  write_u64(save_file, table->nb_rows);
+  // 3. capacity
+  write_u64(save_file, table->capacity);
+  // 4. row_size
+  write_u64(save_file, table->row_size);
+  // 5. layout and order of the rows
+  write_u32(save_file, (uint32_t)table->layout);
+  write_u32(save_file, (uint32_t)table->is_clustered);
+  write_u64(save_file, table->nb_sorted);
+  write_u32(save_file, (uint32_t)(table->lsm != NULL));
+  if (table->lsm != NULL) {
+    write_u64(save_file, table->lsm->nb_flushed);
+    write_u64(save_file, table->lsm->nb_runs);
+    for (size_t i = 0; i < table->lsm->nb_runs; i++) {
+      write_u64(save_file, table->lsm->runs[i].first);
+      write_u64(save_file, table->lsm->runs[i].nb_rows);
+    }
+  }
+  // 6. indexes, their trees are rebuilt when they're used, the Bloom
+  //    filters are saved
+  write_u64(save_file, table->nb_indexes);
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    table_index* index = table->indexes[i];
+    size_t name_len = strlen(index->name) + 1;
+    write_u64(save_file, name_len);
+    fwrite(index->name, name_len, 1, save_file);
+    write_u64(save_file, index->column);
+    write_u32(save_file, (uint32_t)index->kind);
+    if (index->kind == I_BLOOM) {
+      write_u64(save_file, index->filters->blocks_per_filter);
+      write_u64(save_file, index->filters->nb_filters);
+      size_t nb_words = bloom_nb_words(index->filters);
+      for (size_t word = 0; word < nb_words; word++) {
+        write_u32(save_file, index->filters->words[word]);
+      }
+    }
+  }
+  // 7. heap of the long varchars
+  write_u64(save_file, table->heap_size);
+  if (table->heap_size > 0) {
+    fwrite(table->heap, table->heap_size, 1, save_file);
+  }
+  // 8. dictionaries, values in the order of their codes
+  for (size_t i = 0; i < table->schema->nb_attr; i++) {
+    dictionary* dict = table->dictionaries[i];
+    if (dict != NULL) {
+      write_u64(save_file, dict->nb_values);
+      fwrite(dict->values, dict->size, dict->nb_values, save_file);
+    }
+  }
+  // 9. nb_pages
+  write_u64(save_file, table->nb_pages);
+  // 10. file pages and their checksums
+  for (size_t index_page = 0; index_page < table->nb_pages; index_page++) {
+    write_u64(save_file, table->file_pages[index_page]);
+    write_u32(save_file, table->page_checksums[index_page]);
+  }
+  // 11. zones
+  for (size_t index_page = 0; index_page < table->nb_pages; index_page++) {
+    for (size_t i = 0; i < table->schema->nb_attr; i++) {
+      attr_kind kind = table->schema->descs[i]->desc;
+      zone* z = &table->zones[index_page * table->schema->nb_attr + i];
+      write_zone_value(kind, &z->min, save_file);
+      write_zone_value(kind, &z->max, save_file);
+    }
+  }
+  fclose(save_file);
+  table->meta_page = write_file_pages(fd, space, description, length);
+  table->meta_length = length;
+  table->meta_checksum = crc32c(0, description, length);
+  free(description);
+  return nb_written + (length + PAGER_PAGE_SIZE - 1) / PAGER_PAGE_SIZE;
 }
 
-void serialise_table(table_data* table, FILE* save_file) {
+// Read a description of a table. The pages aren't read, they're mapped from
+// the file fd and copied by the OS only when a row is modified. A page is
+// checked against its checksum when it's first used. The file can be closed
+// afterwards.
+table_data* deserialise_table(FILE* save_file, int fd) {
+  table_data* table = (table_data*)malloc(sizeof(table_data));
+  assert(table != NULL);
+
   // 1. schema
-  serialise_table_desc(table->schema, save_file);
+  table->schema = deserialise_table_desc(save_file);
   // 2. nb_rows
-  fwrite(&table->nb_rows, sizeof(size_t), 1, save_file);
+  table->nb_rows = read_u64(save_file);
   // 3. capacity
-  fwrite(&table->capacity, sizeof(size_t), 1, save_file);
+  size_t capacity = read_u64(save_file);
   // 4. row_size
-  fwrite(&table->row_size, sizeof(size_t), 1, save_file);
-  // 5. values
-  size_t total_size = table->row_size * table->nb_rows;
-  fwrite(table->values, total_size, 1, save_file);
+  size_t row_size = read_u64(save_file);
+  // 5. layout and order of the rows
+  table->layout = (table_layout)read_u32(save_file);
+  bool is_clustered = read_u32(save_file) != 0;
+  size_t nb_sorted = read_u64(save_file);
+  lsm_tree* lsm = NULL;
+  if (read_u32(save_file) != 0) {
+    // the fences, the filters and the memtable are built when they're used
+    lsm = create_lsm();
+    lsm->nb_flushed = read_u64(save_file);
+    size_t nb_runs = read_u64(save_file);
+    for (size_t i = 0; i < nb_runs; i++) {
+      size_t first = read_u64(save_file);
+      add_run(lsm, first, read_u64(save_file));
+    }
+  }
+  bool is_paged = init_table_pages(table);
+  assert(is_paged && row_size == table->row_size);
+  table->is_clustered = is_clustered;
+  table->nb_sorted = nb_sorted;
+  table->lsm = lsm;
+  // 6. indexes
+  table->nb_indexes = read_u64(save_file);
+  table->indexes =
+      (table_index**)malloc(sizeof(table_index*) * (table->nb_indexes + 1));
+  assert(table->indexes != NULL);
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    table_index* index = (table_index*)malloc(sizeof(table_index));
+    assert(index != NULL);
+    size_t name_len = read_u64(save_file);
+    index->name = (char*)malloc(sizeof(char) * name_len);
+    assert(index->name != NULL);
+    fread(index->name, name_len, 1, save_file);
+    index->column = read_u64(save_file);
+    index->kind = (index_kind)read_u32(save_file);
+    index->tree = NULL;
+    index->hash = NULL;
+    index->filters = NULL;
+    if (index->kind == I_BLOOM) {
+      index->filters = bloom_create(0);
+      index->filters->blocks_per_filter = read_u64(save_file);
+      bloom_resize(index->filters, read_u64(save_file));
+      size_t nb_words = bloom_nb_words(index->filters);
+      for (size_t word = 0; word < nb_words; word++) {
+        index->filters->words[word] = read_u32(save_file);
+      }
+    }
+    table->indexes[i] = index;
+  }
+  // 7. heap
+  table->heap_size = read_u64(save_file);
+  table->heap_capacity = table->heap_size;
+  table->heap = (char*)malloc(table->heap_size + 1);
+  assert(table->heap != NULL);
+  fread(table->heap, table->heap_size, 1, save_file);
+  // 8. dictionaries
+  for (size_t i = 0; i < table->schema->nb_attr; i++) {
+    dictionary* dict = table->dictionaries[i];
+    if (dict == NULL) {
+      continue;
+    }
+    size_t nb_values = read_u64(save_file);
+    char value[dict->size];
+    for (size_t code = 0; code < nb_values; code++) {
+      fread(value, dict->size, 1, save_file);
+      encode_value(dict, value);
+    }
+  }
+  // 9. nb_pages
+  size_t nb_pages = read_u64(save_file);
+  // 10. file pages and their checksums
+  table->pages = (size_t*)malloc(sizeof(size_t) * (nb_pages + 1));
+  assert(table->pages != NULL);
+  table->file_pages = (size_t*)malloc(sizeof(size_t) * (nb_pages + 1));
+  assert(table->file_pages != NULL);
+  table->page_checksums =
+      (uint32_t*)malloc(sizeof(uint32_t) * (nb_pages + 1));
+  assert(table->page_checksums != NULL);
+  table->pages_capacity = nb_pages + 1;
+  for (size_t index_page = 0; index_page < nb_pages; index_page++) {
+    table->file_pages[index_page] = read_u64(save_file);
+    table->page_checksums[index_page] = read_u32(save_file);
+  }
+  // 11. zones
+  size_t nb_zones = nb_pages * table->schema->nb_attr;
+  table->zones =
+      (zone*)malloc(sizeof(zone) * (nb_zones + table->schema->nb_attr));
+  assert(table->zones != NULL);
+  for (size_t index_page = 0; index_page < nb_pages; index_page++) {
+    for (size_t i = 0; i < table->schema->nb_attr; i++) {
+      attr_kind kind = table->schema->descs[i]->desc;
+      zone* z = &table->zones[index_page * table->schema->nb_attr + i];
+      read_zone_value_from(kind, &z->min, save_file);
+      read_zone_value_from(kind, &z->max, save_file);
+    }
+  }
+  bool is_mapped = pager_map(get_buffer_pool(), fd, nb_pages, table->file_pages,
+                             table->page_checksums, table->pages);
+  assert(is_mapped);
+  table->nb_pages = nb_pages;
+  table->capacity = nb_pages * table->rows_per_page;
+  assert(capacity == table->capacity);
+  resize_dead_rows(table);
+
+  return table;
+}
+
+// Bytes written by write_file_pages, NULL if they don't match their
+// checksum.
+char* read_file_pages(int fd, size_t first, size_t length, uint32_t checksum) {
+  char* bytes = (char*)malloc(length + 1);
+  assert(bytes != NULL);
+  ssize_t nb_read = pread(fd, bytes, length, (off_t)(first * PAGER_PAGE_SIZE));
+  if (nb_read != (ssize_t)length || crc32c(0, bytes, length) != checksum) {
+    free(bytes);
+    return NULL;
+  }
+  return bytes;
+}
+
+// A table saved in the file fd, NULL when its description is damaged.
+table_data* read_table(int fd,
+                       size_t meta_page,
+                       size_t meta_length,
+                       uint32_t meta_checksum) {
+  char* description = read_file_pages(fd, meta_page, meta_length,
+                                      meta_checksum);
+  if (description == NULL) {
+    return NULL;
+  }
+  FILE* save_file = fmemopen(description, meta_length, "rb");
+  assert(save_file != NULL);
+  table_data* table = deserialise_table(save_file, fd);
+  fclose(save_file);
+  free(description);
+  table->meta_page = meta_page;
+  table->meta_length = meta_length;
+  table->meta_checksum = meta_checksum;
+  return table;
 }
 
-table_data* deserialise_table(FILE* save_file) {
+// Files written before the pages were saved: rows are stored contiguously
+// right after the description and copied into new pages.
+table_data* deserialise_legacy_table(FILE* save_file) {
   table_data* table = (table_data*)malloc(sizeof(table_data));
   assert(table != NULL);
 
@@ -1282,30 +4413,475 @@ table_data* deserialise_table(FILE* save_file) {
   // 2. nb_rows
   fread(&table->nb_rows, sizeof(size_t), 1, save_file);
   // 3. capacity
-  fread(&table->capacity, sizeof(size_t), 1, save_file);
+  size_t capacity;
+  fread(&capacity, sizeof(size_t), 1, save_file);
   // 4. row_size
-  fread(&table->row_size, sizeof(size_t), 1, save_file);
-  // 5. values
-  size_t total_size = table->row_size * table->nb_rows;
-  table->values = (void*)malloc(total_size);
-  assert(table->values != NULL);
-  fread(table->values, total_size, 1, save_file);
+  size_t row_size;
+  fread(&row_size, sizeof(size_t), 1, save_file);
+  // 5. values, stored by rows, varchars inline
+  table->layout = L_ROWS;
+  bool is_paged = init_table_pages(table);
+  assert(is_paged);
+  while (table->capacity < table->nb_rows) {
+    add_page(table);
+  }
+  char row[row_size];
+  for (size_t row_index = 0; row_index < table->nb_rows; row_index++) {
+    fread(row, row_size, 1, save_file);
+    char* page = pin_row(table, row_index);
+    size_t offset = 0;
+    for (size_t col_index = 0; col_index < table->schema->nb_attr;
+         col_index++) {
+      attr_desc_size* desc = table->schema->descs[col_index];
+      char* field = get_field(table, page, row_index, col_index);
+      if (is_out_of_line(desc)) {
+        varchar_ref ref;
+        make_varchar_ref(table, &ref, row + offset,
+                         strnlen(row + offset, desc->size));
+        memcpy(field, &ref, sizeof(varchar_ref));
+      } else {
+        memcpy(field, row + offset, desc->size);
+      }
+      offset += desc->size;
+    }
+    unpin_row(table, row_index, true);
+  }
+  rebuild_zones(table);
 
   return table;
 }
 
-void serialise_database(FILE* save_file) {
-  fwrite(&nb_tables, sizeof(size_t), 1, save_file);
-  for (size_t index_table = 0; index_table < nb_tables; index_table++) {
-    serialise_table(tables[index_table], save_file);
+// A database file starts with a header page: this magic, the version of the
+// format, the page size, the place and the checksum of the catalog, then the
+// checksum of the header itself. The catalog is the directory of the tables:
+// their schema, the place and the checksum of their description, their pages
+// and the names of their indexes. A table is read when it's first used.
+// Older files start with the number of tables.
+//
+// Every field is a fixed width little endian integer. The pages hold the rows
+// as they're in memory, they're little endian too. Every page and blob has a
+// CRC32C, a torn write or a damaged page is detected when it's read.
+//
+// A save never writes over the pages of the previous one: modified pages,
+// descriptions and the catalog go to free pages, the file is synced and only
+// then the header points to the new catalog. A crash leaves the previous
+// save readable. Pages left by the previous save are free for the next one.
+static const char database_magic[8] = {'Q', 'D', 'B', 'F', 'I', 'L', 'E', 0};
+
+#define DATABASE_VERSION 3
+#define DATABASE_HEADER_SIZE 40
+
+typedef struct DatabaseHeader {
+  char magic[8];
+  uint32_t version;
+  size_t page_size;
+  size_t catalog_page;
+  size_t catalog_length;
+  uint32_t catalog_checksum;
+} database_header;
+
+void encode_header(database_header* header, unsigned char* bytes) {
+  memcpy(bytes, header->magic, sizeof(header->magic));
+  store_u32(bytes + 8, header->version);
+  store_u32(bytes + 12, (uint32_t)header->page_size);
+  store_u64(bytes + 16, header->catalog_page);
+  store_u64(bytes + 24, header->catalog_length);
+  store_u32(bytes + 32, header->catalog_checksum);
+  store_u32(bytes + 36, crc32c(0, bytes, 36));
+}
+
+// false when the header doesn't match its checksum
+bool decode_header(database_header* header, const unsigned char* bytes) {
+  memcpy(header->magic, bytes, sizeof(header->magic));
+  header->version = load_u32(bytes + 8);
+  header->page_size = load_u32(bytes + 12);
+  header->catalog_page = load_u64(bytes + 16);
+  header->catalog_length = load_u64(bytes + 24);
+  header->catalog_checksum = load_u32(bytes + 32);
+  return load_u32(bytes + 36) == crc32c(0, bytes, 36);
+}
+
+bool is_little_endian_host(void) {
+  uint32_t one = 1;
+  return *(unsigned char*)&one == 1;
+}
+
+// file of the last .save or .open, the positions saved in the tables are in
+// this file. NULL when there's none.
+static char* saved_path;
+static file_space saved_space;
+
+// A background save is a forked process writing a copy of the database, it
+// sends the number of tables written so far through a pipe.
+static pid_t bgsave_pid;  // 0 when none runs
+static char* bgsave_path;
+static int bgsave_progress;
+static size_t bgsave_nb_tables;
+static size_t bgsave_nb_saved;
+static size_t bgsave_log_length;  // bytes of the log in the copy
+static bool bgsave_has_log;       // the log was opened for the copy
+static int progress_fd = -1;      // in the forked process
+
+// The directory entry of a table in memory, it shares the fields of the table.
+table_place describe_table(table_data* table, char** index_names) {
+  for (size_t i = 0; i < table->nb_indexes; i++) {
+    index_names[i] = table->indexes[i]->name;
+  }
+  table_place place = {table->schema,      table->meta_page,
+                       table->meta_length, table->meta_checksum,
+                       table->nb_pages,    table->file_pages,
+                       table->nb_indexes,  index_names};
+  return place;
+}
+
+void serialise_table_place(table_place* place, FILE* save_file) {
+  // 1. schema
+  serialise_table_desc(place->schema, save_file);
+  // 2. description
+  write_u64(save_file, place->meta_page);
+  write_u64(save_file, place->meta_length);
+  write_u32(save_file, place->meta_checksum);
+  // 3. pages
+  write_u64(save_file, place->nb_pages);
+  for (size_t index_page = 0; index_page < place->nb_pages; index_page++) {
+    write_u64(save_file, place->file_pages[index_page]);
+  }
+  // 4. names of the indexes
+  write_u64(save_file, place->nb_indexes);
+  for (size_t i = 0; i < place->nb_indexes; i++) {
+    size_t name_len = strlen(place->index_names[i]) + 1;
+    write_u64(save_file, name_len);
+    fwrite(place->index_names[i], name_len, 1, save_file);
+  }
+}
+
+table_place* deserialise_table_place(FILE* save_file) {
+  table_place* place = (table_place*)malloc(sizeof(table_place));
+  assert(place != NULL);
+  // 1. schema
+  place->schema = deserialise_table_desc(save_file);
+  // 2. description
+  place->meta_page = read_u64(save_file);
+  place->meta_length = read_u64(save_file);
+  place->meta_checksum = read_u32(save_file);
+  // 3. pages
+  place->nb_pages = read_u64(save_file);
+  place->file_pages = (size_t*)malloc(sizeof(size_t) * (place->nb_pages + 1));
+  assert(place->file_pages != NULL);
+  for (size_t index_page = 0; index_page < place->nb_pages; index_page++) {
+    place->file_pages[index_page] = read_u64(save_file);
+  }
+  // 4. names of the indexes
+  place->nb_indexes = read_u64(save_file);
+  place->index_names = (char**)malloc(sizeof(char*) * (place->nb_indexes + 1));
+  assert(place->index_names != NULL);
+  for (size_t i = 0; i < place->nb_indexes; i++) {
+    size_t name_len = read_u64(save_file);
+    place->index_names[i] = (char*)malloc(sizeof(char) * name_len);
+    assert(place->index_names[i] != NULL);
+    fread(place->index_names[i], name_len, 1, save_file);
+  }
+  return place;
+}
+
+// Remember the pages of a file used by the tables and its catalog.
+void remember_saved_file(char* path, size_t catalog_page, size_t length) {
+  free(saved_path);
+  saved_path = NULL;
+  reset_file_space(&saved_space);
+  if (path == NULL) {
+    for (size_t i = 0; i < database.nb_tables; i++) {
+      if (database.tables[i] != NULL) {
+        forget_file_pages(database.tables[i]);
+      }
+    }
+    return;
+  }
+  saved_path = (char*)malloc(sizeof(char) * (strlen(path) + 1));
+  assert(saved_path != NULL);
+  strcpy(saved_path, path);
+  use_file_pages(&saved_space, 0, 1);
+  use_file_pages(&saved_space, catalog_page,
+                 (length + PAGER_PAGE_SIZE - 1) / PAGER_PAGE_SIZE);
+  for (size_t i = 0; i < database.nb_tables; i++) {
+    table_data* table = database.tables[i];
+    char* index_names[table == NULL ? 1 : table->nb_indexes + 1];
+    table_place place = table == NULL ? *database.places[i]
+                                      : describe_table(table, index_names);
+    use_file_pages(&saved_space, place.meta_page,
+                   (place.meta_length + PAGER_PAGE_SIZE - 1) / PAGER_PAGE_SIZE);
+    for (size_t index_page = 0; index_page < place.nb_pages; index_page++) {
+      use_file_pages(&saved_space, place.file_pages[index_page], 1);
+    }
+  }
+}
+
+// Write the modified tables and a new catalog in the free pages of the
+// file, then its header. Returns the number of written pages.
+size_t serialise_database(int fd, file_space* space, database_header* header) {
+  size_t nb_written = 0;
+  for (size_t i = 0; i < database.nb_tables; i++) {
+    if (database.tables[i] != NULL) {
+      nb_written += serialise_table(database.tables[i], fd, space);
+    }
+    if (progress_fd != -1 &&
+        write(progress_fd, &i, sizeof(size_t)) != sizeof(size_t)) {
+      perror("Progress error");
+    }
   }
+  char* catalog;
+  size_t length;
+  FILE* catalog_file = open_memstream(&catalog, &length);
+  assert(catalog_file != NULL);
+  write_u64(catalog_file, database.nb_tables);
+  for (size_t i = 0; i < database.nb_tables; i++) {
+    table_data* table = database.tables[i];
+    if (table == NULL) {
+      serialise_table_place(database.places[i], catalog_file);
+      continue;
+    }
+    char* index_names[table->nb_indexes + 1];
+    table_place place = describe_table(table, index_names);
+    serialise_table_place(&place, catalog_file);
+  }
+  fclose(catalog_file);
+  memcpy(header->magic, database_magic, sizeof(database_magic));
+  header->version = DATABASE_VERSION;
+  header->page_size = PAGER_PAGE_SIZE;
+  header->catalog_page = write_file_pages(fd, space, catalog, length);
+  header->catalog_length = length;
+  header->catalog_checksum = crc32c(0, catalog, length);
+  free(catalog);
+  nb_written++;
+
+  // every page is on disk before the header refers to them
+  fdatasync(fd);
+  unsigned char bytes[DATABASE_HEADER_SIZE];
+  encode_header(header, bytes);
+  ssize_t written = pwrite(fd, bytes, sizeof(bytes), 0);
+  assert(written == (ssize_t)sizeof(bytes));
+  fdatasync(fd);
+  return nb_written + 1;
 }
 
-void deserialise_database(FILE* save_file) {
-  fread(&nb_tables, sizeof(size_t), 1, save_file);
+// Read the tables of a file, header is set unless it's an older file. The
+// tables of a file are only read when they're used, the database keeps the
+// file open until then.
+bool deserialise_database(FILE* save_file,
+                          database_header* header,
+                          bool* is_legacy) {
+  unsigned char bytes[DATABASE_HEADER_SIZE];
+  bool is_read = fread(bytes, sizeof(bytes), 1, save_file) == 1;
+  bool is_intact = is_read && decode_header(header, bytes);
+  *is_legacy = !is_read || memcmp(header->magic, database_magic,
+                                  sizeof(database_magic)) != 0;
+  if (*is_legacy && is_read && memcmp(header->magic, "QDB", 3) == 0) {
+    runtime_error("The file was written by another version of qdb");
+    return false;
+  }
+  if (*is_legacy) {
+    rewind(save_file);
+    size_t nb_tables;
+    fread(&nb_tables, sizeof(size_t), 1, save_file);
+    clear_catalog(&database);
+    for (size_t index_table = 0; index_table < nb_tables; index_table++) {
+      add_table(&database, deserialise_legacy_table(save_file));
+    }
+    return true;
+  }
+  if (!is_intact) {
+    runtime_error("The header of the file doesn't match its checksum");
+    return false;
+  }
+  if (header->version != DATABASE_VERSION) {
+    runtime_error("The file uses version %u of the format, expected %d",
+                  header->version, DATABASE_VERSION);
+    return false;
+  }
+  if (header->page_size != PAGER_PAGE_SIZE) {
+    runtime_error("The file uses pages of %ld B, expected %d B",
+                  header->page_size, PAGER_PAGE_SIZE);
+    return false;
+  }
+  if (!is_little_endian_host()) {
+    runtime_error("The pages of the file can only be read by a little "
+                  "endian host");
+    return false;
+  }
+  char* catalog_bytes =
+      read_file_pages(fileno(save_file), header->catalog_page,
+                      header->catalog_length, header->catalog_checksum);
+  if (catalog_bytes == NULL) {
+    runtime_error("The catalog of the file doesn't match its checksum");
+    return false;
+  }
+  FILE* catalog_file =
+      fmemopen(catalog_bytes, header->catalog_length, "rb");
+  assert(catalog_file != NULL);
+  size_t nb_tables = read_u64(catalog_file);
+  clear_catalog(&database);
   for (size_t index_table = 0; index_table < nb_tables; index_table++) {
-    tables[index_table] = deserialise_table(save_file);
+    add_table_or_place(&database, NULL, deserialise_table_place(catalog_file));
+  }
+  fclose(catalog_file);
+  free(catalog_bytes);
+  database.file = save_file;
+  return true;
+}
+
+// Write every table in a new file, renamed to filename once it's complete.
+bool write_database_copy(char* filename,
+                         database_header* header,
+                         size_t* nb_written) {
+  if (!load_all_tables(&database)) {
+    runtime_error("couldn't read every table, %s isn't written", filename);
+    return false;
+  }
+  remember_saved_file(NULL, 0, 0);
+  use_file_pages(&saved_space, 0, 1);
+  char temporary[strlen(filename) + 5];
+  snprintf(temporary, sizeof(temporary), "%s.tmp", filename);
+  FILE* save_file = fopen(temporary, "w+b");
+  if (save_file == NULL) {
+    runtime_error("couldn't write %s", temporary);
+    return false;
+  }
+  *nb_written = serialise_database(fileno(save_file), &saved_space, header);
+  fclose(save_file);
+  if (rename(temporary, filename) == -1) {
+    runtime_error("couldn't rename %s to %s", temporary, filename);
+    return false;
+  }
+  return true;
+}
+
+// Read the progress of the background save. Once it's done, the log only
+// keeps the requests made since it started. Returns false while it runs.
+bool check_background_save(bool is_waiting) {
+  if (bgsave_pid == 0) {
+    return true;
+  }
+  int status;
+  pid_t done = waitpid(bgsave_pid, &status, is_waiting ? 0 : WNOHANG);
+  size_t nb_saved;
+  while (read(bgsave_progress, &nb_saved, sizeof(size_t)) ==
+         sizeof(size_t)) {
+    bgsave_nb_saved = nb_saved + 1;
+  }
+  if (done == 0) {
+    return false;
+  }
+  close(bgsave_progress);
+  bgsave_pid = 0;
+  if (done == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    runtime_error("Background save to %s failed", bgsave_path);
+    // without the copy, the requests of the log can't be replayed
+    if (bgsave_has_log && request_log != NULL) {
+      wal_truncate(request_log);
+      close_request_log();
+    }
+  } else {
+    printf("Background save to %s done, %ld tables\n", bgsave_path,
+           bgsave_nb_tables);
+    // the pages of the file aren't the ones this process knows
+    if (saved_path != NULL && strcmp(saved_path, bgsave_path) == 0) {
+      remember_saved_file(NULL, 0, 0);
+    }
+    if (request_log != NULL) {
+      wal_cut(request_log, bgsave_log_length);
+    }
+    // the log follows the database, like after a .save
+    if (request_log != NULL && strcmp(logged_path, bgsave_path) != 0) {
+      char old_log[strlen(logged_path) + 5];
+      snprintf(old_log, sizeof(old_log), "%s-wal", logged_path);
+      char new_log[strlen(bgsave_path) + 5];
+      snprintf(new_log, sizeof(new_log), "%s-wal", bgsave_path);
+      close_request_log();
+      if (rename(old_log, new_log) == -1) {
+        runtime_error("couldn't rename %s to %s", old_log, new_log);
+      }
+      open_request_log(bgsave_path, false);
+    }
+  }
+  free(bgsave_path);
+  bgsave_path = NULL;
+  return true;
+}
+
+void wait_background_save(void) {
+  check_background_save(true);
+}
+
+// Fork a process which writes a copy of the database while this one keeps
+// running the requests. Its memory is a snapshot, copied on write by the OS.
+bool command_background_save(char* command) {
+  const char s[] = " ";
+  strtok(command, s);                // first string
+  char* filename = strtok(NULL, s);  // second string
+  if (filename == NULL) {
+    if (check_background_save(false)) {
+      printf("No background save running.\n");
+    } else {
+      printf("Background save to %s: %ld of %ld tables written\n",
+             bgsave_path, bgsave_nb_saved, bgsave_nb_tables);
+    }
+    return true;
+  }
+  if (!check_background_save(false)) {
+    runtime_error("A background save to %s is running", bgsave_path);
+    return false;
+  }
+  int progress[2];
+  if (pipe(progress) == -1) {
+    runtime_error("couldn't create a pipe for the background save");
+    return false;
+  }
+  // the requests made from now on aren't in the copy, they're logged
+  bgsave_has_log = request_log == NULL;
+  if (bgsave_has_log) {
+    open_request_log(filename, false);
+    if (request_log != NULL) {
+      wal_truncate(request_log);
+    }
+  }
+  bgsave_log_length = request_log == NULL ? 0 : wal_size(request_log);
+  // both processes keep the spilled pages as they are now
+  pager_split_spill(get_buffer_pool());
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == -1) {
+    runtime_error("couldn't fork the background save");
+    close(progress[0]);
+    close(progress[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(progress[0]);
+    progress_fd = progress[1];
+    pager_stop_evictions(get_buffer_pool());
+    // the file of the tables not read yet, with its own offset
+    if (database.file != NULL) {
+      database.file = freopen(NULL, "rb", database.file);
+      if (database.file == NULL) {
+        _exit(1);
+      }
+    }
+    database_header header;
+    size_t nb_written;
+    _exit(write_database_copy(filename, &header, &nb_written) ? 0 : 1);
   }
+  close(progress[1]);
+  fcntl(progress[0], F_SETFL, O_NONBLOCK);
+  bgsave_pid = pid;
+  bgsave_progress = progress[0];
+  bgsave_nb_tables = database.nb_tables;
+  bgsave_nb_saved = 0;
+  bgsave_path = (char*)malloc(sizeof(char) * (strlen(filename) + 1));
+  assert(bgsave_path != NULL);
+  strcpy(bgsave_path, filename);
+  printf("Background save to %s started, %ld tables\n", filename,
+         database.nb_tables);
+  return true;
 }
 
 bool command_save_tables(char* command) {
@@ -1319,11 +4895,30 @@ bool command_save_tables(char* command) {
     return false;
   }
 
-  FILE* save_file = fopen(filename, "wb");
-  assert(save_file != NULL);
-
-  serialise_database(save_file);
-  fclose(save_file);
+  // The file of the last save is updated in place. Another file may be
+  // mapped by a previous .open, it's written under another name and renamed
+  // so the mapped pages keep their content.
+  // a background save may replace the file
+  wait_background_save();
+  bool is_incremental = saved_path != NULL &&
+                        strcmp(saved_path, filename) == 0 &&
+                        access(filename, W_OK) == 0;
+  database_header header;
+  size_t nb_written;
+  if (is_incremental) {
+    FILE* save_file = fopen(filename, "r+b");
+    assert(save_file != NULL);
+    nb_written = serialise_database(fileno(save_file), &saved_space, &header);
+    fclose(save_file);
+  } else if (!write_database_copy(filename, &header, &nb_written)) {
+    return false;
+  }
+  remember_saved_file(filename, header.catalog_page, header.catalog_length);
+  // the file holds every logged request
+  open_request_log(filename, false);
+  if (request_log != NULL) {
+    wal_truncate(request_log);
+  }
 
   struct stat sb;
 
@@ -1331,8 +4926,8 @@ bool command_save_tables(char* command) {
     runtime_error("stat failed to read %s", filename);
     return false;
   } else {
-    printf("Wrote %ld tables accounting for %lld bytes to %s\n", nb_tables,
-           (long long)sb.st_size, filename);
+    printf("Wrote %ld pages of %ld tables to %s, now %lld bytes\n",
+           nb_written, database.nb_tables, filename, (long long)sb.st_size);
   }
   return true;
 }
@@ -1347,24 +4942,45 @@ bool command_open_tables(char* command) {
     runtime_error(".open requires a filename: .open data.qdb");
     return false;
   }
+  // the tables and the log are replaced
+  wait_background_save();
   FILE* save_file = fopen(filename, "rb");
   assert(save_file != NULL);
 
-  deserialise_database(save_file);
-  fclose(save_file);
+  database_header header;
+  bool is_legacy;
+  bool success = deserialise_database(save_file, &header, &is_legacy);
+  // the database reads its tables from the file when they're used
+  if (database.file != save_file) {
+    fclose(save_file);
+  }
+  if (!success) {
+    return false;
+  }
+  // an older file is rewritten entirely by the next save
+  remember_saved_file(is_legacy ? NULL : filename, header.catalog_page,
+                      header.catalog_length);
+  // requests made since the last .save
+  open_request_log(filename, true);
 
-  printf("Read %s and found %ld tables:\n", filename, nb_tables);
+  printf("Read %s and found %ld tables:\n", filename, database.nb_tables);
   execute(".tables");
 
   return true;
 }
 
 bool command_print_tables(void) {
-  if (nb_tables == 0) {
+  if (database.nb_tables == 0) {
     printf("No table set.\n");
   }
-  for (size_t index_table = 0; index_table < nb_tables; index_table++) {
-    print_table(tables[index_table]);
+  for (size_t i = 0; i < database.nb_tables; i++) {
+    table_place* place = database.places[i];
+    if (database.tables[i] == NULL) {
+      printf("\nSchema of table: %s, not read yet\n", place->schema->name);
+      print_schema(place->schema);
+      continue;
+    }
+    print_table(database.tables[i]);
   }
   return true;
 }
@@ -1416,17 +5032,75 @@ bool command_read_request_file(char* command) {
 }
 
 bool command_clear_all_tables(void) {
-  if (nb_tables == 0) {
+  wait_background_save();
+  if (database.nb_tables == 0) {
     printf("No table to clear.\n");
     return true;
   }
-  for (size_t index_table = 0; index_table < nb_tables; index_table++) {
-    destroy_table(tables[index_table]);
+  printf("Cleared %ld tables\n", database.nb_tables);
+  clear_catalog(&database);
+  // the tables don't belong to the database anymore
+  close_request_log();
+  return true;
+}
+
+// A decimal argument of a command, false unless the whole string is read.
+bool parse_argument(const char* string, long* value) {
+  char* end;
+  errno = 0;
+  *value = strtol(string, &end, 10);
+  return end != string && *end == '\0' && errno == 0;
+}
+
+bool command_cache(char* command) {
+  const char split[] = " ";
+  strtok(command, split);                   // first string
+  char* budget_string = strtok(NULL, split);  // second string
+  if (budget_string == NULL) {
+    pager_print_stats(get_buffer_pool());
+    return true;
+  }
+  long budget;
+  if (!parse_argument(budget_string, &budget) || budget <= 0) {
+    runtime_error(".cache requires a positive size in MiB: .cache 64");
+    return false;
+  }
+  pager_set_budget(get_buffer_pool(), (size_t)budget * 1024 * 1024);
+  printf("Buffer pool limited to %ld MiB\n", budget);
+  return true;
+}
+
+bool command_wal(char* command) {
+  const char split[] = " ";
+  strtok(command, split);                       // first string
+  char* interval_string = strtok(NULL, split);  // second string
+  char* bytes_string = strtok(NULL, split);     // third string
+  if (interval_string == NULL) {
+    if (request_log == NULL) {
+      printf("No log, .open or .save a database first.\n");
+      return true;
+    }
+    wal_print_stats(request_log);
+    return true;
   }
-  printf("Cleared %ld tables\n", nb_tables);
-  nb_tables = 0;
+  long interval;
+  long bytes = (long)log_bytes;
+  if (!parse_argument(interval_string, &interval) ||
+      (bytes_string != NULL && !parse_argument(bytes_string, &bytes)) ||
+      interval < 0 || bytes <= 0) {
+    runtime_error(
+        ".wal requires an interval in ms and a size in B: .wal 10 65536");
+    return false;
+  }
+  log_interval_ms = (size_t)interval;
+  log_bytes = (size_t)bytes;
+  if (request_log != NULL) {
+    wal_set_group_commit(request_log, log_interval_ms, log_bytes);
+  }
+  printf("Log synced every %ld ms or %ld B\n", interval, bytes);
   return true;
 }
+
 bool command_print_help(void) {
   help();
   return true;
@@ -1437,11 +5111,15 @@ bool execute_command(char* command) {
     printf("Command: %s\n", command);
   }
   if (strcmp(command, ".exit") == 0) {
+    wait_background_save();
+    close_request_log();
     exit(0);
   } else if (strcmp(command, ".tables") == 0) {
     return command_print_tables();
   } else if (strncmp(command, ".save", strlen(".save")) == 0) {
     return command_save_tables(command);
+  } else if (strncmp(command, ".bgsave", strlen(".bgsave")) == 0) {
+    return command_background_save(command);
   } else if (strncmp(command, ".open", strlen(".open")) == 0) {
     return command_open_tables(command);
   } else if (strncmp(command, ".read", strlen(".read")) == 0) {
@@ -1450,16 +5128,19 @@ bool execute_command(char* command) {
     return command_clear_all_tables();
   } else if (strncmp(command, ".help", strlen(".help")) == 0) {
     return command_print_help();
+  } else if (strncmp(command, ".cache", strlen(".cache")) == 0) {
+    return command_cache(command);
+  } else if (strncmp(command, ".wal", strlen(".wal")) == 0) {
+    return command_wal(command);
   } else {
     printf("Unknown command %s\n", command);
   }
   return true;
 }
 
-bool execute_request(char* request) {
-  token** tokens = (token**)malloc(sizeof(token) * MAXTOKEN);
-  assert(tokens != NULL);
-  size_t nb_tokens = lexer(request, tokens);
+bool run_request(arena* statement, char* request) {
+  token** tokens = (token**)arena_alloc(statement, sizeof(token*) * MAXTOKEN);
+  size_t nb_tokens = lexer(statement, request, tokens);
   if (nb_tokens == 0) {
     runtime_error("Lexer failed to tokenize the request");
     return false;
@@ -1470,7 +5151,7 @@ bool execute_request(char* request) {
     print_tokens(tokens, nb_tokens);
   }
 
-  ast_node* root = parse_statement(tokens, &nb_tokens);
+  ast_node* root = parse_statement(statement, tokens, &nb_tokens);
   if (root == NULL) {
     runtime_error("Parser failed to analyse the tokens.");
     return false;
@@ -1480,65 +5161,74 @@ bool execute_request(char* request) {
     print_ast(root);
   }
   table_data* created_table;
+  bool success;
   switch (root->kind) {
     case CREATE:
       created_table = execute_create_table(root);
-      if (created_table != NULL) {
-        if (new_tablename_is_unused(tables, nb_tables, created_table)) {
-          tables[nb_tables] = created_table;
-          nb_tables++;
-        } else {
-          runtime_error("Table %s already exists");
-          return false;
-        }
-        if (DEBUG) {
-          printf("done creating table\n");
-        }
-        return true;
-      } else {
+      if (created_table == NULL) {
         runtime_error("Couldn't create the table");
         return false;
       }
+      if (!new_tablename_is_unused(&database, created_table)) {
+        runtime_error("Table %s already exists", created_table->schema->name);
+        return false;
+      }
+      add_table(&database, created_table);
+      if (DEBUG) {
+        printf("done creating table\n");
+      }
+      success = true;
       break;
     case INSERT:
-      return execute_insert_into_table(tables, nb_tables, root);
+      success = execute_insert_into_table(&database, root);
       break;
     case SELECT:
-      return execute_select_from_table(tables, nb_tables, root);
+      return execute_select_from_table(&database, root);
       break;
     case DROP:
-      if (nb_tables == 0) {
-        runtime_error("No table to drop");
-        return false;
-      }
-      bool ret = execute_drop_table(tables, root, nb_tables);
-      if (ret) {
-        nb_tables -= 1;
-      }
-      return ret;
+      success = execute_drop_table(&database, root);
       break;
     case DELETE:
-      return execute_delete_from_table(tables, nb_tables, root);
+      success = execute_delete_from_table(&database, root);
       break;
     case UPDATE:
-      return execute_update_table(tables, nb_tables, root);
+      success = execute_update_table(&database, root);
+      break;
+    case CREATE_INDEX:
+      success = execute_create_index(&database, root);
+      break;
+    case DROP_INDEX:
+      success = execute_drop_index(&database, root);
+      break;
+    case VACUUM:
+      success = execute_vacuum(&database, root);
       break;
     default:
       runtime_error("Request %s cannot be ran", root->value);
       return false;
       break;
   }
+  if (success) {
+    log_request(request);
+  }
 
-  free(root);
+  return success;
+}
 
-  return true;
+// Everything allocated for a request is released at once when it's done.
+bool execute_request(char* request) {
+  arena* statement = get_statement_arena();
+  bool success = run_request(statement, request);
+  arena_reset(statement);
+  return success;
 }
 
 bool execute(char* request) {
-  if (tables == NULL) {
-    tables = (table_data**)malloc(sizeof(table_data) * MAXTABLES);
+  if (database.tables == NULL) {
+    init_catalog(&database);
   }
-  assert(tables != NULL);
+  // reports the end of a background save
+  check_background_save(false);
   if (strlen(request) == 0) {
     return false;
   }
@@ -1558,6 +5248,32 @@ bool execute(char* request) {
   return execute_request(request);
 }
 
+// Save a table alone in a file and read it back. The table forgets where it
+// was saved.
+table_data* reload_table(table_data* table, char* path) {
+  FILE* file = fopen(path, "w+b");
+  assert(file != NULL);
+  file_space space = {NULL, 0, 0};
+  use_file_pages(&space, 0, 1);
+  forget_file_pages(table);
+  serialise_table(table, fileno(file), &space);
+  table_data* read = read_table(fileno(file), table->meta_page,
+                                table->meta_length, table->meta_checksum);
+  assert(read != NULL);
+  fclose(file);
+  free(space.used);
+  forget_file_pages(table);
+  return read;
+}
+
+// Damage a byte of a file, or repair it.
+void flip_file_byte(int fd, size_t offset) {
+  unsigned char byte;
+  assert(pread(fd, &byte, 1, (off_t)offset) == 1);
+  byte ^= 0x10;
+  assert(pwrite(fd, &byte, 1, (off_t)offset) == 1);
+}
+
 int example_executer(void) {
   if (DEBUG) {
     table_desc* td = example_create_table_desc();
@@ -1616,6 +5332,13 @@ int example_executer(void) {
   assert(!execute(request_update_2));  // duplicate primary key
   assert(execute(request_select_3));
   execute(".tables");
+  // the arguments of the commands are numbers
+  size_t interval_ms = log_interval_ms;
+  char bad_wal[] = ".wal fast";
+  char bad_wal_size[] = ".wal 10 64k";
+  char bad_cache[] = ".cache 64MiB";
+  assert(!execute(bad_wal) && !execute(bad_wal_size) && !execute(bad_cache));
+  assert(log_interval_ms == interval_ms);
 
   /* // serialisation */
   printf("\n\nSERIALISATION / DESERIALISATION\n\n");
@@ -1650,13 +5373,13 @@ int example_executer(void) {
   /* fclose(save_file); */
   /* printf("serialisation deserialisation of table desc okay\n\n"); */
 
-  /* print_schema(tables[0]->schema); */
+  /* print_schema(database.tables[0]->schema); */
   /*  */
   /* char* filename_table_desc = "table_desc.b"; */
   /*  */
   /* FILE* save_file_table_desc = fopen(filename_table_desc, "wb"); */
   /* assert(save_file_table_desc != NULL); */
-  /* serialise_table_desc(tables[0]->schema, save_file_table_desc); */
+  /* serialise_table_desc(database.tables[0]->schema, save_file_table_desc); */
   /* fclose(save_file_table_desc); */
   /*  */
   /* save_file_table_desc = fopen(filename_table_desc, "rb"); */
@@ -1669,10 +5392,8 @@ int example_executer(void) {
   printf("\nbefore saving\n");
   execute("SELECT * FROM \"user\";");
   char* filename_savetable = "table.b";
-  FILE* save_table = fopen(filename_savetable, "wb");
-  assert(save_table != NULL);
-  serialise_table(tables[0], save_table);
-  fclose(save_table);
+  table_data* saved_table =
+      reload_table(database.tables[0], filename_savetable);
   printf("\nafter saving\n");
   execute_command(".tables");
 
@@ -1680,15 +5401,1057 @@ int example_executer(void) {
   execute("DELETE FROM \"user\";");
   execute("SELECT *  FROM \"user\";");
 
-  save_table = fopen(filename_savetable, "rb");
-  assert(save_table != NULL);
-  tables[0] = NULL;
-  tables[0] = deserialise_table(save_table);
-  fclose(save_table);
+  database.tables[0] = NULL;
+  database.tables[0] = saved_table;
   printf("serialisation deserialisation of table okay\n\n");
 
-  print_table(tables[0]);
+  print_table(database.tables[0]);
   /* execute_command(".tables"); */
   execute("SELECT * FROM \"user\";");
+
+  printf("\n\nPRIMARY KEY INDEX\n\n");
+  char request[MAXFORMAT];
+  assert(execute("CREATE TABLE \"pk\" (\"id\" int pk, \"v\" float);"));
+  table_data* pk_table = find_table_from_name(&database, "\"pk\"");
+  assert(pk_table != NULL);
+  for (long i = 0; i < 1000; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"pk\" VALUES (%ld, 1.5);", i);
+    assert(execute(request));
+  }
+  assert(!execute("INSERT INTO \"pk\" VALUES (500, 1.5);"));
+  assert(execute("DELETE FROM \"pk\" WHERE (\"id\" = 500);"));
+  assert(count_live_rows(pk_table) == 999 && pk_table->nb_dead == 1);
+  assert(execute("INSERT INTO \"pk\" VALUES (500, 1.5);"));
+  assert(execute("UPDATE \"pk\" SET \"id\" = 2000 WHERE (\"id\" = 3);"));
+  assert(!execute("UPDATE \"pk\" SET \"id\" = 2000 WHERE (\"id\" = 4);"));
+  assert(execute("UPDATE \"pk\" SET \"id\" = 4 WHERE (\"id\" = 4);"));
+  // a failed UPDATE writes no row, the log doesn't record it
+  assert(!execute("UPDATE \"pk\" SET \"id\" = 3000 WHERE (\"v\" = 1.5);"));
+  assert(!find_pk_owner(pk_table, &(long){3000}, NULL));
+  assert(find_pk_owner(pk_table, &(long){0}, NULL));
+  assert(execute("SELECT * FROM \"pk\" WHERE (\"id\" = 2000);"));
+  assert(get_pk_index(pk_table)->nb_entries == count_live_rows(pk_table));
+  long key = 3;
+  assert(!btree_find(get_pk_index(pk_table), &key, NULL));
+  key = 2000;
+  assert(btree_find(get_pk_index(pk_table), &key, NULL));
+
+  printf("\n\nCOLUMNS STORAGE\n\n");
+  assert(!execute("CREATE TABLE \"bad\" (\"id\" int pk) STORAGE = PK;"));
+  assert(execute(
+      "CREATE TABLE \"pax\" (\"id\" int pk, \"v\" float, \"s\" "
+      "varchar(8)) STORAGE = COLUMNS;"));
+  table_data* pax = find_table_from_name(&database, "\"pax\"");
+  assert(pax != NULL && pax->layout == L_COLUMNS);
+  for (long i = 0; i < 3000; i++) {
+    snprintf(request, MAXFORMAT,
+             "INSERT INTO \"pax\" VALUES (%ld, %ld.5, 's%ld');", i, i, i);
+    assert(execute(request));
+  }
+  assert(pax->nb_pages > 1);
+  assert(execute("DELETE FROM \"pax\" WHERE (\"v\" < 1000.0);"));
+  assert(execute("UPDATE \"pax\" SET \"s\" = 'new' WHERE (\"id\" = 2500);"));
+  assert(count_live_rows(pax) == 2000);
+  table_data* pax_read = reload_table(pax, "pax.b");
+  assert(pax_read->layout == L_COLUMNS && pax_read->nb_rows == 2000);
+  for (size_t row_index = 0; row_index < pax_read->nb_rows; row_index++) {
+    long id = (long)row_index + 1000;
+    char expected[32];
+    snprintf(expected, sizeof(expected), "'s%ld'", id);
+    const char* want = id == 2500 ? "'new'" : expected;
+    char* pax_page = pin_row(pax_read, row_index);
+    size_t length;
+    const char* s = get_string(pax_read, pax_page, row_index, 2, &length);
+    assert(get_int(pax_read, pax_page, row_index, 0) == id);
+    assert(get_float(pax_read, pax_page, row_index, 1) == (double)id + 0.5);
+    assert(length == strlen(want) && memcmp(s, want, length) == 0);
+    unpin_row(pax_read, row_index, false);
+  }
+
+  printf("\n\nSECONDARY INDEXES\n\n");
+  assert(execute(
+      "CREATE TABLE \"idx\" (\"id\" int pk, \"b\" int, \"s\" "
+      "varchar(8));"));
+  table_data* idx = find_table_from_name(&database, "\"idx\"");
+  for (long i = 0; i < 2000; i++) {
+    snprintf(request, MAXFORMAT,
+             "INSERT INTO \"idx\" VALUES (%ld, %ld, 's%ld');", i, i % 50,
+             i % 3);
+    assert(execute(request));
+  }
+  assert(execute("CREATE INDEX \"by_b\" ON \"idx\" (\"b\");"));
+  assert(!execute("CREATE INDEX \"by_b\" ON \"idx\" (\"s\");"));
+  assert(!execute("CREATE INDEX \"by_x\" ON \"idx\" (\"x\");"));
+  assert(idx->nb_indexes == 1 && idx->indexes[0]->column == 1);
+  assert(execute("DELETE FROM \"idx\" WHERE (\"b\" = 7);"));
+  assert(count_live_rows(idx) == 1960);
+  assert(execute("UPDATE \"idx\" SET \"b\" = 7 WHERE (\"b\" > 47);"));
+  assert(execute("INSERT INTO \"idx\" VALUES (5000, 7, 's0');"));
+  long seven = 7;
+  size_t nb_seven = 0;
+  btree* by_b = get_index_tree(idx, idx->indexes[0]);
+  for (btree_cursor c = btree_seek(by_b, &seven); btree_cursor_valid(&c);
+       btree_cursor_next(&c)) {
+    if (btree_compare_keys(by_b, btree_cursor_key(&c), &seven) != 0) {
+      break;
+    }
+    nb_seven++;
+  }
+  assert(nb_seven == 81 && by_b->nb_entries == count_live_rows(idx));
+  assert(execute("DELETE FROM \"idx\" WHERE (\"b\" <= 7);"));
+  assert(count_live_rows(idx) == 1600);
+  // the literal on the left, 46 < "b" is "b" > 46 for the index and the rows
+  assert(execute("DELETE FROM \"idx\" WHERE (46 < \"b\");"));
+  assert(count_live_rows(idx) == 1560);
+  assert(execute("CREATE INDEX \"by_s\" ON \"idx\" (\"s\");"));
+  assert(execute("SELECT \"id\" FROM \"idx\" WHERE (\"s\" = 's1');"));
+  assert(execute("DROP INDEX \"by_s\";"));
+  assert(!execute("DROP INDEX \"by_s\";"));
+  table_data* idx_read = reload_table(idx, "idx.b");
+  assert(idx_read->nb_indexes == 1 && idx_read->indexes[0]->tree == NULL);
+  assert(strcmp(idx_read->indexes[0]->name, "\"by_b\"") == 0);
+  long eight = 8;
+  btree* by_b_read = get_index_tree(idx_read, idx_read->indexes[0]);
+  btree_cursor first = btree_seek(by_b_read, NULL);
+  assert(btree_cursor_valid(&first));
+  assert(memcmp(btree_cursor_key(&first), &eight, sizeof(long)) == 0);
+
+  printf("\n\nHASH INDEXES\n\n");
+  assert(execute(
+      "CREATE TABLE \"kv\" (\"k\" int pk, \"v\" varchar(8));"));
+  assert(execute("CREATE INDEX \"kv_k\" ON \"kv\" (\"k\") USING HASH;"));
+  assert(!execute("CREATE INDEX \"kv_v\" ON \"kv\" (\"v\") USING;"));
+  assert(execute("CREATE INDEX \"kv_v\" ON \"kv\" (\"v\") USING hash;"));
+  table_data* kv = find_table_from_name(&database, "\"kv\"");
+  for (long i = 0; i < 5000; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"kv\" VALUES (%ld, 'v%ld');",
+             i, i % 10);
+    assert(execute(request));
+  }
+  // the uniqueness of the primary key is checked by the hash index alone
+  assert(!execute("INSERT INTO \"kv\" VALUES (4999, 'dup');"));
+  assert(kv->pk_index == NULL && kv->indexes[0]->hash->nb_entries == 5000);
+  assert(!execute("UPDATE \"kv\" SET \"k\" = 12 WHERE (\"k\" = 13);"));
+  assert(execute("UPDATE \"kv\" SET \"k\" = 6000 WHERE (\"k\" = 13);"));
+  size_t owner;
+  long k = 6000;
+  assert(find_pk_owner(kv, &k, &owner) && owner == 13);
+  k = 13;
+  assert(!find_pk_owner(kv, &k, NULL));
+  assert(execute("UPDATE \"kv\" SET \"v\" = 'w' WHERE (\"v\" = 'v3');"));
+  char w[8] = "'w'";
+  size_t nb_w = 0;
+  for (hash_cursor c = hash_seek(kv->indexes[1]->hash, w);
+       hash_cursor_valid(&c); hash_cursor_next(&c)) {
+    nb_w++;
+  }
+  assert(nb_w == 500);
+  assert(execute("DELETE FROM \"kv\" WHERE (\"v\" = 'w');"));
+  assert(count_live_rows(kv) == 4500);
+  assert(kv->indexes[1]->hash->nb_entries == 4500);
+  assert(!execute("INSERT INTO \"kv\" VALUES (0, 'dup');"));
+  assert(kv->indexes[0]->hash->nb_entries == 4500);
+  table_data* kv_read = reload_table(kv, "kv.b");
+  assert(kv_read->indexes[0]->kind == I_HASH);
+  assert(kv_read->indexes[1]->kind == I_HASH);
+
+  printf("\n\nTOMBSTONES\n\n");
+  assert(execute("CREATE TABLE \"tomb\" (\"id\" int pk, \"v\" int);"));
+  table_data* tomb = find_table_from_name(&database, "\"tomb\"");
+  for (long i = 0; i < 3000; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"tomb\" VALUES (%ld, %ld);", i,
+             i % 7);
+    assert(execute(request));
+  }
+  // rows are only marked until half of them are deleted
+  assert(execute("DELETE FROM \"tomb\" WHERE (\"id\" < 1000);"));
+  assert(tomb->nb_rows == 3000 && tomb->nb_dead == 1000);
+  assert(execute("INSERT INTO \"tomb\" VALUES (10, 0);"));
+  assert(!execute("INSERT INTO \"tomb\" VALUES (1500, 0);"));
+  assert(execute("UPDATE \"tomb\" SET \"v\" = 9 WHERE (\"id\" < 1400);"));
+  assert(execute("DELETE FROM \"tomb\" WHERE (\"v\" = 9);"));
+  assert(tomb->nb_dead == 1401 && count_live_rows(tomb) == 1600);
+  assert(execute("DELETE FROM \"tomb\" WHERE (\"id\" < 1600);"));
+  assert(tomb->nb_dead == 0 && tomb->nb_rows == 1400);
+  char* tomb_page = pin_row(tomb, 0);
+  long first_id;
+  memcpy(&first_id, get_field(tomb, tomb_page, 0, 0), sizeof(long));
+  unpin_row(tomb, 0, false);
+  assert(first_id == 1600);
+  assert(execute("DELETE FROM \"tomb\" WHERE (\"v\" = 3);"));
+  assert(tomb->nb_dead == 200);
+  assert(execute("VACUUM \"tomb\";"));
+  assert(tomb->nb_dead == 0 && tomb->nb_rows == 1200);
+  assert(execute("VACUUM;"));
+  assert(!execute("VACUUM \"nope\";"));
+  assert(execute("DELETE FROM \"tomb\" WHERE (\"v\" = 4);"));
+  table_data* tomb_read = reload_table(tomb, "tomb.b");
+  assert(tomb->nb_dead == 0 && tomb->nb_rows == 1000);
+  assert(tomb_read->nb_rows == 1000);
+
+  printf("\n\nOUT OF LINE VARCHARS\n\n");
+  assert(execute("CREATE TABLE \"doc\" (\"id\" int pk, \"title\" "
+                 "varchar(4096), \"tag\" varchar(8));"));
+  table_data* doc = find_table_from_name(&database, "\"doc\"");
+  assert(doc->row_size == sizeof(long) + sizeof(varchar_ref) + 8);
+  for (long i = 0; i < 1000; i++) {
+    snprintf(request, MAXFORMAT,
+             i % 2 ? "INSERT INTO \"doc\" VALUES (%ld, 'a_long_title_%ld', "
+                     "'x');"
+                   : "INSERT INTO \"doc\" VALUES (%ld, 't%ld', 'x');",
+             i, i);
+    assert(execute(request));
+  }
+  assert(!execute("INSERT INTO \"doc\" VALUES (1000, 100000000, 'x');"));
+  // only the long titles are in the heap
+  assert(doc->heap_size == 5 * 16 + 45 * 17 + 450 * 18);
+  assert(execute(
+      "CREATE INDEX \"doc_title\" ON \"doc\" (\"title\") USING HASH;"));
+  char title[4096] = "'a_long_title_999'";
+  size_t title_row;
+  assert(hash_find(doc->indexes[0]->hash, title, &title_row));
+  assert(title_row == 999);
+  assert(execute("DELETE FROM \"doc\" WHERE (\"title\" = 'a_long_title_7');"));
+  assert(execute("DELETE FROM \"doc\" WHERE (\"title\" = 't8');"));
+  assert(count_live_rows(doc) == 998);
+  assert(execute("UPDATE \"doc\" SET \"title\" = 'another_long_title' WHERE "
+                 "(\"id\" < 600);"));
+  assert(doc->heap_garbage * 2 <= doc->heap_size);
+  assert(execute("SELECT \"id\" FROM \"doc\" WHERE (\"title\" = "
+                 "'another_long_title');"));
+  varchar_ref doc_ref;
+  char* doc_first = pin_row(doc, 0);
+  memcpy(&doc_ref, get_field(doc, doc_first, 0, 1), sizeof(varchar_ref));
+  size_t doc_length;
+  const char* doc_title = get_string(doc, doc_first, 0, 1, &doc_length);
+  unpin_row(doc, 0, false);
+  assert(varchar_equals(&doc_ref, doc->heap, "'another_long_title'", 20) &&
+         !varchar_equals(&doc_ref, doc->heap, "'another_long_titlf'", 20));
+  // read in the heap
+  assert(doc_length == 20 && doc_title == doc->heap + doc_ref.offset);
+  table_data* doc_read = reload_table(doc, "doc.b");
+  assert(doc->heap_garbage == 0);
+  char* doc_page = pin_row(doc_read, 997);
+  read_declared_value(doc_read, doc_page, 997, 1, title);
+  unpin_row(doc_read, 997, false);
+  assert(strcmp(title, "'a_long_title_999'") == 0);
+
+  printf("\n\nDICTIONARY\n\n");
+  assert(execute("CREATE TABLE \"visit\" (\"id\" int pk, \"country\" "
+                 "varchar(32) DICT, \"page\" varchar(8));"));
+  table_data* visit = find_table_from_name(&database, "\"visit\"");
+  assert(visit->schema->descs[1]->desc == D_DICT);
+  assert(visit->row_size == sizeof(long) + sizeof(uint32_t) + 8);
+  const char* countries[] = {"'fr'", "'de'", "'it'", "'es'"};
+  for (long i = 0; i < 2000; i++) {
+    snprintf(request, MAXFORMAT,
+             "INSERT INTO \"visit\" VALUES (%ld, %s, 'p%ld');", i,
+             countries[i % 4], i % 10);
+    assert(execute(request));
+  }
+  dictionary* visit_dict = visit->dictionaries[1];
+  assert(visit_dict->nb_values == 4 && visit->dictionaries[2] == NULL);
+  // the literal gets the code of its value
+  char visit_request[] =
+      "SELECT \"id\" FROM \"visit\" WHERE (\"country\" = 'it');";
+  // parsed like a request, the next one releases the tree
+  arena* visit_arena = get_statement_arena();
+  token** visit_tokens =
+      (token**)arena_alloc(visit_arena, sizeof(token*) * MAXTOKEN);
+  size_t nb_visit_tokens = lexer(visit_arena, visit_request, visit_tokens);
+  ast_node* visit_query =
+      parse_statement(visit_arena, visit_tokens, &nb_visit_tokens);
+  assert(visit_query != NULL);
+  ast_node* visit_condition = get_where_condition(visit_query->right);
+  bind_dictionary_codes(visit, visit_condition);
+  assert(visit_condition->right->i_value == 2);
+  char* visit_row = pin_row(visit, 6);
+  size_t visit_length;
+  assert(get_string(visit, visit_row, 6, 1, &visit_length) ==
+         decode_value(visit_dict, 2));
+  assert(visit_length == 4);
+  unpin_row(visit, 6, false);
+  where_program* visit_program = compile_where(visit, visit_condition);
+  assert(visit_program->code[0].op == WHERE_CODE_EQ &&
+         visit_program->code[0].i == 2);
+  row_batch visit_batch = {.index_page = 6 / visit->rows_per_page,
+                           .page = pin_row(visit, 6),
+                           .nb_rows = 2,
+                           .rows = {6, 7}};
+  filter_batch(visit_program, visit, &visit_batch);
+  assert(visit_batch.nb_rows == 1 && visit_batch.rows[0] == 6);
+  unpin_batch(visit, &visit_batch);
+  // a value which isn't in the dictionary matches no row
+  assert(execute("DELETE FROM \"visit\" WHERE (\"country\" = 'uk');"));
+  assert(count_live_rows(visit) == 2000 && visit_dict->nb_values == 4);
+  assert(execute("DELETE FROM \"visit\" WHERE (\"country\" = 'de');"));
+  assert(count_live_rows(visit) == 1500);
+  assert(execute("UPDATE \"visit\" SET \"country\" = 'uk' WHERE "
+                 "(\"country\" = 'es');"));
+  assert(visit_dict->nb_values == 5);
+  assert(execute(
+      "SELECT \"id\", \"country\" FROM \"visit\" WHERE (\"id\" < 8);"));
+  char country[32];
+  char* visit_page = pin_row(visit, 3);
+  read_declared_value(visit, visit_page, 3, 1, country);
+  unpin_row(visit, 3, false);
+  assert(strcmp(country, "'uk'") == 0);
+  // indexes hold the values, not the codes
+  assert(execute(
+      "CREATE INDEX \"visit_country\" ON \"visit\" (\"country\") USING "
+      "HASH;"));
+  char country_key[32] = "'fr'";
+  size_t country_row;
+  assert(hash_find(visit->indexes[0]->hash, country_key, &country_row));
+  assert(execute("UPDATE \"visit\" SET \"page\" = 'home' WHERE "
+                 "(\"country\" = 'fr');"));
+  // a number in a DICT column fails the UPDATE, the other column is kept
+  assert(!execute("UPDATE \"visit\" SET \"page\" = 'away', \"country\" = 5 "
+                  "WHERE (\"id\" = 0);"));
+  visit_page = pin_row(visit, 0);
+  read_declared_value(visit, visit_page, 0, 2, country);
+  unpin_row(visit, 0, false);
+  assert(strcmp(country, "'home'") == 0);
+  table_data* visit_read = reload_table(visit, "visit.b");
+  assert(visit_read->dictionaries[1]->nb_values == 5);
+  visit_page = pin_row(visit_read, 0);
+  read_declared_value(visit_read, visit_page, 0, 1, country);
+  unpin_row(visit_read, 0, false);
+  assert(strcmp(country, "'fr'") == 0);
+  destroy_table(visit_read);
+  free(visit_read);
+
+  printf("\n\nINCREMENTAL SAVE\n\n");
+  assert(execute("CREATE TABLE \"inc\" (\"id\" int pk, \"v\" int);"));
+  table_data* inc = find_table_from_name(&database, "\"inc\"");
+  for (long i = 0; i < 5000; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"inc\" VALUES (%ld, 0);", i);
+    assert(execute(request));
+  }
+  unlink("inc.db");
+  char save_inc[] = ".save inc.db";
+  assert(execute(save_inc));
+  struct stat inc_stat;
+  assert(stat("inc.db", &inc_stat) == 0);
+  off_t full_size = inc_stat.st_size;
+  size_t moved_page = inc->file_pages[3];
+  size_t kept_page = inc->file_pages[2];
+  assert(moved_page != NO_FILE_PAGE && inc->meta_page != NO_FILE_PAGE);
+  // only the page of the row and the description are written again
+  assert(execute("UPDATE \"inc\" SET \"v\" = 7 WHERE (\"id\" = 3500);"));
+  assert(inc->file_pages[3] == NO_FILE_PAGE && inc->file_pages[2] == kept_page);
+  assert(inc->meta_page == NO_FILE_PAGE);
+  assert(database.tables[0]->meta_page != NO_FILE_PAGE);
+  strcpy(save_inc, ".save inc.db");
+  assert(execute(save_inc));
+  assert(inc->file_pages[3] != moved_page && inc->file_pages[2] == kept_page);
+  assert(stat("inc.db", &inc_stat) == 0);
+  assert(inc_stat.st_size == full_size + 3 * PAGER_PAGE_SIZE);
+  // the pages of the previous save are reused by the next one
+  assert(execute("UPDATE \"inc\" SET \"v\" = 8 WHERE (\"id\" = 3501);"));
+  strcpy(save_inc, ".save inc.db");
+  assert(execute(save_inc));
+  assert(inc->file_pages[3] == moved_page);
+  assert(stat("inc.db", &inc_stat) == 0);
+  assert(inc_stat.st_size == full_size + 3 * PAGER_PAGE_SIZE);
+  size_t nb_saved_tables = database.nb_tables;
+  char open_inc[] = ".open inc.db";
+  assert(execute(open_inc));
+  assert(database.nb_tables == nb_saved_tables);
+  inc = find_table_from_name(&database, "\"inc\"");
+  assert(inc->file_pages[3] == moved_page);
+  assert(execute("SELECT * FROM \"inc\" WHERE (\"v\" > 6);"));
+  char* inc_page = pin_row(inc, 3501);
+  assert(get_int(inc, inc_page, 3501, 0) == 3501 &&
+         get_int(inc, inc_page, 3501, 1) == 8);
+  unpin_row(inc, 3501, false);
+  close_request_log();
+
+  printf("\n\nZONE MAPS\n\n");
+  assert(execute("CREATE TABLE \"zm\" (\"id\" int pk, \"ts\" int, "
+                 "\"price\" float, \"label\" varchar(8));"));
+  table_data* zm = find_table_from_name(&database, "\"zm\"");
+  assert(zm->rows_per_page == 512);
+  for (long i = 0; i < 3000; i++) {
+    snprintf(request, MAXFORMAT,
+             "INSERT INTO \"zm\" VALUES (%ld, %ld, %ld.5, 'l%ld');", i, i,
+             i, i / 512);
+    assert(execute(request));
+  }
+  zone* ts_zone = get_zone(zm, 600, 1);
+  assert(ts_zone->min.i == 512 && ts_zone->max.i == 1023);
+  ast_node ts_column = {COLNAME, 1, "\"ts\"", 0, 0, NULL, NULL};
+  ast_node ts_value = {INT, 1, "2500", 2500, 0, NULL, NULL};
+  ast_node ts_above = {COMP, 1, ">", 0, 0, &ts_column, &ts_value};
+  assert(!may_match_page(zm, 0, &ts_above));
+  assert(may_match_page(zm, 4, &ts_above));
+  // the literal on the left, 2500 < "ts"
+  ast_node ts_flipped = {COMP, 1, "<", 0, 0, &ts_value, &ts_column};
+  assert(!may_match_page(zm, 3, &ts_flipped));
+  ast_node label_column = {COLNAME, 1, "\"label\"", 0, 0, NULL, NULL};
+  ast_node label_value = {STRING, 1, "'l3'", 0, 0, NULL, NULL};
+  ast_node label_equal = {COMP, 1, "=", 0, 0, &label_column, &label_value};
+  assert(!may_match_page(zm, 2, &label_equal) &&
+         may_match_page(zm, 3, &label_equal));
+  ast_node zm_or = {COMP, 1, "OR", 0, 0, &label_equal, &ts_above};
+  assert(may_match_page(zm, 3, &zm_or) && !may_match_page(zm, 0, &zm_or));
+  // an update widens the zone, skipped pages hold no matching row
+  assert(execute("UPDATE \"zm\" SET \"ts\" = 5000 WHERE (\"id\" = 7);"));
+  assert(get_zone(zm, 7, 1)->max.i == 5000);
+  assert(may_match_page(zm, 0, &ts_above));
+  assert(execute(
+      "UPDATE \"zm\" SET \"price\" = 0.5 WHERE (\"ts\" > 2900);"));
+  assert(execute(
+      "UPDATE \"zm\" SET \"label\" = 'x' WHERE (\"price\" < 1.0);"));
+  for (size_t row_index = 0; row_index < zm->nb_rows; row_index++) {
+    char label[8];
+    char* zm_page = pin_row(zm, row_index);
+    read_declared_value(zm, zm_page, row_index, 3, label);
+    unpin_row(zm, row_index, false);
+    bool is_updated = row_index == 0 || row_index == 7 || row_index > 2900;
+    assert((strcmp(label, "'x'") == 0) == is_updated);
+  }
+  // compaction makes the zones exact again
+  assert(execute("DELETE FROM \"zm\" WHERE (\"ts\" < 1024);"));
+  assert(execute("VACUUM \"zm\";"));
+  // the "ts" of "id" 7 is 5000, it stays in page 0
+  assert(get_zone(zm, 0, 1)->min.i == 1024);
+  assert(get_zone(zm, 512, 1)->min.i == 1535);
+  assert(get_zone(zm, 512, 1)->max.i == 2046);
+  table_data* zm_read = reload_table(zm, "zm.b");
+  assert(memcmp(zm_read->zones, zm->zones,
+                sizeof(zone) * zm->nb_pages * zm->schema->nb_attr) == 0);
+  destroy_table(zm_read);
+  free(zm_read);
+  // the pages skipped for 2500 < "ts" hold no row the program keeps
+  assert(execute("UPDATE \"zm\" SET \"label\" = 'y' WHERE (2500 < \"ts\");"));
+  size_t nb_labelled = 0;
+  for (size_t row_index = 0; row_index < zm->nb_rows; row_index++) {
+    char label[8];
+    char* zm_page = pin_row(zm, row_index);
+    read_declared_value(zm, zm_page, row_index, 3, label);
+    unpin_row(zm, row_index, false);
+    nb_labelled += strcmp(label, "'y'") == 0;
+  }
+  // "ts" 2501 to 2999, and 5000
+  assert(nb_labelled == 500);
+
+  printf("\n\nBLOOM FILTERS\n\n");
+  assert(execute(
+      "CREATE TABLE \"bf\" (\"id\" int pk, \"email\" varchar(24));"));
+  table_data* bf = find_table_from_name(&database, "\"bf\"");
+  // the emails are shuffled, their zones cover every page
+  for (long i = 0; i < 4000; i++) {
+    snprintf(request, MAXFORMAT,
+             "INSERT INTO \"bf\" VALUES (%ld, 'm%ld_at_x');", i,
+             i * 7919 % 4000);
+    assert(execute(request));
+  }
+  assert(
+      !execute("CREATE INDEX \"bf_e\" ON \"bf\" (\"email\") USING BLUM;"));
+  assert(execute(
+      "CREATE INDEX \"bf_e\" ON \"bf\" (\"email\") USING BLOOM;"));
+  bloom* filters = bf->indexes[0]->filters;
+  assert(bf->nb_pages > 4 && filters->nb_filters == bf->nb_pages);
+  ast_node email_column = {COLNAME, 1, "\"email\"", 0, 0, NULL, NULL};
+  ast_node email_value = {STRING, 1, "'m7919_at_x'", 0, 0, NULL, NULL};
+  ast_node email_equal = {COMP, 1, "=", 0, 0, &email_column, &email_value};
+  size_t nb_matching = 0;
+  for (size_t index_page = 0; index_page < bf->nb_pages; index_page++) {
+    nb_matching += may_match_page(bf, index_page, &email_equal);
+  }
+  // no row has this email, only false positives are scanned
+  assert(nb_matching <= 2);
+  // the email of the row 1
+  ast_node email_found = {STRING, 1, "'m3919_at_x'", 0, 0, NULL, NULL};
+  email_equal.right = &email_found;
+  assert(may_match_page(bf, 0, &email_equal));
+  // inserted and updated values are added to the filters
+  assert(execute("INSERT INTO \"bf\" VALUES (4000, 'late');"));
+  assert(filters->nb_filters == bf->nb_pages);
+  assert(execute(
+      "UPDATE \"bf\" SET \"email\" = 'moved' WHERE (\"id\" = 2);"));
+  assert(execute(
+      "UPDATE \"bf\" SET \"id\" = 5000 WHERE (\"email\" = 'moved');"));
+  assert(execute(
+      "UPDATE \"bf\" SET \"id\" = 5001 WHERE (\"email\" = 'late');"));
+  char* bf_page = pin_row(bf, 2);
+  assert(*(long*)get_field(bf, bf_page, 2, 0) == 5000);
+  unpin_row(bf, 2, false);
+  bf_page = pin_row(bf, 4000);
+  assert(*(long*)get_field(bf, bf_page, 4000, 0) == 5001);
+  unpin_row(bf, 4000, false);
+  table_data* bf_read = reload_table(bf, "bf.b");
+  bloom* filters_read = bf_read->indexes[0]->filters;
+  assert(filters_read->nb_filters == filters->nb_filters);
+  assert(memcmp(filters_read->words, filters->words,
+                sizeof(uint32_t) * bloom_nb_words(filters)) == 0);
+  destroy_table(bf_read);
+  free(bf_read);
+  // compaction refills the filters of the remaining pages
+  assert(execute("DELETE FROM \"bf\" WHERE (\"id\" > 999);"));
+  assert(execute("VACUUM \"bf\";"));
+  assert(bf->nb_rows == 999 && filters->nb_filters == bf->nb_pages);
+  ast_node email_moved = {STRING, 1, "'moved'", 0, 0, NULL, NULL};
+  email_equal.right = &email_moved;
+  assert(!may_match_page(bf, 0, &email_equal));
+  email_equal.right = &email_found;
+  assert(may_match_page(bf, 0, &email_equal));
+  assert(execute("DROP INDEX \"bf_e\";"));
+
+  printf("\n\nCATALOG\n\n");
+  // a name isn't the prefix of another one
+  assert(execute("CREATE TABLE \"t2\" (\"id\" int pk);"));
+  assert(find_table_from_name(&database, "\"t\"") == NULL);
+  assert(execute("CREATE TABLE \"t\" (\"id\" int pk);"));
+  table_data* t2 = find_table_from_name(&database, "\"t2\"");
+  assert(strcmp(t2->schema->name, "\"t2\"") == 0);
+  size_t nb_before = database.nb_tables;
+  for (long i = 0; i < 300; i++) {
+    snprintf(request, MAXFORMAT, "CREATE TABLE \"many_%ld\" (\"id\" int pk);",
+             i);
+    assert(execute(request));
+  }
+  assert(database.nb_tables == nb_before + 300);
+  // the last table takes the place of a dropped one, tables don't move
+  table_data* last = database.tables[database.nb_tables - 1];
+  assert(execute("DROP TABLE \"t\";"));
+  assert(!execute("DROP TABLE \"t\";"));
+  assert(find_table_from_name(&database, "\"t\"") == NULL);
+  assert(find_table_from_name(&database, "\"t2\"") == t2);
+  assert(find_table_from_name(&database, "\"many_299\"") == last);
+  for (long i = 0; i < 300; i += 2) {
+    snprintf(request, MAXFORMAT, "DROP TABLE \"many_%ld\";", i);
+    assert(execute(request));
+  }
+  for (long i = 0; i < 300; i++) {
+    snprintf(request, MAXFORMAT, "\"many_%ld\"", i);
+    assert((find_table_from_name(&database, request) == NULL) == (i % 2 == 0));
+  }
+  assert(database.nb_tables == nb_before + 149);
+
+  printf("\n\nLAZY OPEN\n\n");
+  size_t nb_zm_rows = zm->nb_rows;
+  size_t nb_lazy_tables = database.nb_tables;
+  char save_lazy[] = ".save lazy.db";
+  assert(execute(save_lazy));
+  char open_lazy[] = ".open lazy.db";
+  assert(execute(open_lazy));
+  // only the directory is read
+  assert(database.nb_tables == nb_lazy_tables && database.file != NULL);
+  for (size_t i = 0; i < database.nb_tables; i++) {
+    assert(database.tables[i] == NULL && database.places[i] != NULL);
+  }
+  size_t zm_position;
+  assert(find_table_position(&database, "\"zm\"", &zm_position));
+  assert(database.tables[zm_position] == NULL);
+  zm = find_table_from_name(&database, "\"zm\"");
+  assert(database.tables[zm_position] == zm && zm->nb_rows == nb_zm_rows);
+  assert(execute("SELECT * FROM \"zm\" WHERE (\"id\" = 2000);"));
+  // the table of an index is read to drop it
+  size_t kv_position;
+  assert(find_table_position(&database, "\"kv\"", &kv_position));
+  assert(execute("DROP INDEX \"kv_v\";"));
+  assert(database.tables[kv_position] != NULL);
+  assert(execute("DROP TABLE \"many_1\";"));
+  assert(execute("UPDATE \"zm\" SET \"ts\" = 1 WHERE (\"id\" = 2000);"));
+  // the tables which weren't read keep their pages in the file
+  strcpy(save_lazy, ".save lazy.db");
+  assert(execute(save_lazy));
+  strcpy(open_lazy, ".open lazy.db");
+  assert(execute(open_lazy));
+  assert(database.nb_tables == nb_lazy_tables - 1);
+  size_t nb_read = 0;
+  for (size_t i = 0; i < database.nb_tables; i++) {
+    nb_read += database.tables[i] != NULL;
+  }
+  assert(nb_read == 0);
+  zm = find_table_from_name(&database, "\"zm\"");
+  assert(zm->nb_rows == nb_zm_rows);
+  table_data* lazy_kv = find_table_from_name(&database, "\"kv\"");
+  assert(lazy_kv->nb_indexes == 1);
+  assert(find_table_from_name(&database, "\"many_1\"") == NULL);
+  table_data* lazy_pk = find_table_from_name(&database, "\"pk\"");
+  assert(lazy_pk != NULL && execute("SELECT * FROM \"pk\";"));
+
+  printf("\n\nBACKGROUND SAVE\n\n");
+  assert(execute("INSERT INTO \"zm\" VALUES (9000, 1, 1.5, 'before');"));
+  char bgsave[] = ".bgsave bg.db";
+  assert(execute(bgsave));
+  // stopped, the save is still running
+  kill(bgsave_pid, SIGSTOP);
+  char other_bgsave[] = ".bgsave other.db";
+  assert(!execute(other_bgsave));
+  char bgsave_status[] = ".bgsave";
+  assert(execute(bgsave_status));
+  char* after_fork = "INSERT INTO \"zm\" VALUES (9001, 1, 1.5, 'after');";
+  assert(execute(after_fork));
+  size_t nb_bg_rows = zm->nb_rows;
+  kill(bgsave_pid, SIGCONT);
+  wait_background_save();
+  assert(bgsave_pid == 0 && bgsave_nb_saved == bgsave_nb_tables);
+  // only the requests made after the fork are left in the log of the copy
+  assert(strcmp(logged_path, "bg.db") == 0);
+  assert(wal_size(request_log) == 2 * sizeof(uint32_t) + strlen(after_fork));
+  char open_bg[] = ".open bg.db";
+  assert(execute(open_bg));
+  zm = find_table_from_name(&database, "\"zm\"");
+  assert(zm->nb_rows == nb_bg_rows);
+
+  printf("\n\nCHECKSUMS\n\n");
+  char save_sums[] = ".save sums.db";
+  assert(execute(save_sums));
+  int sums_fd = open("sums.db", O_RDWR);
+  assert(sums_fd != -1);
+  unsigned char header_bytes[DATABASE_HEADER_SIZE];
+  assert(pread(sums_fd, header_bytes, sizeof(header_bytes), 0) ==
+         sizeof(header_bytes));
+  database_header sums_header;
+  assert(decode_header(&sums_header, header_bytes));
+  assert(sums_header.version == DATABASE_VERSION);
+  char open_sums[] = ".open sums.db";
+  assert(execute(open_sums));
+  // a damaged description: the table isn't read, the others are
+  assert(find_table_position(&database, "\"zm\"", &zm_position));
+  flip_file_byte(sums_fd,
+                 database.places[zm_position]->meta_page * PAGER_PAGE_SIZE);
+  assert(find_table_from_name(&database, "\"zm\"") == NULL);
+  assert(find_table_from_name(&database, "\"kv\"") != NULL);
+  char save_damaged[] = ".save damaged.db";
+  assert(!execute(save_damaged));
+  // it can still be dropped, it isn't read
+  assert(execute("DROP TABLE \"zm\";"));
+  // a damaged catalog or header: the file isn't opened
+  size_t nb_sums_tables = database.nb_tables;
+  size_t catalog_offset = sums_header.catalog_page * PAGER_PAGE_SIZE + 3;
+  flip_file_byte(sums_fd, catalog_offset);
+  strcpy(open_sums, ".open sums.db");
+  assert(!execute(open_sums));
+  flip_file_byte(sums_fd, catalog_offset);
+  flip_file_byte(sums_fd, 20);
+  strcpy(open_sums, ".open sums.db");
+  assert(!execute(open_sums));
+  flip_file_byte(sums_fd, 20);
+  // the log drops the damaged table again
+  strcpy(open_sums, ".open sums.db");
+  assert(execute(open_sums));
+  assert(database.nb_tables == nb_sums_tables);
+  assert(!find_table_position(&database, "\"zm\"", &zm_position));
+  close(sums_fd);
+
+  printf("\n\nSTATEMENT ARENA\n\n");
+  assert(execute("CREATE TABLE \"ar\" (\"id\" int pk, \"s\" varchar(8));"));
+  for (long i = 0; i < 5000; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"ar\" VALUES (%ld, 'a%ld');",
+             i, i % 7);
+    assert(execute(request));
+  }
+  // the rows are read in their pages, a scan allocates nothing per row and
+  // every statement reuses the same blocks
+  arena_destroy(statement_arena);
+  statement_arena = NULL;
+  char* scan = "SELECT \"id\" FROM \"ar\" WHERE (\"s\" = 'a9');";
+  assert(execute(scan));
+  size_t arena_bytes = arena_capacity(get_statement_arena());
+  assert(arena_bytes == ARENA_BLOCK_SIZE);
+  for (int i = 0; i < 20; i++) {
+    assert(execute(scan));
+    assert(execute("DELETE FROM \"ar\" WHERE (\"s\" = 'a9');"));
+    assert(execute("UPDATE \"ar\" SET \"s\" = 'b' WHERE (\"s\" = 'a9');"));
+  }
+  assert(arena_capacity(get_statement_arena()) == arena_bytes);
+
+  printf("\n\nCLUSTERED TABLES\n\n");
+  assert(!execute("CREATE TABLE \"bad\" (\"id\" int pk) CLUSTER = ROWS;"));
+  assert(execute(
+      "CREATE TABLE \"cl\" (\"id\" int pk, \"v\" int) CLUSTER = PK;"));
+  assert(execute("CREATE INDEX \"cl_v\" ON \"cl\" (\"v\") USING HASH;"));
+  table_data* cl = find_table_from_name(&database, "\"cl\"");
+  assert(cl != NULL && cl->is_clustered);
+  // scrambled keys, merged every page of rows
+  for (long i = 0; i < 3000; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"cl\" VALUES (%ld, %ld);",
+             (i * 7919) % 3000, i % 10);
+    assert(execute(request));
+  }
+  assert(cl->nb_sorted > 0 && cl->nb_rows - cl->nb_sorted < cl->rows_per_page);
+  // duplicates of a sorted key and of an appended one
+  assert(!execute("INSERT INTO \"cl\" VALUES (0, 1);"));
+  snprintf(request, MAXFORMAT, "INSERT INTO \"cl\" VALUES (%ld, 1);",
+           (2999 * 7919L) % 3000);
+  assert(!execute(request));
+  assert(execute("SELECT \"v\" FROM \"cl\" WHERE (\"id\" = 17);"));
+  assert(cl->nb_sorted == cl->nb_rows && cl->pk_index == NULL);
+  long cl_key;
+  for (size_t row_index = 0; row_index < cl->nb_rows; row_index++) {
+    read_pk(cl, row_index, (char*)&cl_key);
+    assert(cl_key == (long)row_index);
+  }
+  // the range is found by binary search, the rows moved by the merges are
+  // still found by the hash index
+  assert(execute("DELETE FROM \"cl\" WHERE ((\"id\" >= 100) AND "
+                 "(\"id\" < 200));"));
+  assert(count_live_rows(cl) == 2900);
+  size_t nb_v3 = 0;
+  for (hash_cursor c = hash_seek(get_index_hash(cl, cl->indexes[0]),
+                                 &(long){3});
+       hash_cursor_valid(&c); hash_cursor_next(&c)) {
+    size_t row_index = hash_cursor_row(&c);
+    char* page = pin_row(cl, row_index);
+    long v;
+    memcpy(&v, get_field(cl, page, row_index, 1), sizeof(long));
+    unpin_row(cl, row_index, false);
+    assert(!is_row_dead(cl, row_index) && v == 3);
+    nb_v3++;
+  }
+  assert(nb_v3 > 250 && nb_v3 <= 300);
+  // a smaller key and a moved key are merged by the next read
+  assert(execute("INSERT INTO \"cl\" VALUES (-1, 0);"));
+  assert(execute("UPDATE \"cl\" SET \"id\" = 5000 WHERE (\"id\" = 0);"));
+  assert(!execute("UPDATE \"cl\" SET \"id\" = 5000 WHERE (\"id\" = 1);"));
+  assert(execute("SELECT \"id\" FROM \"cl\" WHERE (\"id\" > 2990);"));
+  read_pk(cl, 0, (char*)&cl_key);
+  assert(cl_key == -1);
+  read_pk(cl, 1, (char*)&cl_key);
+  assert(cl_key == 1);
+  read_pk(cl, cl->nb_rows - 1, (char*)&cl_key);
+  assert(cl_key == 5000);
+  size_t cl_owner;
+  assert(find_pk_owner(cl, &(long){150}, NULL) == false);
+  assert(find_pk_owner(cl, &(long){2500}, &cl_owner));
+  read_pk(cl, cl_owner, (char*)&cl_key);
+  assert(cl_key == 2500);
+  // the order is saved with the table
+  table_data* cl_read = reload_table(cl, "test_clustered.db");
+  assert(cl_read->is_clustered && cl_read->nb_sorted == cl_read->nb_rows);
+  assert(cl_read->nb_rows == count_live_rows(cl));
+  destroy_table(cl_read);
+  remove("test_clustered.db");
+  // strings are ordered by their bytes
+  assert(execute("CREATE TABLE \"cls\" (\"name\" varchar(24) pk, \"n\" int) "
+                 "CLUSTER = PK;"));
+  assert(execute("INSERT INTO \"cls\" VALUES ('pear_with_long_name', 1);"));
+  assert(execute("INSERT INTO \"cls\" VALUES ('apple', 2);"));
+  assert(execute("INSERT INTO \"cls\" VALUES ('fig', 3);"));
+  assert(execute("SELECT * FROM \"cls\";"));
+  table_data* cls = find_table_from_name(&database, "\"cls\"");
+  char name[24];
+  read_pk(cls, 0, name);
+  assert(strcmp(name, "'apple'") == 0);
+  read_pk(cls, 2, name);
+  assert(strcmp(name, "'pear_with_long_name'") == 0);
+  char fig[24] = "'fig'";
+  assert(find_pk_owner(cls, fig, &cl_owner) && cl_owner == 1);
+  // the appended rows grow with the table, they're found by a skip list
+  assert(execute("CREATE TABLE \"cg\" (\"id\" int pk, \"v\" int) "
+                 "CLUSTER = PK;"));
+  table_data* cg = find_table_from_name(&database, "\"cg\"");
+  for (long i = 0; i < 9500; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"cg\" VALUES (%ld, 0);",
+             (i * 7919) % 9500);
+    assert(execute(request));
+  }
+  assert(cg->nb_rows - cg->nb_sorted > cg->rows_per_page);
+  assert(cg->appended->nb_entries == cg->nb_rows - cg->nb_sorted);
+  snprintf(request, MAXFORMAT, "INSERT INTO \"cg\" VALUES (%ld, 1);",
+           (9499 * 7919L) % 9500);
+  assert(!execute(request));
+  assert(execute("SELECT \"v\" FROM \"cg\" WHERE (\"id\" = 9499);"));
+  assert(cg->nb_sorted == cg->nb_rows && cg->appended == NULL);
+  // the literal on the left narrows the sorted rows like the rows are kept
+  assert(execute("DELETE FROM \"cg\" WHERE (9000 <= \"id\");"));
+  assert(count_live_rows(cg) == 9000);
+  // a merge moves deleted rows whose strings were left out of the heap
+  assert(execute("CREATE TABLE \"k\" (\"a\" int pk, \"c\" varchar(32)) "
+                 "CLUSTER = PK;"));
+  for (long i = 1; i <= 4; i++) {
+    snprintf(request, MAXFORMAT,
+             "INSERT INTO \"k\" VALUES (%ld, 'a_string_long_enough_%04ld');",
+             i, i);
+    assert(execute(request));
+  }
+  assert(execute("DELETE FROM \"k\" WHERE (\"a\" = 4);"));
+  assert(execute("UPDATE \"k\" SET \"c\" = 'x' WHERE (\"a\" < 4);"));
+  assert(execute("UPDATE \"k\" SET \"a\" = 0 WHERE (\"a\" = 3);"));
+  table_data* kt = find_table_from_name(&database, "\"k\"");
+  read_pk(kt, 0, (char*)&cl_key);
+  assert(cl_key == 0 && count_live_rows(kt) == 3);
+
+  printf("\n\nLSM TABLES\n\n");
+  assert(!execute("CREATE TABLE \"bad\" (\"id\" int pk) ENGINE = ROWS;"));
+  assert(!execute("CREATE TABLE \"bad\" (\"id\" int pk) ENGINE = LSM "
+                  "CLUSTER = PK;"));
+  assert(execute(
+      "CREATE TABLE \"lsm\" (\"id\" int pk, \"v\" int) ENGINE = LSM;"));
+  assert(execute("CREATE INDEX \"lsm_v\" ON \"lsm\" (\"v\");"));
+  table_data* lsm = find_table_from_name(&database, "\"lsm\"");
+  assert(lsm != NULL && lsm->lsm != NULL);
+  long nb_lsm_keys = 20000;
+  for (long i = 0; i < nb_lsm_keys; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"lsm\" VALUES (%ld, %ld);",
+             (i * 7919) % nb_lsm_keys, i % 10);
+    assert(execute(request));
+  }
+  // runs of decreasing sizes, the last rows are in the memtable
+  lsm_tree* runs = lsm->lsm;
+  assert(runs->nb_runs >= 1 && runs->nb_runs <= 4);
+  assert(lsm->nb_rows - runs->nb_flushed ==
+         (size_t)(nb_lsm_keys % LSM_MEMTABLE_ROWS));
+  assert(get_memtable(lsm)->nb_entries ==
+         (size_t)(nb_lsm_keys % LSM_MEMTABLE_ROWS));
+  long lsm_key;
+  long previous_key = 0;
+  for (size_t i = 0; i < runs->nb_runs; i++) {
+    sorted_run* run = &runs->runs[i];
+    assert(i == 0 || run->nb_rows * 2 < runs->runs[i - 1].nb_rows);
+    for (size_t row_index = run->first; row_index < run->first + run->nb_rows;
+         row_index++) {
+      read_pk(lsm, row_index, (char*)&lsm_key);
+      assert(row_index == run->first || lsm_key > previous_key);
+      previous_key = lsm_key;
+    }
+  }
+  assert(lsm->pk_index == NULL);
+  // keys of a run and of the memtable
+  assert(!execute("INSERT INTO \"lsm\" VALUES (0, 1);"));
+  snprintf(request, MAXFORMAT, "INSERT INTO \"lsm\" VALUES (%ld, 1);",
+           ((nb_lsm_keys - 1) * 7919) % nb_lsm_keys);
+  assert(!execute(request));
+  for (lsm_key = 0; lsm_key < nb_lsm_keys; lsm_key += 7) {
+    size_t lsm_owner;
+    assert(find_pk_owner(lsm, &lsm_key, &lsm_owner));
+    assert(is_pk_of_row(lsm, lsm_owner, &lsm_key));
+  }
+  assert(!find_pk_owner(lsm, &(long){-5}, NULL));
+  // the range is found in each run, the moved rows are in the index
+  assert(execute("DELETE FROM \"lsm\" WHERE ((\"id\" >= 100) AND "
+                 "(\"id\" < 200));"));
+  assert(count_live_rows(lsm) == (size_t)nb_lsm_keys - 100);
+  assert(!find_pk_owner(lsm, &(long){150}, NULL));
+  size_t nb_indexed = 0;
+  for (btree_cursor c = btree_seek(find_column_index(lsm, 1), &(long){3});
+       btree_cursor_valid(&c) && *(const long*)btree_cursor_key(&c) == 3;
+       btree_cursor_next(&c)) {
+    size_t row_index = btree_cursor_row(&c);
+    char* page = pin_row(lsm, row_index);
+    long v;
+    memcpy(&v, get_field(lsm, page, row_index, 1), sizeof(long));
+    unpin_row(lsm, row_index, false);
+    assert(!is_row_dead(lsm, row_index) && v == 3);
+    nb_indexed++;
+  }
+  assert(nb_indexed == 1990);
+  // updated keys of a run and of the memtable
+  assert(execute("UPDATE \"lsm\" SET \"id\" = 50000 WHERE (\"id\" = 0);"));
+  snprintf(request, MAXFORMAT,
+           "UPDATE \"lsm\" SET \"id\" = 50001 WHERE (\"id\" = %ld);",
+           ((nb_lsm_keys - 1) * 7919) % nb_lsm_keys);
+  assert(execute(request));
+  assert(!execute("UPDATE \"lsm\" SET \"id\" = 50000 WHERE (\"id\" = 1);"));
+  assert(find_pk_owner(lsm, &(long){50000}, NULL));
+  assert(find_pk_owner(lsm, &(long){50001}, NULL));
+  assert(!find_pk_owner(lsm, &(long){0}, NULL));
+  for (size_t i = 0; i < runs->nb_runs; i++) {
+    assert(runs->runs[i].is_sorted);
+  }
+  // the runs are saved, their fences and filters are built again
+  table_data* lsm_read = reload_table(lsm, "test_lsm.db");
+  assert(lsm_read->lsm != NULL && lsm_read->lsm->nb_runs == runs->nb_runs);
+  assert(count_live_rows(lsm_read) == count_live_rows(lsm));
+  assert(find_pk_owner(lsm_read, &(long){50000}, NULL));
+  assert(find_pk_owner(lsm_read, &(long){12345}, NULL));
+  assert(!find_pk_owner(lsm_read, &(long){150}, NULL));
+  destroy_table(lsm_read);
+  remove("test_lsm.db");
+  assert(execute("DELETE FROM \"lsm\";"));
+  assert(runs->nb_runs == 0 && runs->nb_flushed == 0);
+  assert(execute("INSERT INTO \"lsm\" VALUES (7, 7);"));
+  assert(find_pk_owner(lsm, &(long){7}, NULL));
+  // the same for a run
+  assert(execute("CREATE TABLE \"lk\" (\"a\" int pk, \"c\" varchar(32)) "
+                 "ENGINE = LSM;"));
+  for (long i = 1; i <= LSM_MEMTABLE_ROWS; i++) {
+    snprintf(request, MAXFORMAT,
+             "INSERT INTO \"lk\" VALUES (%ld, 'a_string_long_enough_%04ld');",
+             i, i % 10000);
+    assert(execute(request));
+  }
+  table_data* lk = find_table_from_name(&database, "\"lk\"");
+  assert(lk->lsm->nb_runs == 1);
+  assert(execute("DELETE FROM \"lk\" WHERE (\"a\" = 4);"));
+  assert(execute("UPDATE \"lk\" SET \"c\" = 'x' WHERE (\"a\" != 4);"));
+  assert(execute("UPDATE \"lk\" SET \"a\" = 0 WHERE (\"a\" = 3);"));
+  assert(lk->lsm->runs[0].is_sorted);
+  assert(find_pk_owner(lk, &(long){0}, NULL));
+  assert(count_live_rows(lk) == LSM_MEMTABLE_ROWS - 1);
+  printf("\n\nWHERE PROGRAMS\n\n");
+  assert(execute("CREATE TABLE \"wp\" (\"id\" int pk, \"f\" float, \"s\" "
+                 "varchar(8), \"t\" varchar(64), \"c\" varchar(8) DICT);"));
+  table_data* wp = find_table_from_name(&database, "\"wp\"");
+  for (long i = 0; i < 3000; i++) {
+    snprintf(request, MAXFORMAT,
+             "INSERT INTO \"wp\" VALUES (%ld, %ld.5, 's%ld', "
+             "'a_long_text_%ld', 'c%ld');",
+             i, i, i % 5, i % 3, i % 4);
+    assert(execute(request));
+  }
+  char wp_request[] =
+      "SELECT \"id\" FROM \"wp\" WHERE (((\"id\" < 100) AND (\"s\" = 's1')) "
+      "OR (\"t\" = 'a_long_text_2'));";
+  arena* wp_arena = get_statement_arena();
+  token** wp_tokens =
+      (token**)arena_alloc(wp_arena, sizeof(token*) * MAXTOKEN);
+  size_t nb_wp_tokens = lexer(wp_arena, wp_request, wp_tokens);
+  ast_node* wp_query = parse_statement(wp_arena, wp_tokens, &nb_wp_tokens);
+  assert(wp_query != NULL);
+  where_program* wp_program =
+      compile_where(wp, get_where_condition(wp_query->right));
+  // the comparisons are in order, the jumps skip the right side
+  assert(wp_program->nb_instructions == 5);
+  assert(wp_program->code[0].op == WHERE_INT_LT);
+  assert(wp_program->code[1].op == WHERE_JUMP_FALSE &&
+         wp_program->code[1].offset == 3);
+  assert(wp_program->code[2].op == WHERE_CHR_EQ);
+  assert(wp_program->code[3].op == WHERE_JUMP_TRUE &&
+         wp_program->code[3].offset == 5);
+  assert(wp_program->code[4].op == WHERE_REF_EQ);
+  size_t nb_wp_expected = 0;
+  for (long id = 0; id < 3000; id++) {
+    nb_wp_expected += (id < 100 && id % 5 == 1) || id % 3 == 2;
+  }
+  // the rows kept by each side of the OR are merged in order
+  row_cursor wp_cursor = open_row_cursor(wp, NULL);
+  row_batch wp_batch;
+  size_t nb_wp_kept = 0;
+  while (next_batch(&wp_cursor, &wp_batch)) {
+    filter_batch(wp_program, wp, &wp_batch);
+    for (size_t i = 0; i < wp_batch.nb_rows; i++) {
+      long id = (long)wp_batch.rows[i];
+      assert((id < 100 && id % 5 == 1) || id % 3 == 2);
+      assert(i == 0 || wp_batch.rows[i - 1] < wp_batch.rows[i]);
+    }
+    nb_wp_kept += wp_batch.nb_rows;
+    unpin_batch(wp, &wp_batch);
+  }
+  close_row_cursor(&wp_cursor);
+  assert(nb_wp_kept == nb_wp_expected);
+  assert(execute("DELETE FROM \"wp\" WHERE (((\"id\" < 100) AND (\"s\" = "
+                 "'s1')) OR (\"t\" = 'a_long_text_2'));"));
+  assert(count_live_rows(wp) == 3000 - nb_wp_kept);
+  assert(execute("DELETE FROM \"wp\" WHERE ((\"f\" < 10.0) OR "
+                 "(\"c\" = 'c3'));"));
+  assert(execute("DELETE FROM \"wp\" WHERE (\"c\" = 'c9');"));
+  for (size_t row_index = 0; row_index < wp->nb_rows; row_index++) {
+    if (is_row_dead(wp, row_index)) {
+      continue;
+    }
+    char* page = pin_row(wp, row_index);
+    long id;
+    memcpy(&id, get_field(wp, page, row_index, 0), sizeof(long));
+    unpin_row(wp, row_index, false);
+    assert(id >= 10 && id % 4 != 3 && id % 3 != 2);
+  }
+  // errors are found before the first row
+  assert(!execute("SELECT * FROM \"wp\" WHERE (\"nope\" = 1);"));
+  assert(!execute("UPDATE \"wp\" SET \"f\" = 1.0 WHERE (\"s\" < 's1');"));
+  assert(!execute("DELETE FROM \"wp\" WHERE (\"s\" = 3);"));
+  printf("\n\nBATCHES\n\n");
+  assert(execute("CREATE TABLE \"bt\" (\"id\" int pk);"));
+  table_data* bt = find_table_from_name(&database, "\"bt\"");
+  assert(bt->rows_per_page > BATCH_ROWS);
+  for (long i = 0; i < 5000; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"bt\" VALUES (%ld);", i);
+    assert(execute(request));
+  }
+  assert(execute("DELETE FROM \"bt\" WHERE ((\"id\" > 1000) AND "
+                 "(\"id\" <= 1100));"));
+  // a batch holds the rows of a page, at most BATCH_ROWS of them
+  row_cursor bt_cursor = open_row_cursor(bt, NULL);
+  row_batch bt_batch;
+  size_t nb_bt_rows = 0;
+  size_t nb_bt_batches = 0;
+  while (next_batch(&bt_cursor, &bt_batch)) {
+    assert(bt_batch.nb_rows > 0 && bt_batch.nb_rows <= BATCH_ROWS);
+    for (size_t i = 0; i < bt_batch.nb_rows; i++) {
+      assert(bt_batch.rows[i] / bt->rows_per_page == bt_batch.index_page);
+      assert(!is_row_dead(bt, bt_batch.rows[i]));
+    }
+    nb_bt_rows += bt_batch.nb_rows;
+    nb_bt_batches++;
+    unpin_batch(bt, &bt_batch);
+  }
+  close_row_cursor(&bt_cursor);
+  assert(nb_bt_rows == 4900 && nb_bt_batches == 5);
+  // a statement stops at the first error, its batch is released
+  assert(!execute("UPDATE \"bt\" SET \"id\" = 7 WHERE (\"id\" > 4000);"));
+  assert(execute("UPDATE \"bt\" SET \"id\" = 9000 WHERE (\"id\" = 4000);"));
+  assert(execute("SELECT * FROM \"bt\" WHERE ((\"id\" < 3) OR "
+                 "(\"id\" > 8999));"));
+  assert(execute("DELETE FROM \"bt\" WHERE ((\"id\" < 2048) OR "
+                 "(\"id\" >= 4096));"));
+  assert(count_live_rows(bt) == 2047);
+  printf("\n\nFLOAT COMPARISONS\n\n");
+  assert(execute("CREATE TABLE \"fc\" (\"id\" int pk, \"f\" float);"));
+  table_data* fc = find_table_from_name(&database, "\"fc\"");
+  for (long i = 0; i < 3000; i++) {
+    snprintf(request, MAXFORMAT, "INSERT INTO \"fc\" VALUES (%ld, %ld.5);",
+             i, i % 40);
+    assert(execute(request));
+  }
+  // every comparison of floats, the kernels and the scalar tail agree
+  assert(execute("DELETE FROM \"fc\" WHERE (\"f\" <= 9.5);"));
+  assert(count_live_rows(fc) == 2250);
+  assert(execute("DELETE FROM \"fc\" WHERE (\"f\" >= 30.5);"));
+  assert(count_live_rows(fc) == 1500);
+  assert(execute("DELETE FROM \"fc\" WHERE (\"f\" = 20.5);"));
+  assert(count_live_rows(fc) == 1425);
+  assert(execute("DELETE FROM \"fc\" WHERE ((\"f\" != 15.5) AND "
+                 "(\"id\" < 40));"));
+  assert(count_live_rows(fc) == 1407);
+  assert(execute("UPDATE \"fc\" SET \"f\" = 0.5 WHERE ((\"f\" > 28.5) OR "
+                 "(\"f\" <= 10.5));"));
+  assert(execute("DELETE FROM \"fc\" WHERE (\"f\" < 1.0);"));
+  // 29.5 and 10.5, but the rows of the first 40 ids were deleted
+  assert(count_live_rows(fc) == 1407 - 74 * 2);
+
+  printf("\n\nSTRING FILTERS\n\n");
+  assert(execute("CREATE TABLE \"sf\" (\"id\" int pk, \"c\" varchar(6), "
+                 "\"r\" varchar(30), \"d\" varchar(8) DICT);"));
+  table_data* sf = find_table_from_name(&database, "\"sf\"");
+  for (long i = 0; i < 3000; i++) {
+    snprintf(request, MAXFORMAT,
+             i % 2 ? "INSERT INTO \"sf\" VALUES (%ld, 'c%ld', 'short_%ld', "
+                     "'d%ld');"
+                   : "INSERT INTO \"sf\" VALUES (%ld, 'c%ld', "
+                     "'a_much_longer_title_%ld', 'd%ld');",
+             i, i % 7, i % 5, i % 4);
+    assert(execute(request));
+  }
+  // only =, != and a prefix
+  assert(!execute("DELETE FROM \"sf\" WHERE (\"c\" < 'c3');"));
+  assert(!execute("DELETE FROM \"sf\" WHERE (\"r\" LIKE 'a_much%');"));
+  assert(!execute("DELETE FROM \"sf\" WHERE (\"r\" LIKE '%title');"));
+  assert(count_live_rows(sf) == 3000);
+  // strings in the rows
+  assert(execute("DELETE FROM \"sf\" WHERE (\"c\" = 'c3');"));
+  assert(count_live_rows(sf) == 2571);
+  assert(execute("DELETE FROM \"sf\" WHERE (\"c\" LIKE 'c6%');"));
+  assert(count_live_rows(sf) == 2143);
+  // longer than the field: nothing matches
+  assert(execute("DELETE FROM \"sf\" WHERE ((\"c\" LIKE 'c1234567%') OR "
+                 "(\"c\" = 'c1234567'));"));
+  assert(count_live_rows(sf) == 2143);
+  // out of line varchars, a prefix longer than the header is checked in full
+  assert(execute("DELETE FROM \"sf\" WHERE ((\"r\" LIKE 'short%') AND "
+                 "(\"c\" != 'c0'));"));
+  assert(count_live_rows(sf) == 1286);
+  assert(execute("DELETE FROM \"sf\" WHERE ((\"d\" LIKE 'd1%') OR "
+                 "(\"r\" = 'a_much_longer_title_2'));"));
+  assert(count_live_rows(sf) == 964);
+  assert(execute("DELETE FROM \"sf\" WHERE ((\"r\" != 'short_4') AND "
+                 "(\"d\" = 'd0'));"));
+  assert(count_live_rows(sf) == 535);
+  assert(execute("DELETE FROM \"sf\" WHERE (\"d\" != 'd2');"));
+  assert(count_live_rows(sf) == 428);
   return 0;
 }
@@ -1,11 +1,18 @@
 #ifndef _EXECUTER_H__
 
+#include <stdint.h>
+
+#include "bloom.h"
+#include "btree.h"
+#include "hash.h"
 #include "parser.h"
+#include "skiplist.h"
 
 typedef enum AttrKind {
   D_INT,  // long
   D_FLT,  // double
   D_CHR,  // char*
+  D_DICT, // char*, the row holds its code in the column dictionary
 } attr_kind;
 typedef struct {
   char* name;
@@ -17,12 +24,94 @@ typedef struct TableDesc {
   size_t nb_attr;
   attr_desc_size** descs;
 } table_desc;
+typedef enum TableLayout {
+  L_ROWS,
+  L_COLUMNS,
+} table_layout;
+typedef enum IndexKind {
+  I_BTREE,
+  I_HASH,
+  I_BLOOM,
+} index_kind;
+typedef struct TableIndex {
+  char* name;
+  size_t column;
+  index_kind kind;
+  btree* tree;
+  hash_index* hash;
+  bloom* filters;
+} table_index;
+typedef struct VarcharRef {
+  uint32_t length;
+  char prefix[4];
+  union {
+    char suffix[8];
+    uint64_t offset;
+  };
+} varchar_ref;
+typedef struct Dictionary {
+  size_t size;
+  size_t nb_values;
+  size_t capacity;
+  char* values;
+  hash_index* codes;
+} dictionary;
+typedef union ZoneValue {
+  long i;
+  double f;
+  char s[8];
+} zone_value;
+typedef struct Zone {
+  zone_value min;
+  zone_value max;
+} zone;
+typedef struct SortedRun {
+  size_t first;
+  size_t nb_rows;
+  bool is_sorted;
+  char* fences;
+  bloom* filter;
+} sorted_run;
+typedef struct LsmTree {
+  sorted_run* runs;
+  size_t nb_runs;
+  size_t runs_capacity;
+  size_t nb_flushed;
+  skiplist* memtable;
+} lsm_tree;
 typedef struct TableData {
   table_desc* schema;
   size_t nb_rows;
   size_t capacity;
   size_t row_size;
-  void* values;
+  table_layout layout;
+  bool is_clustered;
+  size_t nb_sorted;
+  skiplist* appended;
+  lsm_tree* lsm;
+  size_t* column_offsets;
+  size_t* column_strides;
+  size_t rows_per_page;
+  size_t nb_pages;
+  size_t pages_capacity;
+  size_t* pages;
+  btree* pk_index;
+  table_index** indexes;
+  size_t nb_indexes;
+  uint64_t* dead_rows;
+  size_t dead_words;
+  size_t nb_dead;
+  char* heap;
+  size_t heap_size;
+  size_t heap_capacity;
+  size_t heap_garbage;
+  dictionary** dictionaries;
+  size_t* file_pages;
+  uint32_t* page_checksums;
+  zone* zones;
+  size_t meta_page;
+  size_t meta_length;
+  uint32_t meta_checksum;
 } table_data;
 bool execute(char* request);
 void print_table(table_data* data);
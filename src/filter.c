@@ -0,0 +1,509 @@
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "filter.h"
+
+// Comparisons of a column of values with a literal, run by the scans on a
+// batch of rows. A kernel sets the bit of each value which matches in a
+// mask, 64 values per word. x86 processors compare 4 values at a time with
+// AVX2, 2 with SSE4.2, the others one by one. Every level gives the same
+// masks, floats compare like C: NaN is only different from every value.
+// Strings compare as windows of 16 bytes against a pattern, only the bytes
+// of a byte mask count: 2 windows at a time with AVX2, 1 with SSE4.2.
+
+static bool compare_long(filter_op op, long value, long literal) {
+  switch (op) {
+    case FILTER_EQ:
+      return value == literal;
+    case FILTER_NE:
+      return value != literal;
+    case FILTER_LT:
+      return value < literal;
+    case FILTER_LE:
+      return value <= literal;
+    case FILTER_GT:
+      return value > literal;
+    case FILTER_GE:
+      return value >= literal;
+  }
+  return false;
+}
+
+static bool compare_double(filter_op op, double value, double literal) {
+  switch (op) {
+    case FILTER_EQ:
+      return value == literal;
+    case FILTER_NE:
+      return value != literal;
+    case FILTER_LT:
+      return value < literal;
+    case FILTER_LE:
+      return value <= literal;
+    case FILTER_GT:
+      return value > literal;
+    case FILTER_GE:
+      return value >= literal;
+  }
+  return false;
+}
+
+// the values from first, the mask is cleared
+static void filter_longs_scalar(filter_op op,
+                                const long* values,
+                                size_t first,
+                                size_t nb_values,
+                                long literal,
+                                uint64_t* mask) {
+  for (size_t i = first; i < nb_values; i++) {
+    mask[i / 64] |= (uint64_t)compare_long(op, values[i], literal) << (i % 64);
+  }
+}
+
+static void filter_doubles_scalar(filter_op op,
+                                  const double* values,
+                                  size_t first,
+                                  size_t nb_values,
+                                  double literal,
+                                  uint64_t* mask) {
+  for (size_t i = first; i < nb_values; i++) {
+    mask[i / 64] |= (uint64_t)compare_double(op, values[i], literal)
+                    << (i % 64);
+  }
+}
+
+static bool window_matches(const char* window,
+                           const char* pattern,
+                           uint32_t byte_mask) {
+  for (size_t b = 0; b < FILTER_WINDOW; b++) {
+    if ((byte_mask >> b) & 1 && window[b] != pattern[b]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static void filter_windows_scalar(const char* const* windows,
+                                  size_t first,
+                                  size_t nb_windows,
+                                  const char* pattern,
+                                  uint32_t byte_mask,
+                                  uint64_t* mask) {
+  for (size_t i = first; i < nb_windows; i++) {
+    mask[i / 64] |= (uint64_t)window_matches(windows[i], pattern, byte_mask)
+                    << (i % 64);
+  }
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define FILTER_HAS_SIMD
+#include <immintrin.h>
+
+// Integers only have == and >, the other comparisons swap their operands or
+// negate the result.
+static bool is_swapped(filter_op op) {
+  return op == FILTER_LT || op == FILTER_GE;
+}
+
+static bool is_negated(filter_op op) {
+  return op == FILTER_NE || op == FILTER_LE || op == FILTER_GE;
+}
+
+// The kernels return the number of values they compared, a multiple of
+// their width. The scalar loop compares the others.
+__attribute__((target("avx2"))) static size_t filter_longs_avx2(
+    filter_op op,
+    const long* values,
+    size_t nb_values,
+    long literal,
+    uint64_t* mask) {
+  __m256i lit = _mm256_set1_epi64x(literal);
+  bool is_equality = op == FILTER_EQ || op == FILTER_NE;
+  uint64_t flip = is_negated(op) ? 0xf : 0;
+  size_t i = 0;
+  for (; i + 4 <= nb_values; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)(values + i));
+    __m256i cmp = is_equality      ? _mm256_cmpeq_epi64(v, lit)
+                  : is_swapped(op) ? _mm256_cmpgt_epi64(lit, v)
+                                   : _mm256_cmpgt_epi64(v, lit);
+    uint64_t bits =
+        (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(cmp)) ^ flip;
+    mask[i / 64] |= bits << (i % 64);
+  }
+  return i;
+}
+
+__attribute__((target("sse4.2"))) static size_t filter_longs_sse42(
+    filter_op op,
+    const long* values,
+    size_t nb_values,
+    long literal,
+    uint64_t* mask) {
+  __m128i lit = _mm_set1_epi64x(literal);
+  bool is_equality = op == FILTER_EQ || op == FILTER_NE;
+  uint64_t flip = is_negated(op) ? 0x3 : 0;
+  size_t i = 0;
+  for (; i + 2 <= nb_values; i += 2) {
+    __m128i v = _mm_loadu_si128((const __m128i*)(values + i));
+    __m128i cmp = is_equality      ? _mm_cmpeq_epi64(v, lit)
+                  : is_swapped(op) ? _mm_cmpgt_epi64(lit, v)
+                                   : _mm_cmpgt_epi64(v, lit);
+    uint64_t bits = (uint64_t)_mm_movemask_pd(_mm_castsi128_pd(cmp)) ^ flip;
+    mask[i / 64] |= bits << (i % 64);
+  }
+  return i;
+}
+
+// The predicate of a float comparison is an immediate, each one has its
+// loop.
+#define FILTER_DOUBLES_AVX2(predicate)                                 \
+  for (; i + 4 <= nb_values; i += 4) {                                 \
+    __m256d v = _mm256_loadu_pd(values + i);                           \
+    uint64_t bits =                                                    \
+        (uint64_t)_mm256_movemask_pd(_mm256_cmp_pd(v, lit, predicate)); \
+    mask[i / 64] |= bits << (i % 64);                                  \
+  }
+
+__attribute__((target("avx2"))) static size_t filter_doubles_avx2(
+    filter_op op,
+    const double* values,
+    size_t nb_values,
+    double literal,
+    uint64_t* mask) {
+  __m256d lit = _mm256_set1_pd(literal);
+  size_t i = 0;
+  switch (op) {
+    case FILTER_EQ:
+      FILTER_DOUBLES_AVX2(_CMP_EQ_OQ);
+      break;
+    case FILTER_NE:
+      FILTER_DOUBLES_AVX2(_CMP_NEQ_UQ);
+      break;
+    case FILTER_LT:
+      FILTER_DOUBLES_AVX2(_CMP_LT_OQ);
+      break;
+    case FILTER_LE:
+      FILTER_DOUBLES_AVX2(_CMP_LE_OQ);
+      break;
+    case FILTER_GT:
+      FILTER_DOUBLES_AVX2(_CMP_GT_OQ);
+      break;
+    case FILTER_GE:
+      FILTER_DOUBLES_AVX2(_CMP_GE_OQ);
+      break;
+  }
+  return i;
+}
+
+#define FILTER_DOUBLES_SSE(compare)                                     \
+  for (; i + 2 <= nb_values; i += 2) {                                  \
+    __m128d v = _mm_loadu_pd(values + i);                               \
+    uint64_t bits = (uint64_t)_mm_movemask_pd(compare(v, lit));         \
+    mask[i / 64] |= bits << (i % 64);                                   \
+  }
+
+__attribute__((target("sse4.2"))) static size_t filter_doubles_sse42(
+    filter_op op,
+    const double* values,
+    size_t nb_values,
+    double literal,
+    uint64_t* mask) {
+  __m128d lit = _mm_set1_pd(literal);
+  size_t i = 0;
+  switch (op) {
+    case FILTER_EQ:
+      FILTER_DOUBLES_SSE(_mm_cmpeq_pd);
+      break;
+    case FILTER_NE:
+      FILTER_DOUBLES_SSE(_mm_cmpneq_pd);
+      break;
+    case FILTER_LT:
+      FILTER_DOUBLES_SSE(_mm_cmplt_pd);
+      break;
+    case FILTER_LE:
+      FILTER_DOUBLES_SSE(_mm_cmple_pd);
+      break;
+    case FILTER_GT:
+      FILTER_DOUBLES_SSE(_mm_cmpgt_pd);
+      break;
+    case FILTER_GE:
+      FILTER_DOUBLES_SSE(_mm_cmpge_pd);
+      break;
+  }
+  return i;
+}
+
+// A window matches when the bytes of the mask are all equal, a single
+// different byte rejects it.
+__attribute__((target("avx2"))) static size_t filter_windows_avx2(
+    const char* const* windows,
+    size_t nb_windows,
+    const char* pattern,
+    uint32_t byte_mask,
+    uint64_t* mask) {
+  __m256i pat =
+      _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)pattern));
+  size_t i = 0;
+  for (; i + 2 <= nb_windows; i += 2) {
+    __m256i v = _mm256_inserti128_si256(
+        _mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)windows[i])),
+        _mm_loadu_si128((const __m128i*)windows[i + 1]), 1);
+    uint32_t equal = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, pat));
+    uint64_t bits = (uint64_t)((equal & byte_mask) == byte_mask) |
+                    (uint64_t)(((equal >> 16) & byte_mask) == byte_mask) << 1;
+    mask[i / 64] |= bits << (i % 64);
+  }
+  return i;
+}
+
+__attribute__((target("sse4.2"))) static size_t filter_windows_sse42(
+    const char* const* windows,
+    size_t nb_windows,
+    const char* pattern,
+    uint32_t byte_mask,
+    uint64_t* mask) {
+  __m128i pat = _mm_loadu_si128((const __m128i*)pattern);
+  size_t i = 0;
+  for (; i < nb_windows; i++) {
+    __m128i v = _mm_loadu_si128((const __m128i*)windows[i]);
+    uint32_t equal = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, pat));
+    mask[i / 64] |= (uint64_t)((equal & byte_mask) == byte_mask) << (i % 64);
+  }
+  return i;
+}
+#endif
+
+// The widest kernels the processor runs, found once.
+filter_level filter_best_level(void) {
+#ifdef FILTER_HAS_SIMD
+  static int level = -1;  // unknown until the first call
+  if (level == -1) {
+    __builtin_cpu_init();
+    level = __builtin_cpu_supports("avx2")     ? FILTER_AVX2
+            : __builtin_cpu_supports("sse4.2") ? FILTER_SSE42
+                                               : FILTER_SCALAR;
+  }
+  return (filter_level)level;
+#else
+  return FILTER_SCALAR;
+#endif
+}
+
+// Set the bits of the values which compare to the literal. level is
+// filter_best_level(), or a lower one.
+void filter_longs(filter_level level,
+                  filter_op op,
+                  const long* values,
+                  size_t nb_values,
+                  long literal,
+                  uint64_t* mask) {
+  memset(mask, 0, sizeof(uint64_t) * FILTER_MASK_WORDS(nb_values));
+  size_t first = 0;
+#ifdef FILTER_HAS_SIMD
+  if (level == FILTER_AVX2) {
+    first = filter_longs_avx2(op, values, nb_values, literal, mask);
+  } else if (level == FILTER_SSE42) {
+    first = filter_longs_sse42(op, values, nb_values, literal, mask);
+  }
+#else
+  (void)level;
+#endif
+  filter_longs_scalar(op, values, first, nb_values, literal, mask);
+}
+
+void filter_doubles(filter_level level,
+                    filter_op op,
+                    const double* values,
+                    size_t nb_values,
+                    double literal,
+                    uint64_t* mask) {
+  memset(mask, 0, sizeof(uint64_t) * FILTER_MASK_WORDS(nb_values));
+  size_t first = 0;
+#ifdef FILTER_HAS_SIMD
+  if (level == FILTER_AVX2) {
+    first = filter_doubles_avx2(op, values, nb_values, literal, mask);
+  } else if (level == FILTER_SSE42) {
+    first = filter_doubles_sse42(op, values, nb_values, literal, mask);
+  }
+#else
+  (void)level;
+#endif
+  filter_doubles_scalar(op, values, first, nb_values, literal, mask);
+}
+
+// Set the bits of the windows whose bytes in byte_mask, bit b for the byte
+// b, are the ones of the pattern. Every window and the pattern have
+// FILTER_WINDOW readable bytes.
+void filter_windows(filter_level level,
+                    const char* const* windows,
+                    size_t nb_windows,
+                    const char* pattern,
+                    uint32_t byte_mask,
+                    uint64_t* mask) {
+  memset(mask, 0, sizeof(uint64_t) * FILTER_MASK_WORDS(nb_windows));
+  size_t first = 0;
+#ifdef FILTER_HAS_SIMD
+  if (level == FILTER_AVX2) {
+    first =
+        filter_windows_avx2(windows, nb_windows, pattern, byte_mask, mask);
+  } else if (level == FILTER_SSE42) {
+    first =
+        filter_windows_sse42(windows, nb_windows, pattern, byte_mask, mask);
+  }
+#else
+  (void)level;
+#endif
+  filter_windows_scalar(windows, first, nb_windows, pattern, byte_mask, mask);
+}
+
+// Flip the bits of the values, the bits past them stay clear.
+void filter_invert(uint64_t* mask, size_t nb_values) {
+  for (size_t word = 0; word < FILTER_MASK_WORDS(nb_values); word++) {
+    mask[word] = ~mask[word];
+  }
+  if (nb_values % 64 != 0) {
+    mask[nb_values / 64] &= ((uint64_t)1 << (nb_values % 64)) - 1;
+  }
+}
+
+static size_t lowest_bit(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+  return (size_t)__builtin_ctzll(bits);
+#else
+  size_t bit = 0;
+  while ((bits & 1) == 0) {
+    bits >>= 1;
+    bit++;
+  }
+  return bit;
+#endif
+}
+
+// Copy the selected values whose bit is set in kept, their number is
+// returned. Empty words are skipped at once.
+size_t filter_select(const uint64_t* mask,
+                     const size_t* selection,
+                     size_t nb_values,
+                     size_t* kept) {
+  size_t nb_kept = 0;
+  for (size_t word = 0; word < FILTER_MASK_WORDS(nb_values); word++) {
+    for (uint64_t bits = mask[word]; bits != 0; bits &= bits - 1) {
+      kept[nb_kept++] = selection[word * 64 + lowest_bit(bits)];
+    }
+  }
+  return nb_kept;
+}
+
+int example_filter(void) {
+  long longs[200];
+  double doubles[200];
+  for (size_t i = 0; i < 200; i++) {
+    // 7919 is prime, the values are scrambled and repeat
+    longs[i] = (long)((i * 7919) % 61) - 30;
+    doubles[i] = (double)longs[i] / 4;
+  }
+  longs[3] = LONG_MIN;
+  longs[4] = LONG_MAX;
+  doubles[5] = NAN;
+  doubles[6] = -INFINITY;
+
+  // every level and every length agree with the scalar comparisons
+  filter_level best = filter_best_level();
+  long long_literals[] = {0, -30, 7, LONG_MIN, LONG_MAX};
+  double double_literals[] = {0, -7.5, 2.25, NAN, INFINITY};
+  for (int level = FILTER_SCALAR; level <= (int)best; level++) {
+    for (int op = FILTER_EQ; op <= FILTER_GE; op++) {
+      for (size_t l = 0; l < 5; l++) {
+        for (size_t nb_values = 0; nb_values <= 200; nb_values += 7) {
+          uint64_t mask[FILTER_MASK_WORDS(200)];
+          filter_longs((filter_level)level, (filter_op)op, longs, nb_values,
+                       long_literals[l], mask);
+          for (size_t i = 0; i < nb_values; i++) {
+            bool is_set = (mask[i / 64] >> (i % 64)) & 1;
+            assert(is_set ==
+                   compare_long((filter_op)op, longs[i], long_literals[l]));
+          }
+          filter_doubles((filter_level)level, (filter_op)op, doubles,
+                         nb_values, double_literals[l], mask);
+          for (size_t i = 0; i < nb_values; i++) {
+            bool is_set = (mask[i / 64] >> (i % 64)) & 1;
+            assert(is_set == compare_double((filter_op)op, doubles[i],
+                                            double_literals[l]));
+          }
+          // the bits past the values stay clear
+          if (nb_values % 64 != 0) {
+            assert(mask[nb_values / 64] >> (nb_values % 64) == 0);
+          }
+        }
+      }
+    }
+  }
+  assert(compare_double(FILTER_NE, NAN, NAN));
+  assert(!compare_double(FILTER_GE, NAN, NAN));
+
+  // windows of a few letters, some share a prefix with the pattern
+  char bytes[200][FILTER_WINDOW];
+  const char* windows[200];
+  for (size_t i = 0; i < 200; i++) {
+    memset(bytes[i], 0, FILTER_WINDOW);
+    size_t length = (i * 7919) % 9;
+    for (size_t b = 0; b < length; b++) {
+      bytes[i][b] = (char)('a' + (i >> b) % 2);
+    }
+    windows[i] = bytes[i];
+  }
+  char pattern[FILTER_WINDOW] = "abab";
+  uint32_t byte_masks[] = {0, 0x1, 0x1f, 0xf, 0xffff, 0xa};
+  for (int level = FILTER_SCALAR; level <= (int)best; level++) {
+    for (size_t m = 0; m < 6; m++) {
+      for (size_t nb_windows = 0; nb_windows <= 200; nb_windows += 7) {
+        uint64_t mask[FILTER_MASK_WORDS(200)];
+        filter_windows((filter_level)level, windows, nb_windows, pattern,
+                       byte_masks[m], mask);
+        for (size_t i = 0; i < nb_windows; i++) {
+          bool is_set = (mask[i / 64] >> (i % 64)) & 1;
+          assert(is_set == window_matches(windows[i], pattern, byte_masks[m]));
+        }
+        if (nb_windows % 64 != 0) {
+          assert(mask[nb_windows / 64] >> (nb_windows % 64) == 0);
+        }
+        // an empty byte mask matches every window
+        if (m == 0 && nb_windows > 0) {
+          assert(mask[0] & 1);
+        }
+      }
+    }
+  }
+  uint64_t inverted[FILTER_MASK_WORDS(200)];
+  filter_windows(best, windows, 200, pattern, 0x1f, inverted);
+  uint64_t matched = inverted[1];
+  filter_invert(inverted, 200);
+  assert(inverted[1] == ~matched);
+  assert(inverted[3] >> 8 == 0);
+
+  // the selected values are kept in order
+  size_t selection[200];
+  size_t kept[200];
+  for (size_t i = 0; i < 200; i++) {
+    selection[i] = i * 3;
+  }
+  uint64_t mask[FILTER_MASK_WORDS(200)];
+  filter_longs(best, FILTER_GT, longs, 200, 25, mask);
+  size_t nb_kept = filter_select(mask, selection, 200, kept);
+  size_t nb_expected = 0;
+  for (size_t i = 0; i < 200; i++) {
+    if (longs[i] > 25) {
+      assert(kept[nb_expected++] == i * 3);
+    }
+  }
+  assert(nb_kept == nb_expected && nb_kept > 0);
+  filter_longs(best, FILTER_LT, longs, 200, LONG_MIN, mask);
+  assert(filter_select(mask, selection, 200, kept) == 0);
+
+  printf("done filter\n");
+  return 0;
+}
@@ -0,0 +1,53 @@
+#ifndef _FILTER_H__
+#define _FILTER_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+// words of a mask of n values, one bit per value
+#define FILTER_MASK_WORDS(n) (((n) + 63) / 64)
+// bytes compared at once by filter_windows
+#define FILTER_WINDOW 16
+
+typedef enum FilterOp {
+  FILTER_EQ,
+  FILTER_NE,
+  FILTER_LT,
+  FILTER_LE,
+  FILTER_GT,
+  FILTER_GE,
+} filter_op;
+
+typedef enum FilterLevel {
+  FILTER_SCALAR,
+  FILTER_SSE42,
+  FILTER_AVX2,
+} filter_level;
+
+filter_level filter_best_level(void);
+void filter_longs(filter_level level,
+                  filter_op op,
+                  const long* values,
+                  size_t nb_values,
+                  long literal,
+                  uint64_t* mask);
+void filter_doubles(filter_level level,
+                    filter_op op,
+                    const double* values,
+                    size_t nb_values,
+                    double literal,
+                    uint64_t* mask);
+void filter_windows(filter_level level,
+                    const char* const* windows,
+                    size_t nb_windows,
+                    const char* pattern,
+                    uint32_t byte_mask,
+                    uint64_t* mask);
+void filter_invert(uint64_t* mask, size_t nb_values);
+size_t filter_select(const uint64_t* mask,
+                     const size_t* selection,
+                     size_t nb_values,
+                     size_t* kept);
+int example_filter(void);
+
+#endif  // _FILTER_H__
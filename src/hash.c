@@ -0,0 +1,347 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hash.h"
+
+// Open addressing hash index with Robin Hood probing: an entry is placed at
+// the first free slot after its home slot, taking the slot of any entry
+// closer to its own home. Probe lengths stay short and a lookup stops as
+// soon as it meets an entry closer to its home than the key would be.
+// Duplicated keys are allowed, they're adjacent in the probe sequence.
+//
+// Resizing is incremental: a full table becomes the old one and each
+// following insertion or removal moves a few of its slots into the new
+// table. Lookups search both until the old one is empty.
+
+#define HASH_MIN_CAPACITY 16
+#define HASH_MIGRATE_STEP 16  // old slots moved by each insertion or removal
+
+typedef struct HashSlot {
+  uint32_t distance;  // from the home slot, plus one. 0 for a free slot
+  uint32_t tag;       // high bits of the hash, to skip most key comparisons
+  size_t row;
+} hash_slot;
+
+struct HashTable {
+  size_t capacity;  // a power of two
+  size_t nb_used;
+  hash_slot* slots;
+  char* keys;  // key_size bytes per slot
+};
+
+static hash_table* create_table(size_t capacity, size_t key_size) {
+  hash_table* table = (hash_table*)malloc(sizeof(hash_table));
+  assert(table != NULL);
+  table->capacity = capacity;
+  table->nb_used = 0;
+  table->slots = (hash_slot*)calloc(capacity, sizeof(hash_slot));
+  assert(table->slots != NULL);
+  table->keys = (char*)malloc(capacity * key_size);
+  assert(table->keys != NULL);
+  return table;
+}
+
+static void destroy_table(hash_table* table) {
+  if (table == NULL) {
+    return;
+  }
+  free(table->slots);
+  free(table->keys);
+  free(table);
+}
+
+static char* key_at(hash_index* index, hash_table* table, size_t position) {
+  return table->keys + position * index->key_size;
+}
+
+static size_t key_length(hash_index* index, const void* key) {
+  return index->is_string ? strnlen((const char*)key, index->key_size)
+                          : index->key_size;
+}
+
+// FNV-1a and the murmur3 finaliser, so every bit of the key moves the low
+// bits used to find the home slot.
+static uint64_t hash_key(hash_index* index, const void* key) {
+  const unsigned char* bytes = (const unsigned char*)key;
+  size_t length = key_length(index, key);
+  uint64_t hash = 14695981039346656037u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= bytes[i];
+    hash *= 1099511628211u;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xff51afd7ed558ccdu;
+  hash ^= hash >> 33;
+  hash *= 0xc4ceb9fe1a85ec53u;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+static uint32_t tag_of(uint64_t hash) {
+  return (uint32_t)(hash >> 32);
+}
+
+static bool are_keys_equal(hash_index* index, const void* a, const void* b) {
+  if (index->is_string) {
+    return strncmp((const char*)a, (const char*)b, index->key_size) == 0;
+  }
+  return memcmp(a, b, index->key_size) == 0;
+}
+
+static void place(hash_index* index,
+                  hash_table* table,
+                  uint64_t hash,
+                  const void* key,
+                  size_t row) {
+  size_t mask = table->capacity - 1;
+  size_t position = (size_t)hash & mask;
+  hash_slot carried = {1, tag_of(hash), row};
+  memcpy(index->carried, key, index->key_size);
+  while (table->slots[position].distance != 0) {
+    hash_slot* slot = &table->slots[position];
+    if (slot->distance < carried.distance) {
+      // the richer entry gives its slot and goes further
+      hash_slot poorer = *slot;
+      *slot = carried;
+      carried = poorer;
+      char* slot_key = key_at(index, table, position);
+      memcpy(index->swapped, slot_key, index->key_size);
+      memcpy(slot_key, index->carried, index->key_size);
+      memcpy(index->carried, index->swapped, index->key_size);
+    }
+    position = (position + 1) & mask;
+    carried.distance++;
+  }
+  table->slots[position] = carried;
+  memcpy(key_at(index, table, position), index->carried, index->key_size);
+  table->nb_used++;
+}
+
+// Free a slot, the following entries of its cluster move back by one so no
+// lookup stops early.
+static void remove_at(hash_index* index, hash_table* table, size_t position) {
+  size_t mask = table->capacity - 1;
+  size_t next = (position + 1) & mask;
+  while (table->slots[next].distance > 1) {
+    table->slots[position] = table->slots[next];
+    table->slots[position].distance--;
+    memcpy(key_at(index, table, position), key_at(index, table, next),
+           index->key_size);
+    position = next;
+    next = (next + 1) & mask;
+  }
+  table->slots[position].distance = 0;
+  table->nb_used--;
+}
+
+// Move some slots of the old table. A moved slot is removed from the old
+// table so it stays searchable until it's empty.
+static void migrate(hash_index* index, size_t nb_steps) {
+  hash_table* old = index->old;
+  if (old == NULL) {
+    return;
+  }
+  while (nb_steps > 0 && index->migrated < old->capacity) {
+    nb_steps--;
+    size_t position = index->migrated;
+    if (old->slots[position].distance == 0) {
+      index->migrated++;
+      continue;
+    }
+    char* key = key_at(index, old, position);
+    place(index, index->table, hash_key(index, key), key,
+          old->slots[position].row);
+    remove_at(index, old, position);
+  }
+  if (index->migrated == old->capacity) {
+    assert(old->nb_used == 0);
+    destroy_table(old);
+    index->old = NULL;
+  }
+}
+
+static void grow(hash_index* index) {
+  migrate(index, SIZE_MAX);
+  index->old = index->table;
+  index->table = create_table(index->old->capacity * 2, index->key_size);
+  index->migrated = 0;
+}
+
+hash_index* hash_create(size_t key_size, bool is_string) {
+  hash_index* index = (hash_index*)malloc(sizeof(hash_index));
+  assert(index != NULL);
+  index->key_size = key_size;
+  index->is_string = is_string;
+  index->nb_entries = 0;
+  index->table = create_table(HASH_MIN_CAPACITY, key_size);
+  index->old = NULL;
+  index->migrated = 0;
+  index->carried = (char*)malloc(key_size);
+  assert(index->carried != NULL);
+  index->swapped = (char*)malloc(key_size);
+  assert(index->swapped != NULL);
+  return index;
+}
+
+void hash_destroy(hash_index* index) {
+  if (index == NULL) {
+    return;
+  }
+  destroy_table(index->table);
+  destroy_table(index->old);
+  free(index->carried);
+  free(index->swapped);
+  free(index);
+}
+
+void hash_insert(hash_index* index, const void* key, size_t row) {
+  migrate(index, HASH_MIGRATE_STEP);
+  // at most 7/8 of the slots are used, probes always meet a free slot
+  if ((index->table->nb_used + 1) * 8 > index->table->capacity * 7) {
+    grow(index);
+  }
+  place(index, index->table, hash_key(index, key), key, row);
+  index->nb_entries++;
+}
+
+// Walk the probe sequence of the cursor up to a slot holding its key.
+static bool scan_table(hash_cursor* cursor) {
+  hash_index* index = cursor->index;
+  hash_table* table = cursor->table;
+  size_t mask = table->capacity - 1;
+  uint32_t tag = tag_of(cursor->hash);
+  while (table->slots[cursor->position].distance >= cursor->distance) {
+    if (table->slots[cursor->position].tag == tag &&
+        are_keys_equal(index, key_at(index, table, cursor->position),
+                       cursor->key)) {
+      return true;
+    }
+    cursor->position = (cursor->position + 1) & mask;
+    cursor->distance++;
+  }
+  return false;
+}
+
+static void start_scan(hash_cursor* cursor, hash_table* table) {
+  cursor->table = table;
+  cursor->position = (size_t)cursor->hash & (table->capacity - 1);
+  cursor->distance = 1;
+}
+
+static void find_match(hash_cursor* cursor) {
+  while (!scan_table(cursor)) {
+    if (cursor->table == cursor->index->old || cursor->index->old == NULL) {
+      cursor->is_valid = false;
+      return;
+    }
+    start_scan(cursor, cursor->index->old);
+  }
+  cursor->is_valid = true;
+}
+
+hash_cursor hash_seek(hash_index* index, const void* key) {
+  hash_cursor cursor;
+  cursor.index = index;
+  cursor.key = key;
+  cursor.hash = hash_key(index, key);
+  start_scan(&cursor, index->table);
+  find_match(&cursor);
+  return cursor;
+}
+
+bool hash_cursor_valid(hash_cursor* cursor) {
+  return cursor->is_valid;
+}
+
+void hash_cursor_next(hash_cursor* cursor) {
+  cursor->position = (cursor->position + 1) & (cursor->table->capacity - 1);
+  cursor->distance++;
+  find_match(cursor);
+}
+
+size_t hash_cursor_row(hash_cursor* cursor) {
+  return cursor->table->slots[cursor->position].row;
+}
+
+bool hash_find(hash_index* index, const void* key, size_t* row) {
+  hash_cursor cursor = hash_seek(index, key);
+  if (cursor.is_valid && row != NULL) {
+    *row = hash_cursor_row(&cursor);
+  }
+  return cursor.is_valid;
+}
+
+bool hash_remove(hash_index* index, const void* key, size_t row) {
+  migrate(index, HASH_MIGRATE_STEP);
+  for (hash_cursor c = hash_seek(index, key); hash_cursor_valid(&c);
+       hash_cursor_next(&c)) {
+    if (hash_cursor_row(&c) == row) {
+      remove_at(index, c.table, c.position);
+      index->nb_entries--;
+      return true;
+    }
+  }
+  return false;
+}
+
+int example_hash(void) {
+  hash_index* index = hash_create(sizeof(long), false);
+  size_t nb_keys = 100000;
+  size_t nb_resizing = 0;
+  for (size_t i = 0; i < nb_keys; i++) {
+    long key = (long)i;
+    hash_insert(index, &key, i + 1);
+    if (index->old != NULL) {
+      nb_resizing++;
+      // the keys which weren't moved yet are found in the old table
+      long first = 0;
+      size_t row;
+      assert(hash_find(index, &first, &row) && row == 1);
+    }
+  }
+  assert(nb_resizing > 0 && index->nb_entries == nb_keys);
+  for (size_t i = 0; i < nb_keys; i++) {
+    long key = (long)i;
+    size_t row;
+    assert(hash_find(index, &key, &row) && row == i + 1);
+  }
+  long missing = -1;
+  assert(!hash_find(index, &missing, NULL));
+
+  // remove the odd keys
+  for (size_t i = 1; i < nb_keys; i += 2) {
+    long key = (long)i;
+    assert(!hash_remove(index, &key, i));
+    assert(hash_remove(index, &key, i + 1));
+  }
+  assert(index->nb_entries == nb_keys / 2);
+  for (size_t i = 0; i < nb_keys; i++) {
+    long key = (long)i;
+    assert(hash_find(index, &key, NULL) == (i % 2 == 0));
+  }
+  hash_destroy(index);
+
+  // duplicated string keys, bytes after the '\0' don't count
+  hash_index* names = hash_create(8, true);
+  char key[8] = "'abc'";
+  char other[8] = "'abc'\0zz";
+  for (size_t row = 0; row < 200; row++) {
+    hash_insert(names, row % 2 ? key : other, row);
+  }
+  assert(hash_remove(names, key, 42));
+  size_t count = 0;
+  for (hash_cursor c = hash_seek(names, other); hash_cursor_valid(&c);
+       hash_cursor_next(&c)) {
+    assert(hash_cursor_row(&c) != 42);
+    count++;
+  }
+  assert(count == 199);
+  hash_destroy(names);
+
+  printf("done hash\n");
+  return 0;
+}
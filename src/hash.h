@@ -0,0 +1,43 @@
+#ifndef _HASH_H__
+#define _HASH_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct HashTable hash_table;
+
+typedef struct HashIndex {
+  size_t key_size;
+  bool is_string;  // keys are compared up to their '\0'
+  size_t nb_entries;
+  hash_table* table;
+  hash_table* old;  // being moved into table, NULL when not resizing
+  size_t migrated;  // slots of old already moved
+  char* carried;    // key being placed by an insertion
+  char* swapped;
+} hash_index;
+
+// Rows of a key. The index mustn't be modified while a cursor is used.
+typedef struct HashCursor {
+  hash_index* index;
+  const void* key;
+  uint64_t hash;
+  hash_table* table;
+  size_t position;
+  size_t distance;
+  bool is_valid;
+} hash_cursor;
+
+hash_index* hash_create(size_t key_size, bool is_string);
+void hash_destroy(hash_index* index);
+void hash_insert(hash_index* index, const void* key, size_t row);
+bool hash_remove(hash_index* index, const void* key, size_t row);
+bool hash_find(hash_index* index, const void* key, size_t* row);
+hash_cursor hash_seek(hash_index* index, const void* key);
+bool hash_cursor_valid(hash_cursor* cursor);
+void hash_cursor_next(hash_cursor* cursor);
+size_t hash_cursor_row(hash_cursor* cursor);
+int example_hash(void);
+
+#endif  // _HASH_H__
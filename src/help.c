@@ -31,10 +31,18 @@ void help(void) {
       ".exit                 : exit qdb \n"
       ".tables               : display all your tables descriptions\n"
       ".clear                : erase all your tables from memory\n"
-      ".open database.db     : open a save file and load all the tables \n"
-      ".save database.db     : save all your tables into a savefile \n"
+      ".open database.db     : open a save file, its tables are read when \n"
+      "                        they're used\n"
+      ".save database.db     : save all your tables into a savefile, only \n"
+      "                        the modified pages when it was saved before\n"
+      ".bgsave database.db   : save a copy of all your tables in the \n"
+      "                        background, .bgsave alone shows its progress\n"
       ".read requests.sql    : open a text file and execute all the requests. "
       "Stop at first error.\n"
+      ".cache 64             : limit the memory used by the pages to 64 MiB\n"
+      ".cache                : display the buffer pool statistics\n"
+      ".wal 10 65536         : sync the log every 10 ms or 64 KiB\n"
+      ".wal                  : display the log statistics\n"
       "\n"
       "## Example of requests\n"
       "\n"
@@ -43,6 +51,12 @@ void help(void) {
       "CREATE TABLE \"user\" (\"a\" int pk, \"b\" int, \"c\" varchar ( 32 ) "
       ");\n"
       "CREATE TABLE \"aze\" (\"a\" int pk );\n"
+      "CREATE TABLE \"facts\" (\"a\" int pk, \"b\" float) "
+      "STORAGE = COLUMNS;\n"
+      "CREATE TABLE \"visit\" (\"a\" int pk, \"country\" varchar(32) "
+      "DICT);\n"
+      "CREATE TABLE \"events\" (\"a\" int pk, \"b\" int) CLUSTER = PK;\n"
+      "CREATE TABLE \"logs\" (\"a\" int pk, \"b\" int) ENGINE = LSM;\n"
       "\n"
       "INSERT INTO \"user\" VALUES (123, 456, 'abc');\n"
       "INSERT INTO \"user\" VALUES (789, 123, 'defgh');\n"
@@ -52,6 +66,7 @@ void help(void) {
       "\n"
       "DELETE FROM \"user\" WHERE ( \"b\" = 123 );\n"
       "DELETE FROM \"user\";\n"
+      "VACUUM \"user\";\n"
       "\n"
       "SELECT \"b\", \"c\", \"a\"  FROM \"user\" WHERE (( \"c\" = 'abc' ) OR ( "
       "\"b\" = 123 ));\n"
@@ -63,6 +78,11 @@ void help(void) {
       "UPDATE  \"user\" SET \"a\" = 999, \"b\" = 3  WHERE (\"a\" = 123);\n"
       "UPDATE  \"user\" SET \"a\" = 999  WHERE (\"a\" = 789);\n"
       "\n"
+      "CREATE INDEX \"user_b\" ON \"user\" (\"b\");\n"
+      "CREATE INDEX \"user_a\" ON \"user\" (\"a\") USING HASH;\n"
+      "CREATE INDEX \"user_c\" ON \"user\" (\"c\") USING BLOOM;\n"
+      "DROP INDEX \"user_b\";\n"
+      "\n"
       "## Remarks\n"
       "\n"
       "- Identifiers (tablename, colname) must be in double quotes: "
@@ -5,13 +5,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "arena.h"
+
 typedef enum Token_kind {
   KEYWORD,         // select insert update, create drop, into set where
   IDENTIFIER,      // variable name ()
   LITERAL_STRING,  // 'abc' "abc"
   NUMBER,          // 123 0123 0x123
   OPERATOR,        // + - * / %
-  COMPARISON,      // = != < > <= >=
+  COMPARISON,      // = != < > <= >= LIKE
   LEFT_PAREN,      // (
   RIGHT_PAREN,     // )
   PUNCTUATION,     // , .
@@ -51,24 +53,38 @@ char* repr_kind(token_kind kind) {
   }
 }
 
-#define NBKEYWORDS 36
+#define NBKEYWORDS 64
 // clang-format off
 const char *skeywords[NBKEYWORDS] = {
   "and",      "AND",
+  "bloom",    "BLOOM",
+  "btree",    "BTREE",
+  "cluster",  "CLUSTER",
+  "columns",  "COLUMNS",
   "create",   "CREATE",
   "delete",   "DELETE",
+  "dict",     "DICT",
   "drop",     "DROP",
+  "engine",   "ENGINE",
   "float",    "FLOAT",
   "from",     "FROM",
+  "hash",     "HASH",
+  "index",    "INDEX",
   "insert",   "INSERT",
   "int",      "INT",
   "into",     "INTO",
+  "lsm",      "LSM",
+  "on",       "ON",
   "or",       "OR",
   "pk",       "PK",
+  "rows",     "ROWS",
   "select",   "SELECT",
   "set",      "SET",
+  "storage",  "STORAGE",
   "table",    "TABLE",
   "update",   "UPDATE",
+  "using",    "USING",
+  "vacuum",   "VACUUM",
   "values",   "VALUES",
   "varchar",  "VARCHAR",
   "where",    "WHERE",
@@ -154,11 +170,15 @@ const char len_2_comparison[LEN2COMPARISON][2] = {"!=", "<=", ">=", "OR"};
 
 const char* len_3_comparison = "AND";
 
+const char* len_4_comparison = "LIKE";
+
 #define LEN1OPERATORS 5
 const char len_1_operators[LEN1OPERATORS] = "+-*/%";
 
 bool is_comparison(char* word, size_t len) {
   switch (len) {
+    case 4:
+      return strncmp(word, len_4_comparison, 4) == 0;
     case 3:
       return strncmp(word, len_3_comparison, 3) == 0;
     default:
@@ -173,7 +193,7 @@ bool is_comparison(char* word, size_t len) {
       return false;
       break;
     case 1:
-      for (int i = 0; i < LEN1OPERATORS; i++) {
+      for (int i = 0; i < LEN1COMPARISON; i++) {
         if (*word == len_1_comparison[i]) {
           return true;
         }
@@ -249,11 +269,10 @@ typedef struct Token {
   token_kind kind;
 } token;
 
-token* new_token(char* value, size_t len, token_kind kind) {
-  token* t = (token*)malloc(sizeof(token));
-  assert(t != NULL);
-  t->value = (char*)malloc(sizeof(char) * (len + 2));
-  assert(t->value != NULL);
+// Tokens live in the arena of their statement.
+token* new_token(arena* a, char* value, size_t len, token_kind kind) {
+  token* t = (token*)arena_alloc(a, sizeof(token));
+  t->value = (char*)arena_alloc(a, sizeof(char) * (len + 2));
   strncpy(t->value, value, len + 1);
   t->value[len + 1] = '\0';
   t->len = len + 1;
@@ -282,7 +301,10 @@ void print_tokens(token** tokens, size_t nb_tokens) {
   }
 }
 
-token* get_next_token(char* line, size_t* position, size_t line_len) {
+token* get_next_token(arena* a,
+                      char* line,
+                      size_t* position,
+                      size_t line_len) {
   size_t i = 0;
   char c;
   token_kind kind;
@@ -299,60 +321,60 @@ token* get_next_token(char* line, size_t* position, size_t line_len) {
     }
     if (is_comparison(line + *position, i + 1)) {
       kind = COMPARISON;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     if (is_keyword(line + *position, i + 1)) {
       if (*position + i + 1 >= line_len ||
           !is_keyword(line + *position, i + 2)) {
         kind = KEYWORD;
-        tok = new_token(line + *position, i, kind);
+        tok = new_token(a, line + *position, i, kind);
         break;
       }
     }
     if (is_identifier(line + *position, i + 1)) {
       kind = IDENTIFIER;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     if (is_literal_string(line + *position, i + 1)) {
       kind = LITERAL_STRING;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     if (is_number(line + *position, i + 1)) {
       kind = NUMBER;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     if (is_operator(line + *position, i + 1)) {
       kind = OPERATOR;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     if (is_punctuation(line + *position, i + 1)) {
       kind = PUNCTUATION;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     if (is_left_paren(line + *position, i + 1)) {
       kind = LEFT_PAREN;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     if (is_right_paren(line + *position, i + 1)) {
       kind = RIGHT_PAREN;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     if (is_end(line + *position, i + 1)) {
       kind = END;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     if (is_comment(line + *position, i + 1)) {
       kind = COMMENT;
-      tok = new_token(line + *position, i, kind);
+      tok = new_token(a, line + *position, i, kind);
       break;
     }
     i++;
@@ -372,12 +394,12 @@ void syntax_error(char* line, size_t position) {
   fprintf(stderr, "^\n");
 }
 
-size_t lexer(char* line, token** tokens) {
+size_t lexer(arena* a, char* line, token** tokens) {
   size_t position = 0;
   size_t line_len = strlen(line);
   size_t nb_tokens = 0;
   while (position < line_len) {
-    token* tok = get_next_token(line, &position, line_len);
+    token* tok = get_next_token(a, line, &position, line_len);
     if (tok == NULL) {
       syntax_error(line, position);
       tokens = NULL;
@@ -430,6 +452,7 @@ void test_comparison_functions(void) {
   assert(is_comparison("<=", 2));
   assert(is_comparison("!=", 2));
   assert(!is_comparison("<=!", 3));
+  assert(is_comparison("LIKE", 4));
   assert(is_left_paren("(", 1));
   assert(is_right_paren(")", 1));
   assert(!is_left_paren(")", 1));
@@ -449,12 +472,15 @@ int example_lexer(void) {
   line = "select \"a\", \"b\", \"c\" from \"tablename\" where (\"a\"=2);";
   /* line = "aze"; */
 
+  arena* a = arena_create(ARENA_BLOCK_SIZE);
   token** tokens = (token**)malloc(sizeof(token) * MAXTOKEN);
   assert(tokens != NULL);
-  size_t nb_tokens = lexer(line, tokens);
+  size_t nb_tokens = lexer(a, line, tokens);
   print_tokens(tokens, nb_tokens);
+  assert(nb_tokens == 14 && strcmp(tokens[0]->value, "SELECT") == 0);
 
   destroy_tokens(tokens);
+  arena_destroy(a);
 
   printf("done\n");
 
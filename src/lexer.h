@@ -2,6 +2,8 @@
 #define _LEXER__
 #include <stdio.h>
 
+#include "arena.h"
+
 typedef enum Token_kind {
   KEYWORD,         // select insert update, create drop, into set where
   IDENTIFIER,      // variable name ()
@@ -26,7 +28,7 @@ typedef struct Token {
 #define MAXTOKEN 1000
 char* repr_kind(token_kind kind) ;
 void syntax_error(char* line, size_t position);
-size_t lexer(char* line, token** tokens) ;
+size_t lexer(arena* a, char* line, token** tokens) ;
 void print_token(token* tok);
 void destroy_tokens(token** tokens);
 int example_lexer(void);
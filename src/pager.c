@@ -0,0 +1,588 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "crc32c.h"
+#include "pager.h"
+
+// Fixed size pages cached in a bounded pool of frames. When every frame is
+// used, the least recently used unpinned frame is evicted and its page is
+// written to a spill file if it was modified. Page n lives at offset
+// n * PAGER_PAGE_SIZE in the spill file.
+//
+// Before a fork the spill file can be split: the pages already spilled stay
+// in their file, which isn't written anymore, the next ones go to a new file.
+// The forked process keeps reading the pages as they were, as long as it
+// doesn't evict pages itself.
+//
+// Pages can also be mapped from a file. They are read in place and aren't
+// counted in the budget, the mapping is private so a modified page is copied
+// by the OS and the pager never writes the file. Whoever writes it must leave
+// alone the mapped pages which weren't modified, they're read from the file.
+// A mapped page may come with its CRC32C, it's checked when the page is first
+// pinned and a page which doesn't match stops the process.
+
+#define NO_FRAME ((size_t)-1)
+#define NO_PAGE ((size_t)-1)
+
+typedef struct Frame {
+  size_t page;  // NO_PAGE when the frame is free
+  size_t nb_pins;
+  bool dirty;
+  size_t prev;  // LRU list, most recently used first
+  size_t next;
+  char* data;
+} frame;
+
+typedef struct PageEntry {
+  bool used;
+  bool on_disk;  // a copy was written to a spill file
+  size_t spill;  // the spill file of the copy
+  size_t frame;  // NO_FRAME when the page isn't cached
+  char* mapped;  // NULL when the page isn't mapped from a file
+  size_t region;
+  bool is_checked;  // the mapped page matched its checksum, or has none
+  uint32_t checksum;
+} page_entry;
+
+typedef struct SpillFile {
+  FILE* file;       // created by the first write, closed once it's unused
+  size_t nb_pages;  // pages whose copy is in the file
+} spill_file;
+
+typedef struct MappedRegion {
+  char* address;
+  size_t length;
+  size_t nb_pages;  // pages still using the region
+} mapped_region;
+
+struct Pager {
+  size_t max_frames;
+  bool is_growing;  // frames are added instead of evicting pages
+  size_t nb_frames;
+  frame* frames;
+  size_t lru_head;
+  size_t lru_tail;
+
+  page_entry* pages;
+  size_t nb_pages;
+  size_t pages_capacity;
+  size_t* free_pages;
+  size_t nb_free_pages;
+
+  spill_file* spills;  // the last one is written
+  size_t nb_spills;
+
+  mapped_region* regions;
+  size_t nb_regions;
+  size_t nb_mapped_pages;
+
+  size_t hits;
+  size_t misses;
+  size_t evictions;
+  size_t writes;
+};
+
+static size_t frames_for_budget(size_t budget) {
+  size_t nb_frames = budget / PAGER_PAGE_SIZE;
+  return nb_frames < PAGER_MIN_FRAMES ? PAGER_MIN_FRAMES : nb_frames;
+}
+
+pager* pager_create(size_t budget) {
+  pager* p = (pager*)malloc(sizeof(pager));
+  assert(p != NULL);
+  p->max_frames = frames_for_budget(budget);
+  p->is_growing = false;
+  p->nb_frames = 0;
+  p->frames = (frame*)malloc(sizeof(frame) * p->max_frames);
+  assert(p->frames != NULL);
+  p->lru_head = NO_FRAME;
+  p->lru_tail = NO_FRAME;
+
+  p->nb_pages = 0;
+  p->pages_capacity = 64;
+  p->pages = (page_entry*)malloc(sizeof(page_entry) * p->pages_capacity);
+  assert(p->pages != NULL);
+  p->free_pages = (size_t*)malloc(sizeof(size_t) * p->pages_capacity);
+  assert(p->free_pages != NULL);
+  p->nb_free_pages = 0;
+
+  p->spills = (spill_file*)malloc(sizeof(spill_file));
+  assert(p->spills != NULL);
+  p->spills[0].file = NULL;
+  p->spills[0].nb_pages = 0;
+  p->nb_spills = 1;
+  p->regions = NULL;
+  p->nb_regions = 0;
+  p->nb_mapped_pages = 0;
+  p->hits = 0;
+  p->misses = 0;
+  p->evictions = 0;
+  p->writes = 0;
+  return p;
+}
+
+static void lru_unlink(pager* p, size_t index) {
+  frame* f = &p->frames[index];
+  if (f->prev != NO_FRAME) {
+    p->frames[f->prev].next = f->next;
+  } else {
+    p->lru_head = f->next;
+  }
+  if (f->next != NO_FRAME) {
+    p->frames[f->next].prev = f->prev;
+  } else {
+    p->lru_tail = f->prev;
+  }
+}
+
+static void lru_push_front(pager* p, size_t index) {
+  frame* f = &p->frames[index];
+  f->prev = NO_FRAME;
+  f->next = p->lru_head;
+  if (p->lru_head != NO_FRAME) {
+    p->frames[p->lru_head].prev = index;
+  }
+  p->lru_head = index;
+  if (p->lru_tail == NO_FRAME) {
+    p->lru_tail = index;
+  }
+}
+
+static void lru_push_back(pager* p, size_t index) {
+  frame* f = &p->frames[index];
+  f->next = NO_FRAME;
+  f->prev = p->lru_tail;
+  if (p->lru_tail != NO_FRAME) {
+    p->frames[p->lru_tail].next = index;
+  }
+  p->lru_tail = index;
+  if (p->lru_head == NO_FRAME) {
+    p->lru_head = index;
+  }
+}
+
+// the copy of a page isn't needed anymore, an older spill file is closed
+// with its last page
+static void forget_spilled_copy(pager* p, page_entry* entry) {
+  if (!entry->on_disk) {
+    return;
+  }
+  entry->on_disk = false;
+  spill_file* spill = &p->spills[entry->spill];
+  spill->nb_pages--;
+  if (spill->nb_pages == 0 && entry->spill + 1 < p->nb_spills) {
+    fclose(spill->file);
+    spill->file = NULL;
+  }
+}
+
+static void write_page(pager* p, size_t page, char* data) {
+  page_entry* entry = &p->pages[page];
+  size_t current = p->nb_spills - 1;
+  spill_file* spill = &p->spills[current];
+  if (spill->file == NULL) {
+    spill->file = tmpfile();
+    assert(spill->file != NULL);
+  }
+  if (!entry->on_disk || entry->spill != current) {
+    forget_spilled_copy(p, entry);
+    entry->on_disk = true;
+    entry->spill = current;
+    spill->nb_pages++;
+  }
+  ssize_t written = pwrite(fileno(spill->file), data, PAGER_PAGE_SIZE,
+                           (off_t)(page * PAGER_PAGE_SIZE));
+  assert(written == PAGER_PAGE_SIZE);
+  p->writes++;
+}
+
+static void read_page(pager* p, size_t page, char* data) {
+  FILE* file = p->spills[p->pages[page].spill].file;
+  ssize_t read = pread(fileno(file), data, PAGER_PAGE_SIZE,
+                       (off_t)(page * PAGER_PAGE_SIZE));
+  assert(read == PAGER_PAGE_SIZE);
+}
+
+// write back the page held by an unpinned frame and forget it
+static void evict_frame(pager* p, size_t index) {
+  frame* f = &p->frames[index];
+  assert(f->nb_pins == 0);
+  if (f->page == NO_PAGE) {
+    return;
+  }
+  if (f->dirty) {
+    write_page(p, f->page, f->data);
+  }
+  p->pages[f->page].frame = NO_FRAME;
+  f->page = NO_PAGE;
+  f->dirty = false;
+  p->evictions++;
+}
+
+static size_t grab_frame(pager* p) {
+  if (p->nb_frames == p->max_frames && p->is_growing) {
+    p->max_frames *= 2;
+    p->frames = (frame*)realloc(p->frames, sizeof(frame) * p->max_frames);
+    assert(p->frames != NULL);
+  }
+  if (p->nb_frames < p->max_frames) {
+    size_t index = p->nb_frames++;
+    frame* f = &p->frames[index];
+    f->data = (char*)malloc(PAGER_PAGE_SIZE);
+    assert(f->data != NULL);
+    f->page = NO_PAGE;
+    f->nb_pins = 0;
+    f->dirty = false;
+    lru_push_front(p, index);
+    return index;
+  }
+  for (size_t index = p->lru_tail; index != NO_FRAME;
+       index = p->frames[index].prev) {
+    if (p->frames[index].nb_pins == 0) {
+      evict_frame(p, index);
+      return index;
+    }
+  }
+  fprintf(stderr, "Pager error: every one of the %ld frames is pinned\n",
+          p->max_frames);
+  abort();
+}
+
+static void check_mapped_page(size_t page, page_entry* entry) {
+  if (crc32c(0, entry->mapped, PAGER_PAGE_SIZE) != entry->checksum) {
+    fprintf(stderr, "Pager error: page %ld doesn't match its checksum\n",
+            page);
+    abort();
+  }
+  entry->is_checked = true;
+}
+
+void* pager_pin(pager* p, size_t page) {
+  assert(page < p->nb_pages && p->pages[page].used);
+  page_entry* entry = &p->pages[page];
+  if (entry->mapped != NULL) {
+    p->hits++;
+    if (!entry->is_checked) {
+      check_mapped_page(page, entry);
+    }
+    return entry->mapped;
+  }
+  size_t index = entry->frame;
+  if (index != NO_FRAME) {
+    p->hits++;
+  } else {
+    p->misses++;
+    index = grab_frame(p);
+    frame* f = &p->frames[index];
+    if (entry->on_disk) {
+      read_page(p, page, f->data);
+    } else {
+      memset(f->data, 0, PAGER_PAGE_SIZE);
+    }
+    f->page = page;
+    entry->frame = index;
+  }
+  frame* f = &p->frames[index];
+  f->nb_pins++;
+  if (p->lru_head != index) {
+    lru_unlink(p, index);
+    lru_push_front(p, index);
+  }
+  return f->data;
+}
+
+void pager_unpin(pager* p, size_t page, bool dirty) {
+  char* mapped = p->pages[page].mapped;
+  if (mapped != NULL) {
+    if (dirty) {
+      // make sure the page is copied, its place in the file may be reused
+      // once the page is saved elsewhere
+      *(volatile char*)mapped = *(volatile char*)mapped;
+    }
+    return;
+  }
+  frame* f = &p->frames[p->pages[page].frame];
+  assert(f->nb_pins > 0);
+  f->nb_pins--;
+  f->dirty = f->dirty || dirty;
+}
+
+static size_t new_page_entry(pager* p) {
+  size_t page;
+  if (p->nb_free_pages > 0) {
+    page = p->free_pages[--p->nb_free_pages];
+  } else {
+    if (p->nb_pages == p->pages_capacity) {
+      p->pages_capacity *= 2;
+      p->pages = (page_entry*)realloc(p->pages,
+                                      sizeof(page_entry) * p->pages_capacity);
+      assert(p->pages != NULL);
+      p->free_pages = (size_t*)realloc(p->free_pages,
+                                       sizeof(size_t) * p->pages_capacity);
+      assert(p->free_pages != NULL);
+    }
+    page = p->nb_pages++;
+  }
+  p->pages[page].used = true;
+  p->pages[page].on_disk = false;
+  p->pages[page].frame = NO_FRAME;
+  p->pages[page].mapped = NULL;
+  return page;
+}
+
+// A new page is filled with zeroes.
+size_t pager_allocate(pager* p) {
+  return new_page_entry(p);
+}
+
+// Map nb_pages pages of a file, page n of the file being at offset
+// n * PAGER_PAGE_SIZE. file_pages lists them in any order, their numbers in
+// the pool are written into pages. checksums holds the CRC32C of each page,
+// or is NULL.
+bool pager_map(pager* p,
+               int fd,
+               size_t nb_pages,
+               const size_t* file_pages,
+               const uint32_t* checksums,
+               size_t* pages) {
+  if (nb_pages == 0) {
+    return true;
+  }
+  size_t last = 0;
+  for (size_t i = 0; i < nb_pages; i++) {
+    last = file_pages[i] > last ? file_pages[i] : last;
+  }
+  size_t length = (last + 1) * PAGER_PAGE_SIZE;
+  void* address =
+      mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (address == MAP_FAILED) {
+    perror("Pager error: mmap");
+    return false;
+  }
+  p->regions = (mapped_region*)realloc(
+      p->regions, sizeof(mapped_region) * (p->nb_regions + 1));
+  assert(p->regions != NULL);
+  size_t region = p->nb_regions++;
+  p->regions[region].address = (char*)address;
+  p->regions[region].length = length;
+  p->regions[region].nb_pages = nb_pages;
+  for (size_t i = 0; i < nb_pages; i++) {
+    pages[i] = new_page_entry(p);
+    p->pages[pages[i]].mapped =
+        (char*)address + file_pages[i] * PAGER_PAGE_SIZE;
+    p->pages[pages[i]].region = region;
+    p->pages[pages[i]].is_checked = checksums == NULL;
+    p->pages[pages[i]].checksum = checksums == NULL ? 0 : checksums[i];
+  }
+  p->nb_mapped_pages += nb_pages;
+  return true;
+}
+
+static void unmap_page(pager* p, page_entry* entry) {
+  mapped_region* region = &p->regions[entry->region];
+  entry->mapped = NULL;
+  p->nb_mapped_pages--;
+  region->nb_pages--;
+  if (region->nb_pages == 0) {
+    munmap(region->address, region->length);
+    region->address = NULL;
+  }
+}
+
+void pager_free(pager* p, size_t page) {
+  page_entry* entry = &p->pages[page];
+  assert(entry->used);
+  if (entry->mapped != NULL) {
+    unmap_page(p, entry);
+  } else if (entry->frame != NO_FRAME) {
+    // the frame is reused first
+    frame* f = &p->frames[entry->frame];
+    assert(f->nb_pins == 0);
+    f->page = NO_PAGE;
+    f->dirty = false;
+    lru_unlink(p, entry->frame);
+    lru_push_back(p, entry->frame);
+  }
+  forget_spilled_copy(p, entry);
+  entry->used = false;
+  entry->frame = NO_FRAME;
+  p->free_pages[p->nb_free_pages++] = page;
+}
+
+// Pages can't be pinned while the budget changes.
+void pager_set_budget(pager* p, size_t budget) {
+  for (size_t index = 0; index < p->nb_frames; index++) {
+    evict_frame(p, index);
+    free(p->frames[index].data);
+  }
+  p->nb_frames = 0;
+  p->lru_head = NO_FRAME;
+  p->lru_tail = NO_FRAME;
+  p->max_frames = frames_for_budget(budget);
+  p->frames = (frame*)realloc(p->frames, sizeof(frame) * p->max_frames);
+  assert(p->frames != NULL);
+}
+
+void pager_destroy(pager* p) {
+  for (size_t index = 0; index < p->nb_frames; index++) {
+    free(p->frames[index].data);
+  }
+  free(p->frames);
+  for (size_t region = 0; region < p->nb_regions; region++) {
+    if (p->regions[region].address != NULL) {
+      munmap(p->regions[region].address, p->regions[region].length);
+    }
+  }
+  free(p->regions);
+  free(p->pages);
+  free(p->free_pages);
+  for (size_t i = 0; i < p->nb_spills; i++) {
+    if (p->spills[i].file != NULL) {
+      fclose(p->spills[i].file);
+    }
+  }
+  free(p->spills);
+  free(p);
+}
+
+// The pages spilled until now stay in their file, the next ones are written
+// in a new file. Called before a fork.
+void pager_split_spill(pager* p) {
+  if (p->spills[p->nb_spills - 1].nb_pages == 0) {
+    return;
+  }
+  p->spills =
+      (spill_file*)realloc(p->spills, sizeof(spill_file) * (p->nb_spills + 1));
+  assert(p->spills != NULL);
+  p->spills[p->nb_spills].file = NULL;
+  p->spills[p->nb_spills].nb_pages = 0;
+  p->nb_spills++;
+}
+
+// The pool grows instead of evicting pages, so the spill files aren't written
+// anymore. Called by a forked process which shares them.
+void pager_stop_evictions(pager* p) {
+  p->is_growing = true;
+}
+
+void pager_print_stats(pager* p) {
+  printf("Page size: %d B, budget: %ld frames (%ld KiB), %ld frames in use\n",
+         PAGER_PAGE_SIZE, p->max_frames,
+         p->max_frames * PAGER_PAGE_SIZE / 1024, p->nb_frames);
+  printf("Pages: %ld allocated, %ld mapped from a file, %ld free\n",
+         p->nb_pages - p->nb_free_pages, p->nb_mapped_pages,
+         p->nb_free_pages);
+  printf("Hits: %ld, misses: %ld, evictions: %ld, pages written: %ld\n",
+         p->hits, p->misses, p->evictions, p->writes);
+}
+
+int example_pager(void) {
+  // the smallest pool possible, every page after the 16th spills
+  pager* p = pager_create(0);
+  size_t nb_pages = 100;
+  size_t pages[nb_pages];
+  for (size_t i = 0; i < nb_pages; i++) {
+    pages[i] = pager_allocate(p);
+    char* data = (char*)pager_pin(p, pages[i]);
+    assert(data[0] == 0 && data[PAGER_PAGE_SIZE - 1] == 0);
+    memset(data, (int)(i % 128), PAGER_PAGE_SIZE);
+    pager_unpin(p, pages[i], true);
+  }
+  assert(p->writes > 0);
+  for (size_t i = 0; i < nb_pages; i++) {
+    char* data = (char*)pager_pin(p, pages[i]);
+    assert(data[0] == (char)(i % 128));
+    assert(data[PAGER_PAGE_SIZE - 1] == (char)(i % 128));
+    pager_unpin(p, pages[i], false);
+  }
+  assert(p->nb_frames == PAGER_MIN_FRAMES);
+
+  // freed pages are reused and zeroed
+  pager_free(p, pages[3]);
+  size_t page = pager_allocate(p);
+  assert(page == pages[3]);
+  char* data = (char*)pager_pin(p, page);
+  assert(data[0] == 0);
+  pager_unpin(p, page, false);
+
+  // after a split, spilled pages stay as they were in the first file
+  size_t nb_writes = p->writes;
+  data = (char*)pager_pin(p, pages[4]);
+  data[42] = 'x';
+  pager_unpin(p, pages[4], true);
+  pager_split_spill(p);
+  assert(p->nb_spills == 2);
+  for (size_t i = 5; i < nb_pages; i++) {
+    pager_pin(p, pages[i]);
+    pager_unpin(p, pages[i], false);
+  }
+  assert(p->writes > nb_writes && p->pages[pages[4]].spill == 1);
+  char old_copy[PAGER_PAGE_SIZE];
+  assert(pread(fileno(p->spills[0].file), old_copy, PAGER_PAGE_SIZE,
+               (off_t)(pages[4] * PAGER_PAGE_SIZE)) == PAGER_PAGE_SIZE);
+  assert(old_copy[42] == (char)(4 % 128));
+  data = (char*)pager_pin(p, pages[4]);
+  assert(data[42] == 'x');
+  data[42] = (char)(4 % 128);
+  pager_unpin(p, pages[4], true);
+  // without evictions, nothing is written
+  pager_stop_evictions(p);
+  nb_writes = p->writes;
+  for (size_t i = 4; i < nb_pages; i++) {
+    pager_pin(p, pages[i]);
+  }
+  assert(p->writes == nb_writes && p->max_frames >= nb_pages - 4);
+  for (size_t i = 4; i < nb_pages; i++) {
+    pager_unpin(p, pages[i], false);
+  }
+  p->is_growing = false;
+
+  // a larger budget keeps the content
+  pager_set_budget(p, 200 * PAGER_PAGE_SIZE);
+  for (size_t i = 4; i < nb_pages; i++) {
+    data = (char*)pager_pin(p, pages[i]);
+    assert(data[42] == (char)(i % 128));
+    pager_unpin(p, pages[i], false);
+  }
+  // pages mapped from a file are read in place, writes stay private
+  FILE* file = tmpfile();
+  assert(file != NULL);
+  char content[PAGER_PAGE_SIZE];
+  for (int i = 0; i < 3; i++) {
+    memset(content, 'a' + i, PAGER_PAGE_SIZE);
+    fwrite(content, PAGER_PAGE_SIZE, 1, file);
+  }
+  fflush(file);
+  size_t file_pages[2] = {2, 0};
+  size_t mapped[2];
+  memset(content, 'c', PAGER_PAGE_SIZE);
+  uint32_t checksums[2] = {crc32c(0, content, PAGER_PAGE_SIZE), 0};
+  memset(content, 'a', PAGER_PAGE_SIZE);
+  checksums[1] = crc32c(0, content, PAGER_PAGE_SIZE);
+  assert(pager_map(p, fileno(file), 2, file_pages, checksums, mapped));
+  data = (char*)pager_pin(p, mapped[1]);
+  assert(data[0] == 'a');
+  pager_unpin(p, mapped[1], false);
+  data = (char*)pager_pin(p, mapped[0]);
+  assert(data[0] == 'c');
+  data[0] = 'z';
+  pager_unpin(p, mapped[0], true);
+  assert(pread(fileno(file), content, 1, 2 * PAGER_PAGE_SIZE) == 1);
+  assert(content[0] == 'c');
+  pager_free(p, mapped[0]);
+  pager_free(p, mapped[1]);
+  assert(p->nb_mapped_pages == 0);
+  fclose(file);
+
+  pager_print_stats(p);
+  pager_destroy(p);
+
+  printf("done pager\n");
+  return 0;
+}
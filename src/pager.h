@@ -0,0 +1,32 @@
+#ifndef _PAGER_H__
+#define _PAGER_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PAGER_PAGE_SIZE 16384
+#define PAGER_MIN_FRAMES 16
+#define PAGER_DEFAULT_BUDGET (64 * 1024 * 1024)
+
+typedef struct Pager pager;
+
+pager* pager_create(size_t budget);
+void pager_destroy(pager* p);
+void pager_set_budget(pager* p, size_t budget);
+size_t pager_allocate(pager* p);
+bool pager_map(pager* p,
+               int fd,
+               size_t nb_pages,
+               const size_t* file_pages,
+               const uint32_t* checksums,
+               size_t* pages);
+void pager_free(pager* p, size_t page);
+void* pager_pin(pager* p, size_t page);
+void pager_unpin(pager* p, size_t page, bool dirty);
+void pager_split_spill(pager* p);
+void pager_stop_evictions(pager* p);
+void pager_print_stats(pager* p);
+int example_pager(void);
+
+#endif  // _PAGER_H__
@@ -57,6 +57,11 @@ typedef enum Ast_kind {
   FLOAT,       // -14.56
   STRING,      // 'bla'
   L_PAREN,
+  OPTION,      // STORAGE = COLUMNS
+  CREATE_INDEX,  // create index
+  DROP_INDEX,    // drop index
+  INDEXNAME,     // "by_name"
+  VACUUM,        // vacuum
 } ast_kind;
 
 const char* ast_kind_names[] = {
@@ -81,6 +86,11 @@ const char* ast_kind_names[] = {
     [FLOAT] = "FLOAT",
     [STRING] = "STRING",
     [L_PAREN] = "LEFT_PAREN",
+    [OPTION] = "OPTION",
+    [CREATE_INDEX] = "CREATE_INDEX",
+    [DROP_INDEX] = "DROP_INDEX",
+    [INDEXNAME] = "INDEXNAME",
+    [VACUUM] = "VACUUM",
 };
 
 void print_ask_kind(ast_kind kind) {
@@ -134,7 +144,7 @@ void print_ast(ast_node* root) {
   printf("\n=== AST END  ===\n\n");
 }
 
-ast_node* parse_statement(token** tokens, size_t* nb_tokens);
+ast_node* parse_statement(arena* a, token** tokens, size_t* nb_tokens);
 ast_node* parse_drop(token** tokens, size_t* nb_tokens);
 ast_node* parse_insert(token** tokens, size_t* nb_tokens);
 ast_node* parse_tablename(token** tokens, size_t* nb_tokens);
@@ -156,6 +166,10 @@ ast_node* parse_literal_negative_integer(token** tokens, size_t* nb_tokens);
 /* ast_node* parse_comp(token* tokens, size_t* nb_tokens); */
 /* ast_node* parse_type(token* tokens, size_t* nb_tokens); */
 
+// The nodes and their values are allocated in the arena of the statement
+// being parsed.
+static arena* nodes;
+
 // true iff read has same kind as current
 bool expect(token_kind expected, token* current) {
   return expected == current->kind;
@@ -194,15 +208,10 @@ bool is_token_keyword_update(token* tokens) {
 }
 
 ast_node* create_node_root(ast_kind kind, char* description) {
-  ast_node* node = (ast_node*)malloc(sizeof(ast_node));
-  assert(node != NULL);
+  ast_node* node = (ast_node*)arena_alloc(nodes, sizeof(ast_node));
   node->kind = kind;
   node->nb_tokens = 2;
-  char* value = (char*)malloc(sizeof(char) * (strlen(description) + 1));
-  assert(value != NULL);
-
-  strcpy(value, description);
-  node->value = value;
+  node->value = arena_strdup(nodes, description);
   node->left = NULL;
   node->right = NULL;
   return node;
@@ -221,15 +230,14 @@ ast_node* create_node_create(void) {
 }
 
 ast_node* parse_identifier(token** tokens, size_t* nb_tokens) {
-  ast_node* node = (ast_node*)malloc(sizeof(ast_node));
-  assert(node != NULL);
+  ast_node* node = (ast_node*)arena_alloc(nodes, sizeof(ast_node));
   node->kind = TABLENAME;
   node->nb_tokens = 1;
   size_t len = (*tokens)->len;
-  node->value = (char*)malloc(sizeof(char) * (len + 1));
-  assert(node->value != NULL);
+  node->value = (char*)arena_alloc(nodes, sizeof(char) * (len + 1));
   strncpy(node->value, (*tokens)->value, len + 1);
   node->value[len] = '\0';
+  set_leaf(node);
   *nb_tokens = *nb_tokens - 1;
   return node;
 }
@@ -249,41 +257,40 @@ bool is_token_operator(token* tok, char* value) {
 }
 
 ast_node* parse_literal_string(token** tokens, size_t* nb_tokens) {
-  ast_node* node = (ast_node*)malloc(sizeof(ast_node));
-  assert(node != NULL);
+  ast_node* node = (ast_node*)arena_alloc(nodes, sizeof(ast_node));
   node->kind = STRING;
   node->nb_tokens = 1;
   size_t len = (*tokens)->len;
-  char* value = (char*)malloc(sizeof(char) * len);
+  char* value = (char*)arena_alloc(nodes, sizeof(char) * (len + 1));
   strncpy(value, (*tokens)->value, len);
+  value[len] = '\0';
   node->value = value;
+  set_leaf(node);
   *nb_tokens -= 1;
   return node;
 }
 
 ast_node* parse_literal_negative_integer(token** tokens, size_t* nb_tokens) {
-  ast_node* node = (ast_node*)malloc(sizeof(ast_node));
-  assert(node != NULL);
+  ast_node* node = (ast_node*)arena_alloc(nodes, sizeof(ast_node));
   node->kind = INT;
   node->nb_tokens = 2;
-  char* value =
-      (char*)malloc(sizeof(char) * (strlen((*(tokens + 1))->value) + 1));
-  value[0] = '-';
-  strcat(value, (*(tokens + 1))->value);
+  size_t len = strlen((*(tokens + 1))->value) + 2;
+  char* value = (char*)arena_alloc(nodes, sizeof(char) * len);
+  snprintf(value, len, "-%s", (*(tokens + 1))->value);
   node->value = value;
+  set_leaf(node);
   node->i_value = atol(value);
   *nb_tokens -= 2;
   return node;
 }
 
 ast_node* parse_literal_postive_integer(token** tokens, size_t* nb_tokens) {
-  ast_node* node = (ast_node*)malloc(sizeof(ast_node));
-  assert(node != NULL);
+  ast_node* node = (ast_node*)arena_alloc(nodes, sizeof(ast_node));
   node->kind = INT;
   node->nb_tokens = 1;
-  char* value = (char*)malloc(sizeof(char) * strlen((*tokens)->value));
-  strcpy(value, (*tokens)->value);
+  char* value = arena_strdup(nodes, (*tokens)->value);
   node->value = value;
+  set_leaf(node);
   node->i_value = atol(value);
   *nb_tokens -= 1;
   return node;
@@ -295,15 +302,14 @@ ast_node* parse_literal_positive_float(token** tokens, size_t* nb_tokens) {
   unsigned long len_left = strlen(left->value);
   unsigned long len_right = strlen(right->value);
 
-  ast_node* node = (ast_node*)malloc(sizeof(ast_node));
-  assert(node != NULL);
+  ast_node* node = (ast_node*)arena_alloc(nodes, sizeof(ast_node));
   node->kind = FLOAT;
   node->nb_tokens = 3;
-  char* value = (char*)malloc(sizeof(char) * (len_left + 1 + len_right));
-  strcpy(value, left->value);
-  value[len_left] = '.';
-  strcat(value, right->value);
+  size_t len = len_left + 1 + len_right + 1;
+  char* value = (char*)arena_alloc(nodes, sizeof(char) * len);
+  snprintf(value, len, "%s.%s", left->value, right->value);
   node->value = value;
+  set_leaf(node);
   node->f_value = atof(value);
   /* printf("value: char %s float %f\n", node->value, node->f_value); */
   *nb_tokens -= 3;
@@ -316,16 +322,14 @@ ast_node* parse_literal_negative_float(token** tokens, size_t* nb_tokens) {
   unsigned long len_left = strlen(left->value);
   unsigned long len_right = strlen(right->value);
 
-  ast_node* node = (ast_node*)malloc(sizeof(ast_node));
-  assert(node != NULL);
+  ast_node* node = (ast_node*)arena_alloc(nodes, sizeof(ast_node));
   node->kind = FLOAT;
   node->nb_tokens = 4;
-  char* value = (char*)malloc(sizeof(char) * (1 + len_left + 1 + len_right));
-  value[0] = '-';
-  strcat(value, left->value);
-  value[len_left + 1] = '.';
-  strcat(value, right->value);
+  size_t len = 1 + len_left + 1 + len_right + 1;
+  char* value = (char*)arena_alloc(nodes, sizeof(char) * len);
+  snprintf(value, len, "-%s.%s", left->value, right->value);
   node->value = value;
+  set_leaf(node);
   node->f_value = atof(value);
   /* printf("value: char %s float %f\n", node->value, node->f_value); */
   *nb_tokens -= 4;
@@ -365,7 +369,24 @@ ast_node* parse_literal(token** tokens, size_t* nb_tokens) {
   return NULL;
 }
 
+// DROP INDEX "name";
+ast_node* parse_drop_index(token** tokens, size_t* nb_tokens) {
+  if (*nb_tokens < 3 || !expect(IDENTIFIER, *(tokens + 2)) ||
+      !expect(END, *(tokens + 3))) {
+    parser_error("Expected DROP INDEX \"name\";");
+    return NULL;
+  }
+  ast_node* root = create_node_root(DROP_INDEX, "drop_index");
+  root->left = parse_identifier(tokens + 2, nb_tokens);
+  root->left->kind = INDEXNAME;
+  *nb_tokens = 0;
+  return root;
+}
+
 ast_node* parse_drop(token** tokens, size_t* nb_tokens) {
+  if (*nb_tokens > 1 && is_token_keyword_something(*(tokens + 1), "INDEX")) {
+    return parse_drop_index(tokens, nb_tokens);
+  }
   if (*nb_tokens != 3) {
     parser_error(
         "Wrong number of tokens for 'drop table \"tablename\"': expected 4 got "
@@ -579,14 +600,88 @@ ast_node* parse_primary_column(token** tokens, size_t* nb_tokens) {
   if (!expect(IDENTIFIER, *tokens)) {
     parser_error("Expected a column name got %s", (*tokens)->value);
   }
-  col->value = (char*)malloc(sizeof(char) * ((*tokens)->len + 1));
+  col->value = (char*)arena_alloc(nodes, (*tokens)->len + 1);
   strncpy(col->value, (*tokens)->value, (*tokens)->len);
   col->value[(*tokens)->len] = '\0';
   *nb_tokens -= 1;
   return col;
 }
 
+// Options following the columns of a table: STORAGE = COLUMNS, CLUSTER = PK,
+// ENGINE = LSM
+// Options are chained by their left child, the right child holds the value.
+bool parse_table_options(token** tokens,
+                         size_t* nb_tokens,
+                         ast_node** options) {
+  ast_node** last = options;
+  while (expect(KEYWORD, *tokens)) {
+    if (!expect(COMPARISON, *(tokens + 1)) ||
+        strcmp((*(tokens + 1))->value, "=") != 0 ||
+        !expect(KEYWORD, *(tokens + 2))) {
+      parser_error("Expected an option like STORAGE = COLUMNS, got %s",
+                   (*tokens)->value);
+      return false;
+    }
+    ast_node* option = create_node_root(OPTION, (*tokens)->value);
+    option->right = create_node_root(OPTION, (*(tokens + 2))->value);
+    *last = option;
+    last = &option->left;
+    tokens += 3;
+    *nb_tokens -= 3;
+  }
+  if (!expect(END, *tokens)) {
+    parser_error("Expected ; after the columns, got %s", (*tokens)->value);
+    return false;
+  }
+  return true;
+}
+
+// CREATE INDEX "name" ON "table" ("column") USING HASH;
+// The index name is the left child, the table the right one. The column is
+// the left child of the table. The optional USING option is the right child
+// of the name.
+ast_node* parse_create_index(token** tokens, size_t* nb_tokens) {
+  if (*nb_tokens < 8 || !expect(IDENTIFIER, *(tokens + 2)) ||
+      !is_token_keyword_something(*(tokens + 3), "ON") ||
+      !expect(IDENTIFIER, *(tokens + 4)) ||
+      !expect(LEFT_PAREN, *(tokens + 5)) ||
+      !expect(IDENTIFIER, *(tokens + 6)) ||
+      !expect(RIGHT_PAREN, *(tokens + 7))) {
+    parser_error("Expected CREATE INDEX \"name\" ON \"table\" (\"column\");");
+    return NULL;
+  }
+  ast_node* root = create_node_root(CREATE_INDEX, "create_index");
+  root->left = parse_identifier(tokens + 2, nb_tokens);
+  root->left->kind = INDEXNAME;
+  root->right = parse_tablename(tokens + 4, nb_tokens);
+  root->right->left = parse_identifier(tokens + 6, nb_tokens);
+  root->right->left->kind = COLNAME;
+  tokens += 8;
+  if (is_token_keyword_something(*tokens, "USING")) {
+    if (!is_token_keyword_something(*(tokens + 1), "HASH") &&
+        !is_token_keyword_something(*(tokens + 1), "BTREE") &&
+        !is_token_keyword_something(*(tokens + 1), "BLOOM")) {
+      parser_error("Expected USING HASH, BTREE or BLOOM, got %s",
+                   (*(tokens + 1))->value);
+      return NULL;
+    }
+    root->left->right = create_node_root(OPTION, (*tokens)->value);
+    root->left->right->right =
+        create_node_root(OPTION, (*(tokens + 1))->value);
+    tokens += 2;
+  }
+  if (!expect(END, *tokens)) {
+    parser_error("Expected ; after the column, got %s", (*tokens)->value);
+    return NULL;
+  }
+  *nb_tokens = 0;
+  return root;
+}
+
 ast_node* parse_create(token** tokens, size_t* nb_tokens) {
+  if (*nb_tokens > 1 && is_token_keyword_something(*(tokens + 1), "INDEX")) {
+    return parse_create_index(tokens, nb_tokens);
+  }
   if (!is_token_keyword_create(*tokens) ||
       !is_keyword_this(*(tokens + 1), "TABLE")) {
     parser_error("Expected CREATE TABLE.");
@@ -664,6 +759,9 @@ ast_node* parse_create(token** tokens, size_t* nb_tokens) {
     // no other column, advance
     set_leaf(first_col->left);
     /* print_ast(root); */
+    if (!parse_table_options(tokens + 1, nb_tokens, &root->right)) {
+      return NULL;
+    }
     if (*nb_tokens != 1) {
       parser_error("too much tokens left expected 1 got %d", *nb_tokens);
       return NULL;
@@ -696,6 +794,14 @@ ast_node* parse_create(token** tokens, size_t* nb_tokens) {
       current->left = next;
       current->nb_tokens = 7;
       tokens += 4;
+      // varchar(n) DICT: values are replaced by codes in a dictionary
+      if (is_keyword_this(*tokens, "DICT")) {
+        next->right = create_node_root(OPTION, "DICT");
+        set_leaf(next->right);
+        current->nb_tokens += 1;
+        tokens += 1;
+        *nb_tokens -= 1;
+      }
       current = current->left->left;
     } else if (is_keyword_this(*tokens, "int") ||
                is_keyword_this(*tokens, "float")) {
@@ -725,6 +831,9 @@ ast_node* parse_create(token** tokens, size_t* nb_tokens) {
     *nb_tokens -= 1;
   }
   set_leaf(current);
+  if (!parse_table_options(tokens + 1, nb_tokens, &root->right)) {
+    return NULL;
+  }
   table->i_value = nb_attr;
   printf("create table : node table i_value %ld\n", table->i_value);
 
@@ -818,8 +927,11 @@ ast_node* create_comparison(token** tokens, size_t* nb_tokens) {
       parser_error("Cannot merge 2 identical comparisons.");
       return NULL;
     }
-    comp->value = (char*)realloc(comp->value, sizeof(char) * 3);
-    strncat(comp->value, (*(tokens + 1))->value, 1);
+    char* value = (char*)arena_alloc(nodes, sizeof(char) * 3);
+    value[0] = comp->value[0];
+    value[1] = (*(tokens + 1))->value[0];
+    value[2] = '\0';
+    comp->value = value;
     comp->nb_tokens = 2;
     *nb_tokens -= 1;
   }
@@ -841,13 +953,11 @@ ast_node* parse_where(token** tokens, size_t* nb_tokens) {
 
   // create stacks
   stack_node* output;
-  output = (stack_node*)malloc(sizeof(stack_node));
-  assert(output != NULL);
+  output = (stack_node*)arena_alloc(nodes, sizeof(stack_node));
   output->sp = 0;
 
   stack_node* comps;
-  comps = (stack_node*)malloc(sizeof(stack_node));
-  assert(comps != NULL);
+  comps = (stack_node*)arena_alloc(nodes, sizeof(stack_node));
   comps->sp = 0;
 
   // main loop
@@ -867,8 +977,10 @@ ast_node* parse_where(token** tokens, size_t* nb_tokens) {
       if (leaf == NULL) {
         return NULL;
       }
-      // a leaf node decrement the number of tokens, it has to be set back
-      *nb_tokens += leaf->nb_tokens;
+      // a leaf node decrement the number of tokens, it has to be set back.
+      // A float uses 3 tokens.
+      *nb_tokens += 1;
+      tokens += leaf->nb_tokens - 1;
       push(output, leaf);
 
     } else if (is_token_comparison(*tokens)) {
@@ -1058,10 +1170,7 @@ ast_node* parse_select(token** tokens, size_t* nb_tokens) {
   }
   ast_node* tablename_right = parse_tablename(tokens, nb_tokens);
   root->right = tablename_right;
-  tablename_left->value =
-      (char*)malloc(sizeof(char) * (strlen(tablename_right->value) + 1));
-  strncpy(tablename_left->value, tablename_right->value,
-          (strlen(tablename_right->value) + 1));
+  tablename_left->value = arena_strdup(nodes, tablename_right->value);
   /* print_ast(root); */
   if (*nb_tokens <= 1) {
     root->right = NULL;
@@ -1184,7 +1293,22 @@ ast_node* parse_update(token** tokens, size_t* nb_tokens) {
   return NULL;
 }
 
-ast_node* parse_statement(token** tokens, size_t* nb_tokens) {
+// VACUUM; or VACUUM "table"; the table is the left child.
+ast_node* parse_vacuum(token** tokens, size_t* nb_tokens) {
+  ast_node* root = create_node_root(VACUUM, "vacuum");
+  if (expect(IDENTIFIER, *(tokens + 1))) {
+    root->left = parse_tablename(tokens + 1, nb_tokens);
+    tokens += 1;
+  }
+  if (!expect(END, *(tokens + 1))) {
+    parser_error("Expected VACUUM; or VACUUM \"table\";");
+    return NULL;
+  }
+  *nb_tokens = 0;
+  return root;
+}
+
+ast_node* parse_tokens(token** tokens, size_t* nb_tokens) {
   if (*nb_tokens == 0) {
     parser_error("Invalid tokens");
     return NULL;
@@ -1207,31 +1331,20 @@ ast_node* parse_statement(token** tokens, size_t* nb_tokens) {
   if (is_token_keyword_update(*tokens)) {
     return parse_update(tokens, nb_tokens);
   }
+  if (is_token_keyword_something(*tokens, "VACUUM")) {
+    return parse_vacuum(tokens, nb_tokens);
+  }
   parser_error("Couldn't parse statement");
   return NULL;
 }
 
-void destroy_ast(ast_node* node) {
-  if (node == NULL) {
-    return;
-  }
-  /* if (node->value != NULL) { */
-  /*   free(node->value); */
-  /* } */
-  destroy_ast(node->left);
-  destroy_ast(node->right);
-  free(node);
-  /* free(node); */
-  /* ast_node* current = node; */
-  /* ast_node* next; */
-  /* while (current != NULL) { */
-  /*   if (current->value != NULL) { */
-  /*     free(current->value); */
-  /*   } */
-  /*   next = current->left; */
-  /*   free(current); */
-  /*   current = next; */
-  /* } */
+// The tree lives in the arena a, it's released with the other allocations of
+// the statement.
+ast_node* parse_statement(arena* a, token** tokens, size_t* nb_tokens) {
+  nodes = a;
+  ast_node* root = parse_tokens(tokens, nb_tokens);
+  nodes = NULL;
+  return root;
 }
 
 int example_parser(void) {
@@ -1282,20 +1395,23 @@ int example_parser(void) {
   input[22] = "INSERT INTO \"user\" VALUES (456, -123.45, 'abc');";
   // clang-format on
 
+  arena* a = arena_create(ARENA_BLOCK_SIZE);
   for (int j = 0; j < 23; j++) {
     printf("\n%s\n", input[j]);
     token** tokens = (token**)malloc(sizeof(token) * MAXTOKEN);
     assert(tokens != NULL);
-    size_t nb_tokens = lexer(input[j], tokens);
+    size_t nb_tokens = lexer(a, input[j], tokens);
     print_tokens(tokens, nb_tokens);
     printf("\n");
-    ast_node* root = parse_statement(tokens, &nb_tokens);
+    ast_node* root = parse_statement(a, tokens, &nb_tokens);
 
     print_ast(root);
-    /* destroy_ast(root); */
     destroy_tokens(tokens);
-    /* free(tokens); */
+    // every statement reuses the same blocks
+    arena_reset(a);
   }
+  assert(arena_capacity(a) == ARENA_BLOCK_SIZE);
+  arena_destroy(a);
   free(input);
   printf("done\n");
 
@@ -25,6 +25,11 @@ typedef enum Ast_kind {
   FLOAT,       // -14.56
   STRING,      // 'bla'
   L_PAREN,
+  OPTION,      // STORAGE = COLUMNS
+  CREATE_INDEX,  // create index
+  DROP_INDEX,    // drop index
+  INDEXNAME,     // "by_name"
+  VACUUM,        // vacuum
 } ast_kind;
 typedef struct ASTNode {
   ast_kind kind;
@@ -35,8 +40,7 @@ typedef struct ASTNode {
   struct ASTNode* left;
   struct ASTNode* right;
 } ast_node;
-ast_node *parse_statement(token **tokens, size_t *nb_tokens);
+ast_node *parse_statement(arena *a, token **tokens, size_t *nb_tokens);
 void print_ast(ast_node* root);
-void destroy_ast(ast_node *node);
 
 #endif // _PARSER_H__
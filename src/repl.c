@@ -5,7 +5,7 @@ Compile with :
 
 ```sh
 gcc -Wall -Wextra -Wpedantic -Wconversion -g repl.c executer.c parser.c lexer.c
--o ./bin/repl -lreadline; ./bin/repl
+help.c arena.c bloom.c btree.c crc32c.c filter.c hash.c pager.c skiplist.c wal.c -o ./bin/repl -pthread -lreadline; ./bin/repl
 ```
 */
 #include <stdbool.h>
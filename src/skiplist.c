@@ -0,0 +1,243 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "skiplist.h"
+
+struct SkipListNode {
+  size_t row;
+  size_t level;
+  char* key;
+  struct SkipListNode* next[];  // one per level
+};
+
+static skiplist_node* create_node(skiplist* list, size_t level) {
+  skiplist_node* node = (skiplist_node*)malloc(
+      sizeof(skiplist_node) + sizeof(skiplist_node*) * level + list->key_size);
+  assert(node != NULL);
+  node->level = level;
+  node->key = (char*)(node->next + level);
+  for (size_t i = 0; i < level; i++) {
+    node->next[i] = NULL;
+  }
+  return node;
+}
+
+skiplist* skiplist_create(btree_key_kind kind, size_t key_size) {
+  skiplist* list = (skiplist*)malloc(sizeof(skiplist));
+  assert(list != NULL);
+  list->kind = kind;
+  list->key_size = key_size;
+  list->nb_entries = 0;
+  list->level = 1;
+  list->seed = 0x9e3779b97f4a7c15;
+  list->head = create_node(list, SKIPLIST_MAX_LEVEL);
+  return list;
+}
+
+void skiplist_clear(skiplist* list) {
+  skiplist_node* node = list->head->next[0];
+  while (node != NULL) {
+    skiplist_node* next = node->next[0];
+    free(node);
+    node = next;
+  }
+  for (size_t i = 0; i < SKIPLIST_MAX_LEVEL; i++) {
+    list->head->next[i] = NULL;
+  }
+  list->nb_entries = 0;
+  list->level = 1;
+}
+
+void skiplist_destroy(skiplist* list) {
+  if (list == NULL) {
+    return;
+  }
+  skiplist_clear(list);
+  free(list->head);
+  free(list);
+}
+
+// keys may come straight from a row, they aren't always aligned.
+static int compare_keys(skiplist* list, const void* a, const void* b) {
+  long a_int, b_int;
+  double a_flt, b_flt;
+  switch (list->kind) {
+    case BTREE_INT:
+      memcpy(&a_int, a, sizeof(long));
+      memcpy(&b_int, b, sizeof(long));
+      return (a_int > b_int) - (a_int < b_int);
+    case BTREE_FLT:
+      memcpy(&a_flt, a, sizeof(double));
+      memcpy(&b_flt, b, sizeof(double));
+      return (a_flt > b_flt) - (a_flt < b_flt);
+    case BTREE_STR:
+      return strncmp((const char*)a, (const char*)b, list->key_size);
+  }
+  return 0;
+}
+
+// Entries are ordered by key then row, like the entries of a btree.
+static bool is_before(skiplist* list,
+                      skiplist_node* node,
+                      const void* key,
+                      size_t row) {
+  int cmp = compare_keys(list, node->key, key);
+  return cmp < 0 || (cmp == 0 && node->row < row);
+}
+
+// Last node of each list before (key, row), the head when there's none.
+static void find_previous(skiplist* list,
+                          const void* key,
+                          size_t row,
+                          skiplist_node** previous) {
+  skiplist_node* node = list->head;
+  for (size_t i = SKIPLIST_MAX_LEVEL; i-- > 0;) {
+    while (node->next[i] != NULL && is_before(list, node->next[i], key, row)) {
+      node = node->next[i];
+    }
+    previous[i] = node;
+  }
+}
+
+// A node is in the list above with probability 1/2, drawn by xorshift.
+static size_t random_level(skiplist* list) {
+  list->seed ^= list->seed << 13;
+  list->seed ^= list->seed >> 7;
+  list->seed ^= list->seed << 17;
+  size_t level = 1;
+  uint64_t bits = list->seed;
+  while (level < SKIPLIST_MAX_LEVEL && (bits & 1) != 0) {
+    level++;
+    bits >>= 1;
+  }
+  return level;
+}
+
+void skiplist_insert(skiplist* list, const void* key, size_t row) {
+  skiplist_node* previous[SKIPLIST_MAX_LEVEL];
+  find_previous(list, key, row, previous);
+  skiplist_node* node = create_node(list, random_level(list));
+  memcpy(node->key, key, list->key_size);
+  node->row = row;
+  for (size_t i = 0; i < node->level; i++) {
+    node->next[i] = previous[i]->next[i];
+    previous[i]->next[i] = node;
+  }
+  if (node->level > list->level) {
+    list->level = node->level;
+  }
+  list->nb_entries++;
+}
+
+// Remove an entry, false if it isn't there.
+bool skiplist_remove(skiplist* list, const void* key, size_t row) {
+  skiplist_node* previous[SKIPLIST_MAX_LEVEL];
+  find_previous(list, key, row, previous);
+  skiplist_node* node = previous[0]->next[0];
+  if (node == NULL || node->row != row ||
+      compare_keys(list, node->key, key) != 0) {
+    return false;
+  }
+  for (size_t i = 0; i < node->level; i++) {
+    previous[i]->next[i] = node->next[i];
+  }
+  free(node);
+  list->nb_entries--;
+  return true;
+}
+
+// First entry whose key isn't below key, the first entry if key is NULL.
+skiplist_cursor skiplist_seek(skiplist* list, const void* key) {
+  skiplist_cursor cursor;
+  if (key == NULL) {
+    cursor.node = list->head->next[0];
+    return cursor;
+  }
+  skiplist_node* previous[SKIPLIST_MAX_LEVEL];
+  find_previous(list, key, 0, previous);
+  cursor.node = previous[0]->next[0];
+  return cursor;
+}
+
+bool skiplist_cursor_valid(skiplist_cursor* cursor) {
+  return cursor->node != NULL;
+}
+
+void skiplist_cursor_next(skiplist_cursor* cursor) {
+  cursor->node = cursor->node->next[0];
+}
+
+const void* skiplist_cursor_key(skiplist_cursor* cursor) {
+  return cursor->node->key;
+}
+
+size_t skiplist_cursor_row(skiplist_cursor* cursor) {
+  return cursor->node->row;
+}
+
+int example_skiplist(void) {
+  skiplist* list = skiplist_create(BTREE_INT, sizeof(long));
+  size_t nb_keys = 10000;
+  // 7919 is prime, this visits every key in a scrambled order
+  for (size_t i = 0; i < nb_keys; i++) {
+    long key = (long)((i * 7919) % nb_keys);
+    skiplist_insert(list, &key, (size_t)key + 1);
+  }
+  assert(list->nb_entries == nb_keys);
+  assert(list->level > 8 && list->level <= SKIPLIST_MAX_LEVEL);
+  for (long key = 0; key < (long)nb_keys; key++) {
+    skiplist_cursor c = skiplist_seek(list, &key);
+    assert(skiplist_cursor_valid(&c));
+    assert(skiplist_cursor_row(&c) == (size_t)key + 1);
+  }
+  long missing = -3;
+  skiplist_cursor first = skiplist_seek(list, &missing);
+  assert(skiplist_cursor_row(&first) == 1);
+
+  for (long key = 0; key < (long)nb_keys; key += 2) {
+    assert(skiplist_remove(list, &key, (size_t)key + 1));
+  }
+  long removed = 10;
+  assert(!skiplist_remove(list, &removed, 11));
+
+  // ordered iteration from a key which was removed
+  skiplist_cursor cursor = skiplist_seek(list, &removed);
+  long expected = 11;
+  for (; skiplist_cursor_valid(&cursor); skiplist_cursor_next(&cursor)) {
+    long key;
+    memcpy(&key, skiplist_cursor_key(&cursor), sizeof(long));
+    assert(key == expected);
+    expected += 2;
+  }
+  assert(expected == (long)nb_keys + 1);
+  skiplist_destroy(list);
+
+  // duplicated string keys, a deleted row and the row inserted since
+  skiplist* names = skiplist_create(BTREE_STR, 8);
+  char key[8] = "'abc'";
+  for (size_t row = 0; row < 200; row++) {
+    skiplist_insert(names, key, 199 - row);
+  }
+  assert(skiplist_remove(names, key, 42));
+  size_t count = 0;
+  size_t previous = 0;
+  for (skiplist_cursor c = skiplist_seek(names, key);
+       skiplist_cursor_valid(&c); skiplist_cursor_next(&c)) {
+    assert(skiplist_cursor_row(&c) != 42);
+    assert(count == 0 || skiplist_cursor_row(&c) > previous);
+    previous = skiplist_cursor_row(&c);
+    count++;
+  }
+  assert(count == 199);
+  skiplist_clear(names);
+  assert(names->nb_entries == 0);
+  skiplist_cursor empty = skiplist_seek(names, NULL);
+  assert(!skiplist_cursor_valid(&empty));
+  skiplist_destroy(names);
+
+  printf("done skiplist\n");
+  return 0;
+}
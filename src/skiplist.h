@@ -0,0 +1,41 @@
+#ifndef _SKIPLIST_H__
+#define _SKIPLIST_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "btree.h"
+
+#define SKIPLIST_MAX_LEVEL 24
+
+typedef struct SkipListNode skiplist_node;
+
+// Ordered (key, row) pairs in linked lists, each one skipping about half of
+// the nodes of the one below. Keys are compared like the keys of a btree.
+typedef struct SkipList {
+  btree_key_kind kind;
+  size_t key_size;
+  size_t nb_entries;
+  size_t level;   // lists in use
+  uint64_t seed;  // of the levels of the new nodes
+  skiplist_node* head;
+} skiplist;
+
+typedef struct SkipListCursor {
+  skiplist_node* node;
+} skiplist_cursor;
+
+skiplist* skiplist_create(btree_key_kind kind, size_t key_size);
+void skiplist_destroy(skiplist* list);
+void skiplist_clear(skiplist* list);
+void skiplist_insert(skiplist* list, const void* key, size_t row);
+bool skiplist_remove(skiplist* list, const void* key, size_t row);
+skiplist_cursor skiplist_seek(skiplist* list, const void* key);
+bool skiplist_cursor_valid(skiplist_cursor* cursor);
+void skiplist_cursor_next(skiplist_cursor* cursor);
+const void* skiplist_cursor_key(skiplist_cursor* cursor);
+size_t skiplist_cursor_row(skiplist_cursor* cursor);
+int example_skiplist(void);
+
+#endif  // _SKIPLIST_H__
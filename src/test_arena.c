@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+#include "arena.h"
+
+int main(void) {
+  example_arena();
+
+  printf("done tests\n");
+  return 0;
+}
@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+#include "bloom.h"
+
+int main(void) {
+  example_bloom();
+
+  printf("done tests\n");
+  return 0;
+}
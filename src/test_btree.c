@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+#include "btree.h"
+
+int main(void) {
+  example_btree();
+
+  printf("done tests\n");
+  return 0;
+}
@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+#include "crc32c.h"
+
+int main(void) {
+  example_crc32c();
+
+  printf("done tests\n");
+  return 0;
+}
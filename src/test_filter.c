@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+#include "filter.h"
+
+int main(void) {
+  example_filter();
+
+  printf("done tests\n");
+  return 0;
+}
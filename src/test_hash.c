@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+#include "hash.h"
+
+int main(void) {
+  example_hash();
+
+  printf("done tests\n");
+  return 0;
+}
@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+#include "pager.h"
+
+int main(void) {
+  example_pager();
+
+  printf("done tests\n");
+  return 0;
+}
@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+#include "skiplist.h"
+
+int main(void) {
+  example_skiplist();
+
+  printf("done tests\n");
+  return 0;
+}
@@ -0,0 +1,10 @@
+#include <stdio.h>
+
+#include "wal.h"
+
+int main(void) {
+  example_wal();
+
+  printf("done tests\n");
+  return 0;
+}
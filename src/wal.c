@@ -0,0 +1,349 @@
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "wal.h"
+
+// Append only write ahead log. A record is its length, a checksum and its
+// bytes. Records are written as soon as they're appended, they survive a
+// crash of the process. The fsyncs are grouped: the log is synced once the
+// unsynced bytes reach a threshold or after a short interval, by a flusher
+// thread, so a power loss can only lose the records of the last interval.
+//
+// A torn record at the end of the file (length or checksum not matching) is
+// the end of the log, it's cut when the log is opened.
+
+typedef struct RecordHeader {
+  uint32_t length;
+  uint32_t checksum;
+} record_header;
+
+struct Wal {
+  char* path;
+  int fd;
+  size_t written;     // bytes in the log
+  size_t synced;      // bytes known to be on disk
+  size_t generation;  // of the file, a cut or a truncation starts a new one
+
+  size_t interval_ms;
+  size_t bytes;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_t flusher;
+  bool stopping;
+
+  size_t nb_records;
+  size_t nb_syncs;
+  size_t nb_replayed;
+};
+
+// FNV-1a
+static uint32_t checksum(const char* data, size_t length) {
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < length; i++) {
+    hash ^= (unsigned char)data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+// Apply every complete record, returns the length of the valid log.
+static size_t replay(wal* w, bool (*apply)(char* record)) {
+  size_t offset = 0;
+  record_header header;
+  while (pread(w->fd, &header, sizeof(header), (off_t)offset) ==
+         sizeof(header)) {
+    char* record = (char*)malloc((size_t)header.length + 1);
+    assert(record != NULL);
+    ssize_t read = pread(w->fd, record, header.length,
+                         (off_t)(offset + sizeof(header)));
+    if (read != (ssize_t)header.length ||
+        checksum(record, header.length) != header.checksum) {
+      free(record);
+      break;
+    }
+    record[header.length] = '\0';
+    if (apply != NULL) {
+      apply(record);
+      w->nb_replayed++;
+    }
+    free(record);
+    offset += sizeof(header) + header.length;
+  }
+  return offset;
+}
+
+// the lock must be held, it's released during the fsync
+static void sync_locked(wal* w) {
+  if (w->synced == w->written) {
+    return;
+  }
+  size_t target = w->written;
+  size_t generation = w->generation;
+  pthread_mutex_unlock(&w->lock);
+  fdatasync(w->fd);
+  pthread_mutex_lock(&w->lock);
+  // the target is an offset of the file before a cut or a truncation
+  if (generation == w->generation && target > w->synced) {
+    w->synced = target;
+  }
+  w->nb_syncs++;
+}
+
+static void* flush_periodically(void* argument) {
+  wal* w = (wal*)argument;
+  pthread_mutex_lock(&w->lock);
+  while (!w->stopping) {
+    if (w->synced == w->written) {
+      pthread_cond_wait(&w->wake, &w->lock);
+      continue;
+    }
+    // let the other records of the group be appended
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    long nanoseconds = deadline.tv_nsec + (long)w->interval_ms * 1000000;
+    deadline.tv_sec += nanoseconds / 1000000000;
+    deadline.tv_nsec = nanoseconds % 1000000000;
+    while (!w->stopping && w->synced < w->written &&
+           pthread_cond_timedwait(&w->wake, &w->lock, &deadline) !=
+               ETIMEDOUT) {
+    }
+    sync_locked(w);
+  }
+  pthread_mutex_unlock(&w->lock);
+  return NULL;
+}
+
+// Open or create a log, apply its records if apply isn't NULL and get ready
+// to append after the last complete one.
+wal* wal_open(const char* path, bool (*apply)(char* record)) {
+  int fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (fd == -1) {
+    perror("WAL error");
+    return NULL;
+  }
+  wal* w = (wal*)malloc(sizeof(wal));
+  assert(w != NULL);
+  w->path = (char*)malloc(strlen(path) + 1);
+  assert(w->path != NULL);
+  strcpy(w->path, path);
+  w->fd = fd;
+  w->interval_ms = WAL_DEFAULT_INTERVAL_MS;
+  w->bytes = WAL_DEFAULT_BYTES;
+  w->stopping = false;
+  w->nb_records = 0;
+  w->nb_syncs = 0;
+  w->nb_replayed = 0;
+
+  size_t end = replay(w, apply);
+  if (ftruncate(fd, (off_t)end) == -1 ||
+      lseek(fd, (off_t)end, SEEK_SET) == -1) {
+    perror("WAL error");
+  }
+  w->written = end;
+  w->synced = end;
+  w->generation = 0;
+  if (apply != NULL && w->nb_replayed > 0) {
+    printf("Replayed %ld records from %s\n", w->nb_replayed, path);
+  }
+
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->wake, NULL);
+  pthread_create(&w->flusher, NULL, flush_periodically, w);
+  return w;
+}
+
+void wal_close(wal* w) {
+  if (w == NULL) {
+    return;
+  }
+  pthread_mutex_lock(&w->lock);
+  w->stopping = true;
+  pthread_cond_signal(&w->wake);
+  pthread_mutex_unlock(&w->lock);
+  pthread_join(w->flusher, NULL);
+  wal_sync(w);
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->wake);
+  close(w->fd);
+  free(w->path);
+  free(w);
+}
+
+void wal_append(wal* w, const char* record, size_t length) {
+  record_header header;
+  header.length = (uint32_t)length;
+  header.checksum = checksum(record, length);
+  char buffer[sizeof(header) + length];
+  memcpy(buffer, &header, sizeof(header));
+  memcpy(buffer + sizeof(header), record, length);
+  ssize_t written = write(w->fd, buffer, sizeof(buffer));
+  assert(written == (ssize_t)sizeof(buffer));
+
+  pthread_mutex_lock(&w->lock);
+  bool was_synced = w->synced == w->written;
+  w->written += sizeof(buffer);
+  w->nb_records++;
+  if (w->interval_ms == 0 || w->written - w->synced >= w->bytes) {
+    sync_locked(w);
+  } else if (was_synced) {
+    pthread_cond_signal(&w->wake);
+  }
+  pthread_mutex_unlock(&w->lock);
+}
+
+void wal_sync(wal* w) {
+  pthread_mutex_lock(&w->lock);
+  sync_locked(w);
+  pthread_mutex_unlock(&w->lock);
+}
+
+// Every record is in the database file, the log starts over.
+void wal_truncate(wal* w) {
+  pthread_mutex_lock(&w->lock);
+  if (ftruncate(w->fd, 0) == -1 || lseek(w->fd, 0, SEEK_SET) == -1) {
+    perror("WAL error");
+  }
+  fdatasync(w->fd);
+  w->written = 0;
+  w->synced = 0;
+  w->generation++;
+  pthread_mutex_unlock(&w->lock);
+}
+
+size_t wal_size(wal* w) {
+  pthread_mutex_lock(&w->lock);
+  size_t size = w->written;
+  pthread_mutex_unlock(&w->lock);
+  return size;
+}
+
+// The records of the first length bytes are in the database file. The
+// following ones are copied in a new log, which replaces this one.
+void wal_cut(wal* w, size_t length) {
+  pthread_mutex_lock(&w->lock);
+  assert(length <= w->written);
+  char path[strlen(w->path) + 5];
+  snprintf(path, sizeof(path), "%s.tmp", w->path);
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd == -1) {
+    perror("WAL error");
+    pthread_mutex_unlock(&w->lock);
+    return;
+  }
+  char buffer[64 * 1024];
+  for (size_t offset = length; offset < w->written;) {
+    size_t size = w->written - offset < sizeof(buffer) ? w->written - offset
+                                                       : sizeof(buffer);
+    ssize_t read = pread(w->fd, buffer, size, (off_t)offset);
+    assert(read == (ssize_t)size);
+    ssize_t written = write(fd, buffer, size);
+    assert(written == (ssize_t)size);
+    offset += size;
+  }
+  fdatasync(fd);
+  if (rename(path, w->path) == -1 || dup2(fd, w->fd) == -1) {
+    perror("WAL error");
+  }
+  close(fd);
+  w->written -= length;
+  w->synced = w->written;
+  w->generation++;
+  pthread_mutex_unlock(&w->lock);
+}
+
+// An interval of 0 syncs every record.
+void wal_set_group_commit(wal* w, size_t interval_ms, size_t bytes) {
+  pthread_mutex_lock(&w->lock);
+  w->interval_ms = interval_ms;
+  w->bytes = bytes;
+  pthread_mutex_unlock(&w->lock);
+}
+
+void wal_print_stats(wal* w) {
+  pthread_mutex_lock(&w->lock);
+  printf("Group commit: every %ld ms or %ld B\n", w->interval_ms, w->bytes);
+  printf("Log: %ld B, %ld B not synced\n", w->written,
+         w->written - w->synced);
+  printf("Records: %ld appended, %ld replayed, syncs: %ld\n", w->nb_records,
+         w->nb_replayed, w->nb_syncs);
+  pthread_mutex_unlock(&w->lock);
+}
+
+static size_t nb_applied;
+
+static bool count_record(char* record) {
+  char expected[32];
+  snprintf(expected, sizeof(expected), "record %ld", nb_applied);
+  assert(strcmp(record, expected) == 0);
+  nb_applied++;
+  return true;
+}
+
+int example_wal(void) {
+  const char* path = "example.wal";
+  unlink(path);
+
+  wal* w = wal_open(path, count_record);
+  assert(w != NULL && nb_applied == 0);
+  char record[32];
+  for (size_t i = 0; i < 100; i++) {
+    snprintf(record, sizeof(record), "record %ld", i);
+    wal_append(w, record, strlen(record));
+  }
+  wal_close(w);
+
+  // a torn record at the end is ignored and cut
+  int fd = open(path, O_WRONLY | O_APPEND);
+  assert(fd != -1);
+  record_header torn = {20, 0};
+  assert(write(fd, &torn, sizeof(torn)) == sizeof(torn));
+  assert(write(fd, "record", 6) == 6);
+  close(fd);
+
+  w = wal_open(path, count_record);
+  assert(nb_applied == 100);
+  wal_set_group_commit(w, 0, WAL_DEFAULT_BYTES);
+  snprintf(record, sizeof(record), "record %d", 100);
+  wal_append(w, record, strlen(record));
+  wal_print_stats(w);
+  wal_close(w);
+
+  // the records before a snapshot are cut
+  nb_applied = 0;
+  w = wal_open(path, count_record);
+  assert(nb_applied == 101);
+  size_t snapshot = wal_size(w);
+  for (size_t i = 101; i < 110; i++) {
+    snprintf(record, sizeof(record), "record %ld", i);
+    wal_append(w, record, strlen(record));
+  }
+  wal_cut(w, snapshot);
+  snprintf(record, sizeof(record), "record %d", 110);
+  wal_append(w, record, strlen(record));
+  wal_close(w);
+  nb_applied = 101;
+  w = wal_open(path, count_record);
+  assert(nb_applied == 111);
+  wal_truncate(w);
+  wal_close(w);
+
+  nb_applied = 0;
+  w = wal_open(path, count_record);
+  assert(nb_applied == 0);
+  wal_close(w);
+  unlink(path);
+
+  printf("done wal\n");
+  return 0;
+}
@@ -0,0 +1,23 @@
+#ifndef _WAL_H__
+#define _WAL_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define WAL_DEFAULT_INTERVAL_MS 10
+#define WAL_DEFAULT_BYTES (64 * 1024)
+
+typedef struct Wal wal;
+
+wal* wal_open(const char* path, bool (*apply)(char* record));
+void wal_close(wal* w);
+void wal_append(wal* w, const char* record, size_t length);
+void wal_sync(wal* w);
+void wal_truncate(wal* w);
+size_t wal_size(wal* w);
+void wal_cut(wal* w, size_t length);
+void wal_set_group_commit(wal* w, size_t interval_ms, size_t bytes);
+void wal_print_stats(wal* w);
+int example_wal(void);
+
+#endif  // _WAL_H__